@@ -0,0 +1,102 @@
+#include <windows.h>
+#include <iostream>
+#include <cstdlib>
+#include <new>
+#include "model.h"
+#include "sphericalModel.h"
+#include "loopScheduler.h"
+
+// Benchmark of the model step, which runs in the control loop (separate executable, not part of the experiment program)
+// Usage: BenchmarkModel [number of steps]
+// For each model, measures the mean and worst duration of one step (model update + force computation) and checks that no memory is allocated during the steps
+// The time budget of one step is the period of the control loop (CONTROL_LOOP_PERIOD, 10 ms, of which the HM communication already takes most)
+
+static unsigned long nbAllocations = 0; // counted by the global operator new below
+
+void* operator new(size_t size)
+{
+	nbAllocations++;
+	void *p = malloc(size);
+	if (p == NULL)
+		throw std::bad_alloc();
+	return p;
+}
+
+void operator delete(void *p) throw()
+{
+	free(p);
+}
+
+
+// Cart acceleration imposed during the benchmark: back and forth motion, large enough to swing the ball far from the bottom of the cup
+double CartAcceleration(int step, double timeStep)
+{
+	return 5. * sin(2. * 3.1415926 * 1.2 * step * timeStep);
+}
+
+
+void PrintResult(const char *name, int nbSteps, double totalTime, double worstTime, unsigned long allocations, double timeStep)
+{
+	std::cout << name << ": " << 1e6 * totalTime / nbSteps << " us per step (worst " << 1e6 * worstTime << " us, " << 100. * worstTime / timeStep << "% of the loop period), "
+		<< allocations << " allocations" << std::endl;
+}
+
+
+int main(int argc, char** argv)
+{
+	int nbSteps = 1000000;
+	if (argc > 1)
+		nbSteps = atoi(argv[1]);
+	double timeStep = CONTROL_LOOP_PERIOD / 1000.; // (s) period of the control loop
+	double mass = 0.6, length = 0.45, damping = 0.005; // same order of magnitude as in param.txt
+	unsigned __int64 timerFrequency, startStamp, stepStartStamp, stepEndStamp;
+	QueryPerformanceFrequency((LARGE_INTEGER*)&timerFrequency);
+
+	Model model(mass, length, damping, 0., 0.);
+	Model smallAngleModel(mass, length, damping, 0., 0.);
+	smallAngleModel.SetSmallAngleApproximation(5. * 3.1415926 / 180.);
+	SphericalModel sphericalModel(mass, length, damping, 0., 0.);
+	double checksum = 0.; // printed so that the computations are not optimized away
+
+	for (int m=0; m<3; m++)
+	{
+		double totalTime = 0., worstTime = 0.;
+		unsigned long allocationsBefore = nbAllocations;
+		QueryPerformanceCounter((LARGE_INTEGER*)&startStamp);
+		for (int i=0; i<nbSteps; i++)
+		{
+			double acceleration = CartAcceleration(i, timeStep);
+			double force, forceAcross;
+			QueryPerformanceCounter((LARGE_INTEGER*)&stepStartStamp);
+			if (m == 0)
+			{
+				model.UpdatePendulumState(acceleration, timeStep);
+				force = model.ComputePendulumForceOnCart(acceleration);
+			}
+			else if (m == 1)
+			{
+				smallAngleModel.UpdatePendulumState(acceleration, timeStep);
+				force = smallAngleModel.ComputePendulumForceOnCart(acceleration);
+			}
+			else
+			{
+				sphericalModel.UpdatePendulumState(acceleration, 0.5 * acceleration, timeStep);
+				sphericalModel.ComputePendulumForceOnCart(force, forceAcross);
+			}
+			QueryPerformanceCounter((LARGE_INTEGER*)&stepEndStamp);
+			double stepTime = (1. * (stepEndStamp - stepStartStamp)) / timerFrequency;
+			totalTime += stepTime;
+			if (stepTime > worstTime)
+				worstTime = stepTime;
+			checksum += force;
+		}
+		if (m == 0)
+			PrintResult("1D model (RK4)", nbSteps, totalTime, worstTime, nbAllocations - allocationsBefore, timeStep);
+		else if (m == 1)
+			PrintResult("1D model (small-angle fast path below 5 deg)", nbSteps, totalTime, worstTime, nbAllocations - allocationsBefore, timeStep);
+		else
+			PrintResult("2D model (spherical pendulum, RK4)", nbSteps, totalTime, worstTime, nbAllocations - allocationsBefore, timeStep);
+	}
+	std::cout << "(checksum " << checksum << ")" << std::endl;
+	return 0;
+}
@@ -0,0 +1,55 @@
+#include "parseParamFile.h"
+#include "viability.h"
+#include "loopScheduler.h"
+
+// Offline generator of the viability (escape-risk) table used by the cup task (separate executable, not part of the experiment program)
+// Usage: GenerateViabilityTable [output file]
+// The physical parameters are read in the same param.txt file as the experiment, so the table always matches the block it is generated for
+// The table must be generated again each time one of the cart-pendulum parameters (or accelerationAmplification, maxCartAcceleration, or the period of the control loop) is modified
+
+int main(int argc, char** argv)
+{
+	std::string table_filename = "viability.bin"; // default file loaded by the experiment at startup
+	if (argc > 1)
+		table_filename = argv[1];
+
+	double gravity = 9.81; // must be the same as in Display
+	int nbAngles = 401;
+	int nbVelocities = 401;
+	int nbAccelerations = 21; // discretization of the bounded cart acceleration (the extreme values are always included)
+	double timeStep = CONTROL_LOOP_PERIOD / 1000.; // (s) period of the control loop, the table is only used by a task running at this period
+
+	const std::string param_filename = "param.txt";
+	std::string output_filename = "Default";
+	std::vector<std::pair<std::string, std::string> > param_name_type;
+	std::map<std::string, int> param_map_int;
+	std::map<std::string, bool> param_map_bool;
+	std::map<std::string, double> param_map_double;
+
+	param_name_type.push_back(std::pair<std::string, std::string>("accelerationAmplification", TYPE_DOUBLE));
+	param_name_type.push_back(std::pair<std::string, std::string>("maxCartAcceleration", TYPE_DOUBLE));		// (m/s/s) maximal acceleration the subject can give to the HM
+	param_name_type.push_back(std::pair<std::string, std::string>("arcCup", TYPE_DOUBLE));					// (degrees)
+	param_name_type.push_back(std::pair<std::string, std::string>("pendulumMass", TYPE_DOUBLE));				// (kg)
+	param_name_type.push_back(std::pair<std::string, std::string>("pendulumLength", TYPE_DOUBLE));			// (m)
+	param_name_type.push_back(std::pair<std::string, std::string>("pendulumDamping", TYPE_DOUBLE));			// (N.m.s)
+
+	if(parseParamFile(param_filename, output_filename, param_name_type, param_map_int, param_map_bool, param_map_double) == -1)
+		return -1;
+
+	param_map_double["arcCup"] *= 3.1415926 / 180.;
+
+	std::cout << "Computing viability table..." << std::endl;
+	ViabilityTable table;
+	table.Compute(param_map_double["pendulumMass"],
+				  param_map_double["pendulumLength"],
+				  param_map_double["pendulumDamping"],
+				  param_map_double["arcCup"],
+				  gravity,
+				  param_map_double["accelerationAmplification"] * param_map_double["maxCartAcceleration"], // the model sees the amplified acceleration
+				  nbAngles, nbVelocities, nbAccelerations, timeStep);
+
+	if (table.Save(table_filename) != 0)
+		return -1;
+	std::cout << "Viability table written in " << table_filename << std::endl;
+	return 0;
+}
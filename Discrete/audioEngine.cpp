@@ -0,0 +1,561 @@
+#include "audioEngine.h"
+#include "Mmsystem.h" // waveOut, after windows.h
+#include <cstring>
+#include <math.h>
+
+#define AUDIO_WAIT_TIMEOUT 100 // (ms) the audio thread checks that it is still running at least this often
+
+struct AudioEngine::Device
+{
+	HWAVEOUT waveOut;
+	HANDLE bufferEvent; // set by the device when a buffer has been played
+	WAVEHDR headers[AUDIO_NB_BUFFERS];
+	short buffers[AUDIO_NB_BUFFERS][AUDIO_BUFFER_FRAMES * AUDIO_NB_CHANNELS];
+};
+
+
+static unsigned int ReadLittleEndian(const char *bytes, int nbBytes)
+{
+	unsigned int value = 0;
+	for (int i=nbBytes-1; i>=0; i--)
+		value = (value << 8) | (unsigned char)bytes[i];
+	return value;
+}
+
+
+static void WriteLittleEndian(std::ofstream &file, unsigned int value, int nbBytes)
+{
+	for (int i=0; i<nbBytes; i++)
+		file.put((char)((value >> (8 * i)) & 0xFF));
+}
+
+
+AudioEngine::AudioEngine()
+{
+	sinkType = AUDIO_SINK_NULL;
+	QueryPerformanceFrequency((LARGE_INTEGER *)&timerFrequency);
+	nbRequests = 0;
+	nbTakenRequests = 0;
+	for (int i=0; i<AUDIO_MAX_VOICES; i++)
+		voices[i].cue = -1;
+	nbMixedFrames = 0;
+	streamStartTime = 0.;
+	isClockSet = false;
+	originTime = 0.;
+	originFrame = 0;
+	nbOnsets = 0;
+	nbUnderruns = 0;
+	pDevice = NULL;
+	nbFileFrames = 0;
+	isTimerPeriodSet = false;
+	isRunning = false;
+}
+
+AudioEngine::~AudioEngine()
+{
+	Stop();
+}
+
+
+int AudioEngine::LoadCue(const std::string &name, const std::string &filename)
+{
+	Cue cue;
+	cue.name = name;
+	if (DecodeWavFile(filename, cue.samples) != 0)
+	{
+		std::cout << "Error: the sound " << filename << " cannot be read (PCM or float WAV file expected), the " << name << " cue is not played" << std::endl;
+		return -1;
+	}
+	cues.push_back(cue);
+	return (int)cues.size() - 1;
+}
+
+
+int AudioEngine::DecodeWavFile(const std::string &filename, std::vector<short> &samples)
+{
+	std::ifstream wavFile(filename.c_str(), std::ios::in | std::ios::binary);
+	if (!wavFile.is_open())
+		return -1;
+	std::vector<char> bytes((std::istreambuf_iterator<char>(wavFile)), std::istreambuf_iterator<char>());
+	if (bytes.size() < 12 || memcmp(&bytes[0], "RIFF", 4) != 0 || memcmp(&bytes[8], "WAVE", 4) != 0)
+		return -1;
+
+	// Chunks: the format and the samples, the others are skipped
+	unsigned int formatTag = 0, nbChannels = 0, sampleRate = 0, nbBits = 0;
+	size_t dataStart = 0, dataSize = 0;
+	size_t position = 12;
+	while (position + 8 <= bytes.size())
+	{
+		size_t chunkSize = ReadLittleEndian(&bytes[position + 4], 4);
+		size_t body = position + 8;
+		if (memcmp(&bytes[position], "fmt ", 4) == 0 && chunkSize >= 16 && body + 16 <= bytes.size())
+		{
+			formatTag = ReadLittleEndian(&bytes[body], 2);
+			nbChannels = ReadLittleEndian(&bytes[body + 2], 2);
+			sampleRate = ReadLittleEndian(&bytes[body + 4], 4);
+			nbBits = ReadLittleEndian(&bytes[body + 14], 2);
+			if (formatTag == 0xFFFE && chunkSize >= 26 && body + 26 <= bytes.size()) // WAVE_FORMAT_EXTENSIBLE: the format is the start of the sub-format
+				formatTag = ReadLittleEndian(&bytes[body + 24], 2);
+		}
+		else if (memcmp(&bytes[position], "data", 4) == 0)
+		{
+			dataStart = body;
+			dataSize = min(chunkSize, bytes.size() - body);
+		}
+		position = body + chunkSize + (chunkSize & 1); // chunks are aligned on 2 bytes
+	}
+	bool isInteger = (formatTag == 1 && (nbBits == 8 || nbBits == 16 || nbBits == 24 || nbBits == 32));
+	bool isFloat = (formatTag == 3 && nbBits == 32);
+	if ((!isInteger && !isFloat) || nbChannels == 0 || sampleRate == 0 || dataStart == 0)
+		return -1;
+
+	// Samples between -1 and 1 (a mono file is played on both channels, the channels beyond AUDIO_NB_CHANNELS are ignored)
+	size_t bytesPerSample = nbBits / 8;
+	size_t nbFrames = dataSize / (nbChannels * bytesPerSample);
+	if (nbFrames == 0)
+		return -1;
+	std::vector<float> frames(nbFrames * AUDIO_NB_CHANNELS);
+	for (size_t i=0; i<nbFrames; i++)
+		for (int channel=0; channel<AUDIO_NB_CHANNELS; channel++)
+		{
+			const char *sample = &bytes[dataStart + (i * nbChannels + min(channel, (int)nbChannels - 1)) * bytesPerSample];
+			float value;
+			if (isFloat)
+				memcpy(&value, sample, 4);
+			else if (nbBits == 8) // unsigned
+				value = ((int)(unsigned char)sample[0] - 128) / 128.f;
+			else // signed, sign of the most significant byte
+				value = (float)((int)(ReadLittleEndian(sample, (int)bytesPerSample) << (32 - nbBits)) / 2147483648.);
+			frames[i * AUDIO_NB_CHANNELS + channel] = value;
+		}
+
+	// Linear interpolation to the rate of the output
+	size_t nbOutputFrames = (size_t)((double)nbFrames * AUDIO_SAMPLE_RATE / sampleRate);
+	if (nbOutputFrames == 0)
+		return -1;
+	samples.resize(nbOutputFrames * AUDIO_NB_CHANNELS);
+	for (size_t i=0; i<nbOutputFrames; i++)
+	{
+		double x = (double)i * sampleRate / AUDIO_SAMPLE_RATE;
+		size_t previous = (size_t)x;
+		size_t next = min(previous + 1, nbFrames - 1);
+		double fraction = x - previous;
+		for (int channel=0; channel<AUDIO_NB_CHANNELS; channel++)
+		{
+			double value = (1. - fraction) * frames[previous * AUDIO_NB_CHANNELS + channel] + fraction * frames[next * AUDIO_NB_CHANNELS + channel];
+			samples[i * AUDIO_NB_CHANNELS + channel] = (short)max(-32768., min(32767., floor(value * 32767. + 0.5)));
+		}
+	}
+	return 0;
+}
+
+
+int AudioEngine::Start(int sink, const std::string &filename)
+{
+	if (isRunning)
+		return -1;
+	if (sink != AUDIO_SINK_DEVICE && sink != AUDIO_SINK_NULL && sink != AUDIO_SINK_FILE)
+	{
+		std::cout << "Unknown audio sink " << sink << ", the cues are not played" << std::endl;
+		return -1;
+	}
+	sinkType = sink;
+	onsets.resize(AUDIO_MAX_ONSETS); // not in the audio thread
+	nbOnsets = 0;
+	nbUnderruns = 0;
+	nbRequests = 0;
+	nbTakenRequests = 0;
+	for (int i=0; i<AUDIO_MAX_VOICES; i++)
+		voices[i].cue = -1;
+	nbMixedFrames = 0;
+	isClockSet = false;
+	originTime = 0.;
+	originFrame = 0;
+
+	if (sinkType == AUDIO_SINK_FILE && OpenFile(filename) != 0)
+	{
+		std::cout << "Error on file opening: " << filename << ", the cues are not played" << std::endl;
+		return -1;
+	}
+	if (sinkType == AUDIO_SINK_DEVICE)
+	{
+		WAVEFORMATEX format;
+		memset(&format, 0, sizeof(format));
+		format.wFormatTag = WAVE_FORMAT_PCM;
+		format.nChannels = AUDIO_NB_CHANNELS;
+		format.nSamplesPerSec = AUDIO_SAMPLE_RATE;
+		format.wBitsPerSample = 16;
+		format.nBlockAlign = AUDIO_NB_CHANNELS * 2;
+		format.nAvgBytesPerSec = AUDIO_SAMPLE_RATE * format.nBlockAlign;
+		pDevice = new Device();
+		pDevice->bufferEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+		if (pDevice->bufferEvent == NULL || waveOutOpen(&pDevice->waveOut, WAVE_MAPPER, &format, (DWORD_PTR)pDevice->bufferEvent, 0, CALLBACK_EVENT) != MMSYSERR_NOERROR)
+		{
+			std::cout << "Error: the audio device cannot be opened, the cues are not played" << std::endl;
+			if (pDevice->bufferEvent != NULL)
+				CloseHandle(pDevice->bufferEvent);
+			delete pDevice;
+			pDevice = NULL;
+			return -1;
+		}
+		for (int i=0; i<AUDIO_NB_BUFFERS; i++)
+		{
+			memset(&pDevice->headers[i], 0, sizeof(WAVEHDR));
+			pDevice->headers[i].lpData = (LPSTR)pDevice->buffers[i];
+			pDevice->headers[i].dwBufferLength = sizeof(pDevice->buffers[i]);
+			waveOutPrepareHeader(pDevice->waveOut, &pDevice->headers[i], sizeof(WAVEHDR));
+		}
+	}
+	else if (timeBeginPeriod(1) == TIMERR_NOERROR) // the thread sleeps by 1 ms between two buffers
+		isTimerPeriodSet = true;
+
+	// The device starts playing with the first buffers, of silence (the estimate of the clock is then corrected from its position)
+	streamStartTime = GetTime();
+	for (int i=0; i<AUDIO_NB_BUFFERS; i++)
+		if (sinkType == AUDIO_SINK_DEVICE)
+		{
+			MixBuffer(pDevice->buffers[i]);
+			waveOutWrite(pDevice->waveOut, &pDevice->headers[i], sizeof(WAVEHDR));
+		}
+		else
+			WriteBuffer();
+	isRunning = true;
+	audioThread = std::thread(&AudioEngine::Run, this);
+	SetThreadPriority((HANDLE)audioThread.native_handle(), THREAD_PRIORITY_HIGHEST);
+	return 0;
+}
+
+
+void AudioEngine::Stop()
+{
+	if (!isRunning)
+		return;
+	isRunning = false;
+	if (pDevice != NULL)
+		SetEvent(pDevice->bufferEvent);
+	audioThread.join();
+
+	if (pDevice != NULL)
+	{
+		waveOutReset(pDevice->waveOut); // returns all the buffers
+		for (int i=0; i<AUDIO_NB_BUFFERS; i++)
+			waveOutUnprepareHeader(pDevice->waveOut, &pDevice->headers[i], sizeof(WAVEHDR));
+		waveOutClose(pDevice->waveOut);
+		CloseHandle(pDevice->bufferEvent);
+		delete pDevice;
+		pDevice = NULL;
+	}
+	if (isTimerPeriodSet)
+	{
+		timeEndPeriod(1);
+		isTimerPeriodSet = false;
+	}
+	if (sinkType == AUDIO_SINK_FILE)
+		CloseFile();
+}
+
+
+bool AudioEngine::Play(int cue)
+{
+	if (cue < 0 || cue >= (int)cues.size())
+		return false;
+	Request request;
+	request.cue = cue;
+	request.isScheduled = false;
+	request.originTime = 0.;
+	request.delay = 0.;
+	return PushRequest(request);
+}
+
+
+bool AudioEngine::PlayAt(int cue, double originTime, double delay)
+{
+	if (cue < 0 || cue >= (int)cues.size() || delay < 0.)
+		return false;
+	Request request;
+	request.cue = cue;
+	request.isScheduled = true;
+	request.originTime = originTime;
+	request.delay = delay;
+	return PushRequest(request);
+}
+
+
+bool AudioEngine::CancelScheduled()
+{
+	Request request;
+	request.cue = -1;
+	request.isScheduled = false;
+	request.originTime = 0.;
+	request.delay = 0.;
+	return PushRequest(request);
+}
+
+
+bool AudioEngine::PushRequest(const Request &request)
+{
+	if (!isRunning)
+		return false;
+	unsigned int index = nbRequests.load(std::memory_order_relaxed);
+	if (index - nbTakenRequests.load(std::memory_order_acquire) >= AUDIO_REQUEST_QUEUE_SIZE)
+		return false;
+	requests[index % AUDIO_REQUEST_QUEUE_SIZE] = request;
+	requests[index % AUDIO_REQUEST_QUEUE_SIZE].time = GetTime();
+	nbRequests.store(index + 1, std::memory_order_release);
+	return true;
+}
+
+
+unsigned int AudioEngine::GetNbOnsets()
+{
+	return nbOnsets.load(std::memory_order_acquire);
+}
+
+
+AudioOnset AudioEngine::GetOnset(unsigned int index)
+{
+	return onsets[index];
+}
+
+
+int AudioEngine::WriteOnsets(const std::string &filename)
+{
+	std::ofstream onsets_file(filename.c_str());
+	if (!onsets_file)
+	{
+		std::cout << "Error on file opening: " << filename << std::endl;
+		return -1;
+	}
+	onsets_file << "Cue,Request_Time (s),Scheduled_Time (s),Onset_Time (s),Latency (ms),Onset_Frame" << std::endl;
+	unsigned int nbLoggedOnsets = GetNbOnsets();
+	for (unsigned int i=0; i<nbLoggedOnsets; i++)
+	{
+		char line[256];
+		// The latency of a scheduled cue is from its scheduled time (0 when it is on time)
+		double latency = onsets[i].onsetTime - ((onsets[i].scheduledTime > 0.) ? onsets[i].scheduledTime : onsets[i].requestTime);
+		sprintf_s(line, "%s,%.6f,%.6f,%.6f,%.3f,%llu", cues[onsets[i].cue].name.c_str(), onsets[i].requestTime, onsets[i].scheduledTime, onsets[i].onsetTime, 1000. * latency, (unsigned long long)onsets[i].onsetFrame);
+		onsets_file << line << std::endl;
+	}
+	onsets_file.close();
+	if (onsets_file.fail())
+		return -1;
+	return 0;
+}
+
+
+unsigned int AudioEngine::GetNbUnderruns()
+{
+	return nbUnderruns;
+}
+
+
+void AudioEngine::Run()
+{
+	if (sinkType == AUDIO_SINK_DEVICE)
+	{
+		unsigned int nextBuffer = 0; // the device returns the buffers in the order they were written
+		while (isRunning)
+		{
+			WaitForSingleObject(pDevice->bufferEvent, AUDIO_WAIT_TIMEOUT);
+			if (!isRunning)
+				break;
+			UpdateClock();
+			int nbPlayedBuffers = 0;
+			for (int i=0; i<AUDIO_NB_BUFFERS; i++)
+				if (pDevice->headers[i].dwFlags & WHDR_DONE)
+					nbPlayedBuffers++;
+			if (nbPlayedBuffers == AUDIO_NB_BUFFERS)
+				nbUnderruns++;
+			while (pDevice->headers[nextBuffer].dwFlags & WHDR_DONE)
+			{
+				MixBuffer(pDevice->buffers[nextBuffer]);
+				waveOutWrite(pDevice->waveOut, &pDevice->headers[nextBuffer], sizeof(WAVEHDR));
+				nextBuffer = (nextBuffer + 1) % AUDIO_NB_BUFFERS;
+			}
+		}
+	}
+	else
+	{
+		// As a device: a buffer is mixed when the one AUDIO_NB_BUFFERS before has been played, at the rate of the clock
+		while (isRunning)
+		{
+			double playedTime = streamStartTime + ((double)nbMixedFrames - AUDIO_NB_BUFFERS * AUDIO_BUFFER_FRAMES) / AUDIO_SAMPLE_RATE;
+			if (GetTime() < playedTime)
+			{
+				Sleep(1);
+				continue;
+			}
+			WriteBuffer();
+		}
+	}
+}
+
+
+void AudioEngine::WriteBuffer()
+{
+	MixBuffer(fileBuffer);
+	if (sinkType == AUDIO_SINK_FILE)
+	{
+		file.write((const char *)fileBuffer, sizeof(fileBuffer));
+		nbFileFrames += AUDIO_BUFFER_FRAMES;
+	}
+}
+
+
+void AudioEngine::TakeRequests()
+{
+	unsigned int nbAvailableRequests = nbRequests.load(std::memory_order_acquire);
+	unsigned int index = nbTakenRequests.load(std::memory_order_relaxed);
+	for (; index!=nbAvailableRequests; index++)
+	{
+		Request request = requests[index % AUDIO_REQUEST_QUEUE_SIZE];
+		nbTakenRequests.store(index + 1, std::memory_order_release);
+
+		if (request.cue < 0) // cancel the cues which have not started
+		{
+			for (int i=0; i<AUDIO_MAX_VOICES; i++)
+				if (voices[i].cue >= 0 && voices[i].startFrame >= nbMixedFrames)
+					voices[i].cue = -1;
+			continue;
+		}
+
+		// A free voice, otherwise the one which has played the longest
+		int voice = 0;
+		for (int i=0; i<AUDIO_MAX_VOICES; i++)
+		{
+			if (voices[i].cue < 0)
+			{
+				voice = i;
+				break;
+			}
+			if (voices[i].position > voices[voice].position)
+				voice = i;
+		}
+		voices[voice].cue = request.cue;
+		voices[voice].position = 0;
+		voices[voice].onset.cue = request.cue;
+		voices[voice].onset.requestTime = request.time;
+		voices[voice].startFrame = nbMixedFrames; // from this buffer
+		if (request.isScheduled)
+		{
+			// The origin is converted with the current estimate of the clock once, the cues scheduled from it are then at exact intervals
+			if (request.originTime != originTime || originFrame == 0)
+			{
+				originTime = request.originTime;
+				originFrame = (unsigned __int64)max(floor((originTime - streamStartTime) * AUDIO_SAMPLE_RATE + 0.5), 1.);
+			}
+			unsigned __int64 scheduledFrame = originFrame + (unsigned __int64)floor(request.delay * AUDIO_SAMPLE_RATE + 0.5);
+			if (scheduledFrame > nbMixedFrames) // otherwise late: from this buffer
+				voices[voice].startFrame = scheduledFrame;
+			voices[voice].onset.scheduledTime = originTime + request.delay;
+			voices[voice].onset.onsetTime = originTime + ((double)voices[voice].startFrame - (double)originFrame) / AUDIO_SAMPLE_RATE;
+		}
+		else
+		{
+			voices[voice].onset.scheduledTime = 0.;
+			voices[voice].onset.onsetTime = streamStartTime + (double)voices[voice].startFrame / AUDIO_SAMPLE_RATE;
+		}
+		voices[voice].onset.onsetFrame = voices[voice].startFrame;
+	}
+}
+
+
+void AudioEngine::MixBuffer(short *buffer)
+{
+	// The new requests start at the beginning of this buffer at the earliest
+	TakeRequests();
+
+	memset(mixBuffer, 0, sizeof(mixBuffer));
+	unsigned __int64 endFrame = nbMixedFrames + AUDIO_BUFFER_FRAMES;
+	for (int i=0; i<AUDIO_MAX_VOICES; i++)
+	{
+		if (voices[i].cue < 0 || voices[i].startFrame >= endFrame)
+			continue;
+		if (voices[i].position == 0)
+		{
+			unsigned int onsetIndex = nbOnsets.load(std::memory_order_relaxed);
+			if (onsetIndex < AUDIO_MAX_ONSETS)
+			{
+				onsets[onsetIndex] = voices[i].onset;
+				nbOnsets.store(onsetIndex + 1, std::memory_order_release);
+			}
+		}
+		size_t offset = (voices[i].startFrame > nbMixedFrames) ? (size_t)(voices[i].startFrame - nbMixedFrames) : 0; // first frame of the cue in this buffer
+		const std::vector<short> &samples = cues[voices[i].cue].samples;
+		size_t nbCueFrames = samples.size() / AUDIO_NB_CHANNELS;
+		size_t nbFrames = min(nbCueFrames - voices[i].position, (size_t)AUDIO_BUFFER_FRAMES - offset);
+		const short *source = &samples[voices[i].position * AUDIO_NB_CHANNELS];
+		int *destination = &mixBuffer[offset * AUDIO_NB_CHANNELS];
+		for (size_t j=0; j<nbFrames*AUDIO_NB_CHANNELS; j++)
+			destination[j] += source[j];
+		voices[i].position += nbFrames;
+		if (voices[i].position >= nbCueFrames)
+			voices[i].cue = -1;
+	}
+	for (int j=0; j<AUDIO_BUFFER_FRAMES*AUDIO_NB_CHANNELS; j++)
+		buffer[j] = (short)max(-32768, min(32767, mixBuffer[j]));
+	nbMixedFrames = endFrame;
+}
+
+
+void AudioEngine::UpdateClock()
+{
+	// The position is read just after the time: it is at most the duration of the call late
+	MMTIME position;
+	position.wType = TIME_SAMPLES;
+	double time = GetTime();
+	if (waveOutGetPosition(pDevice->waveOut, &position, sizeof(MMTIME)) != MMSYSERR_NOERROR || position.wType != TIME_SAMPLES)
+		return;
+	double estimate = time - (double)position.u.sample / AUDIO_SAMPLE_RATE;
+	if (!isClockSet)
+	{
+		streamStartTime = estimate;
+		isClockSet = true;
+	}
+	else
+		streamStartTime += AUDIO_CLOCK_SMOOTHING * (estimate - streamStartTime);
+}
+
+
+double AudioEngine::GetTime()
+{
+	unsigned __int64 timeStamp;
+	QueryPerformanceCounter((LARGE_INTEGER *)&timeStamp);
+	return (1. * timeStamp) / timerFrequency;
+}
+
+
+int AudioEngine::OpenFile(const std::string &filename)
+{
+	file.open(filename.c_str(), std::ios::out | std::ios::binary);
+	if (!file.is_open())
+		return -1;
+	// Header of a PCM WAV file, the sizes are written by CloseFile
+	file.write("RIFF", 4);
+	WriteLittleEndian(file, 0, 4);
+	file.write("WAVEfmt ", 8);
+	WriteLittleEndian(file, 16, 4);
+	WriteLittleEndian(file, 1, 2); // PCM
+	WriteLittleEndian(file, AUDIO_NB_CHANNELS, 2);
+	WriteLittleEndian(file, AUDIO_SAMPLE_RATE, 4);
+	WriteLittleEndian(file, AUDIO_SAMPLE_RATE * AUDIO_NB_CHANNELS * 2, 4);
+	WriteLittleEndian(file, AUDIO_NB_CHANNELS * 2, 2);
+	WriteLittleEndian(file, 16, 2);
+	file.write("data", 4);
+	WriteLittleEndian(file, 0, 4);
+	nbFileFrames = 0;
+	return 0;
+}
+
+
+void AudioEngine::CloseFile()
+{
+	if (!file.is_open())
+		return;
+	unsigned int dataSize = (unsigned int)(nbFileFrames * AUDIO_NB_CHANNELS * 2);
+	file.seekp(4);
+	WriteLittleEndian(file, 36 + dataSize, 4);
+	file.seekp(40);
+	WriteLittleEndian(file, dataSize, 4);
+	file.close();
+}
@@ -0,0 +1,150 @@
+#ifndef AUDIOENGINE_H_INCLUDED
+#define AUDIOENGINE_H_INCLUDED
+
+/* Cue sounds decoded in memory at startup and played by a dedicated audio thread */
+/*
+	PlaySoundA read the .wav file from the disk when it was called, in the tick of the control loop, and the sound started after a delay which depended
+	on the disk cache and on the system. Here the cues are decoded once by LoadCue (PCM WAV 8, 16, 24 or 32 bits, or float, converted to the output format:
+	AUDIO_SAMPLE_RATE, stereo, 16 bits), and Play only queues a request in a ring: the control loop never waits for the audio.
+	The audio thread mixes the cues being played in small buffers of AUDIO_BUFFER_FRAMES frames, AUDIO_NB_BUFFERS of them queued on the sink. A cue starts
+	at the beginning of the next buffer mixed, i.e. at most (AUDIO_NB_BUFFERS + 1) buffers after Play (about 23 ms with the values below), with a jitter of one buffer.
+
+	Sinks:
+	- AUDIO_SINK_DEVICE: the default waveOut device, each buffer is mixed again as soon as the device has played it
+	- AUDIO_SINK_NULL: nothing is played, the buffers are consumed at the rate of a device (for tests without sound card)
+	- AUDIO_SINK_FILE: as AUDIO_SINK_NULL, and the output is written in a WAV file (to check the cues and their timing offline)
+
+	Scheduled cues (PlayAt, e.g. a metronome): the cue starts at a given frame of the output, on the clock of the device, instead of the next buffer.
+	The origin time of the request is converted once to a frame of the output, then the cue starts delay * AUDIO_SAMPLE_RATE frames later: the cues scheduled
+	from the same origin are spaced by their exact delays (to the sample), whatever the period of the control loop, as long as they are requested before their buffer
+	is mixed (more than (AUDIO_NB_BUFFERS + 1) buffers ahead). A cue requested too late starts at the next buffer, its onset shows it.
+
+	Onsets: the time at which the first sample of each cue is played is estimated on the QueryPerformanceCounter clock (the clock of the control loop)
+	from the position of the device, and logged with the time of the request when the cue starts to be mixed. They can be read from any thread (GetNbOnsets, GetOnset),
+	or written by WriteOnsets. The onset of a scheduled cue is given from its origin: origin + (onset frame - origin frame) / AUDIO_SAMPLE_RATE.
+*/
+#include <windows.h>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <thread>
+#include <atomic>
+
+#define AUDIO_SINK_DEVICE 0
+#define AUDIO_SINK_NULL 1
+#define AUDIO_SINK_FILE 2
+
+#define AUDIO_SAMPLE_RATE 44100
+#define AUDIO_NB_CHANNELS 2
+#define AUDIO_BUFFER_FRAMES 256 // (5.8 ms)
+#define AUDIO_NB_BUFFERS 3
+#define AUDIO_MAX_VOICES 8 // cues played at the same time, the oldest one is stopped beyond
+#define AUDIO_REQUEST_QUEUE_SIZE 64
+#define AUDIO_MAX_ONSETS 65536 // logged onsets, the next ones are played but not logged
+#define AUDIO_CLOCK_SMOOTHING 0.05 // weight of the last position of the device in the estimate of the time of the first sample
+
+struct AudioOnset
+{
+	int cue;
+	double requestTime; // (s) call to Play
+	double scheduledTime; // (s) origin + delay given to PlayAt (0: played from the next buffer)
+	double onsetTime; // (s) first sample played (estimated)
+	unsigned __int64 onsetFrame; // first sample in the output stream
+};
+
+class AudioEngine
+{
+	public:
+		AudioEngine();
+		~AudioEngine(); // stop
+
+		// Before Start: decode the WAV file. Return the number of the cue, or -1 if the file cannot be read
+		int LoadCue(const std::string &name, const std::string &filename);
+		// Open the sink (filename: output of AUDIO_SINK_FILE) and start the audio thread. Return -1 if the sink cannot be opened (the cues are not played then)
+		int Start(int sink, const std::string &filename = "");
+		// Stop the audio thread and close the sink (not from the audio thread)
+		void Stop();
+
+		// One thread (the control loop): play a cue from the next buffer. Never waits. Return false if the cue is unknown, the engine stopped or the queue full
+		bool Play(int cue);
+		// Same thread: play a cue delay (s) after originTime (s, QueryPerformanceCounter), on the clock of the device (see above)
+		bool PlayAt(int cue, double originTime, double delay);
+		// Same thread: the scheduled cues which have not started yet are not played
+		bool CancelScheduled();
+
+		// Onsets logged since Start (can be read from any thread)
+		unsigned int GetNbOnsets();
+		AudioOnset GetOnset(unsigned int index);
+		// After Stop: one line per onset, with the name of the cue and its latency (onset - scheduled time, or onset - request). Return -1 if the file cannot be written
+		int WriteOnsets(const std::string &filename);
+		// Buffers of the device which were all played before they could be mixed again (gaps in the sound)
+		unsigned int GetNbUnderruns();
+
+	private:
+		struct Cue
+		{
+			std::string name;
+			std::vector<short> samples; // interleaved, AUDIO_NB_CHANNELS
+		};
+		struct Request
+		{
+			int cue; // -1: cancel the scheduled cues
+			double time; // (s)
+			bool isScheduled;
+			double originTime, delay; // (s) PlayAt
+		};
+		struct Voice
+		{
+			int cue; // -1: free
+			size_t position; // frame
+			unsigned __int64 startFrame; // in the output
+			AudioOnset onset; // logged when the first frames are mixed
+		};
+
+		int DecodeWavFile(const std::string &filename, std::vector<short> &samples);
+		void Run(); // audio thread
+		bool PushRequest(const Request &request);
+		void TakeRequests(); // at the beginning of a buffer
+		void MixBuffer(short *buffer); // next AUDIO_BUFFER_FRAMES frames of the output
+		void WriteBuffer(); // next buffer of the null and file sinks
+		void UpdateClock(); // time of the first sample from the position of the device
+		double GetTime(); // (s) QueryPerformanceCounter
+		int OpenFile(const std::string &filename);
+		void CloseFile();
+
+		std::vector<Cue> cues;
+		int sinkType;
+		unsigned __int64 timerFrequency;
+
+		// Written by Play
+		Request requests[AUDIO_REQUEST_QUEUE_SIZE];
+		std::atomic<unsigned int> nbRequests;
+
+		std::atomic<unsigned int> nbTakenRequests; // by the audio thread
+
+		// Audio thread
+		Voice voices[AUDIO_MAX_VOICES];
+		int mixBuffer[AUDIO_BUFFER_FRAMES * AUDIO_NB_CHANNELS];
+		unsigned __int64 nbMixedFrames;
+		double streamStartTime; // (s) estimated time at which the first frame of the output was played
+		bool isClockSet;
+		double originTime; // (s) origin of the last scheduled cue
+		unsigned __int64 originFrame; // its frame in the output
+		std::vector<AudioOnset> onsets; // allocated by Start, an onset is not modified once counted in nbOnsets
+		std::atomic<unsigned int> nbOnsets;
+		std::atomic<unsigned int> nbUnderruns;
+
+		// Sinks
+		struct Device; // waveOut handle and buffers (Mmsystem.h is only included by audioEngine.cpp)
+		Device *pDevice;
+		short fileBuffer[AUDIO_BUFFER_FRAMES * AUDIO_NB_CHANNELS];
+		std::ofstream file;
+		unsigned __int64 nbFileFrames;
+		bool isTimerPeriodSet;
+
+		std::atomic<bool> isRunning;
+		std::thread audioThread;
+};
+
+#endif // AUDIOENGINE_H_INCLUDED
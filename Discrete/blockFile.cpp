@@ -0,0 +1,370 @@
+#include "blockFile.h"
+
+static const char padding[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+
+BlockFileWriter::BlockFileWriter()
+{
+	isBlockHeaderWritten = false;
+	currentTrialOffset = 0;
+	currentTrialNb = 0;
+	currentTrialSize = 0;
+}
+
+BlockFileWriter::~BlockFileWriter()
+{
+	Close();
+}
+
+
+int BlockFileWriter::Open(const std::string filename)
+{
+	Close();
+	file.open(filename.c_str(), std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!file)
+		return -1;
+	currentFilename = filename;
+	isBlockHeaderWritten = false;
+	trialNumbers.clear();
+	trialOffsets.clear();
+	return 0;
+}
+
+
+void BlockFileWriter::Close()
+{
+	if (file.is_open())
+		file.close();
+	file.clear();
+	currentFilename.clear();
+}
+
+
+bool BlockFileWriter::IsOpen(const std::string filename)
+{
+	return file.is_open() && filename == currentFilename;
+}
+
+
+int BlockFileWriter::AppendTrial(int trialNb, const TrialHeader &header, const std::vector<std::string> &channelNames, const std::vector<std::string> &channelUnits, const double * const *channels, unsigned int nbSamples)
+{
+	if (BeginTrial(trialNb, header, channelNames, channelUnits, nbSamples) != 0)
+		return -1;
+	for (unsigned int c=0; c<channelNames.size(); c++)
+		if (WriteSamples(channels[c], nbSamples) != 0)
+			return -1;
+	return EndTrial();
+}
+
+
+int BlockFileWriter::BeginTrial(int trialNb, const TrialHeader &header, const std::vector<std::string> &channelNames, const std::vector<std::string> &channelUnits, unsigned int nbSamples)
+{
+	currentTrialSize = 0; // EndTrial fails until the parameters of the trial are written
+	if (!file.is_open())
+		return -1;
+
+	// The parameters of the first trial are the parameters of the block
+	if (!isBlockHeaderWritten)
+	{
+		blockHeader = header;
+		std::string metadata;
+		unsigned int version = BLOCK_FILE_VERSION;
+		AppendBytes(metadata, "CUPBLOCK", 8);
+		AppendBytes(metadata, &version, sizeof(unsigned int));
+		AppendBytes(metadata, &blockHeader.nbParameters, sizeof(unsigned int));
+		AppendBytes(metadata, &blockHeader.nbHeaderLines, sizeof(double));
+		AppendString(metadata, blockHeader.taskName);
+		for (unsigned int p=0; p<blockHeader.nbParameters; p++)
+			AppendParameter(metadata, blockHeader.parameters[p]);
+		AppendBytes(metadata, padding, (8 - metadata.size() % 8) % 8);
+		file.seekp(0);
+		file.write(metadata.data(), metadata.size());
+		if (file.fail())
+		{
+			file.clear(); // written again with the next trial
+			return -1;
+		}
+		isBlockHeaderWritten = true;
+	}
+
+	// Trial: only the parameters which differ from the block
+	unsigned int nbChannels = channelNames.size();
+	std::string metadata;
+	std::string changedParameters;
+	unsigned int nbChangedParameters = 0;
+	for (unsigned int p=0; p<header.nbParameters; p++)
+	{
+		if (p < blockHeader.nbParameters && IsSameParameter(header.parameters[p], blockHeader.parameters[p]))
+			continue;
+		AppendBytes(changedParameters, &p, sizeof(unsigned int));
+		AppendParameter(changedParameters, header.parameters[p]);
+		nbChangedParameters++;
+	}
+	unsigned int zero = 0;
+	AppendBytes(metadata, &trialNb, sizeof(int));
+	AppendBytes(metadata, &header.nbParameters, sizeof(unsigned int));
+	AppendBytes(metadata, &nbChangedParameters, sizeof(unsigned int));
+	AppendBytes(metadata, &nbChannels, sizeof(unsigned int));
+	AppendBytes(metadata, &nbSamples, sizeof(unsigned int));
+	AppendBytes(metadata, &zero, sizeof(unsigned int));
+	metadata.append(changedParameters);
+	for (unsigned int c=0; c<nbChannels; c++)
+	{
+		AppendString(metadata, channelNames[c]);
+		AppendString(metadata, channelUnits[c]);
+	}
+	AppendBytes(metadata, padding, (8 - metadata.size() % 8) % 8); // the trial starts on a multiple of 8, so the columns are aligned
+
+	// Write the trial at the end of the file, after the last index (which stays valid until the index of this trial is written).
+	// The bytes of a trial which could not be written stay in the file, unused
+	file.seekp(0, std::ios::end);
+	__int64 fileSize = file.tellp();
+	if (fileSize < 0)
+	{
+		file.clear();
+		return -1;
+	}
+	currentTrialOffset = (fileSize + 7) / 8 * 8;
+	file.write(padding, currentTrialOffset - fileSize);
+	file.write(metadata.data(), metadata.size());
+	if (file.fail())
+	{
+		file.clear();
+		return -1;
+	}
+	currentTrialNb = trialNb;
+	currentTrialSize = metadata.size() + (unsigned __int64)nbChannels * nbSamples * sizeof(double);
+	return 0;
+}
+
+
+int BlockFileWriter::WriteSamples(const double *samples, unsigned int nbSamples)
+{
+	if (nbSamples > 0)
+		file.write((const char*)samples, nbSamples * sizeof(double));
+	if (file.fail())
+	{
+		file.clear();
+		currentTrialSize = 0; // EndTrial fails, the trial is not added to the index
+		return -1;
+	}
+	return 0;
+}
+
+
+int BlockFileWriter::EndTrial()
+{
+	if (!file.is_open() || currentTrialSize == 0 || (unsigned __int64)file.tellp() != currentTrialOffset + currentTrialSize)
+		return -1; // not the number of samples announced in BeginTrial
+	trialNumbers.push_back(currentTrialNb);
+	trialOffsets.push_back(currentTrialOffset);
+	if (WriteIndex() != 0)
+	{
+		// The trial is not in the file: the previous index is still the last complete index
+		trialNumbers.pop_back();
+		trialOffsets.pop_back();
+		return -1;
+	}
+	return 0;
+}
+
+
+int BlockFileWriter::WriteIndex()
+{
+	std::string index;
+	unsigned int zero = 0;
+	for (unsigned int t=0; t<trialNumbers.size(); t++)
+	{
+		AppendBytes(index, &trialNumbers[t], sizeof(int));
+		AppendBytes(index, &zero, sizeof(unsigned int));
+		AppendBytes(index, &trialOffsets[t], sizeof(unsigned __int64));
+	}
+	unsigned int nbTrials = trialNumbers.size();
+	unsigned __int64 indexOffset = currentTrialOffset + currentTrialSize;
+	AppendBytes(index, &indexOffset, sizeof(unsigned __int64));
+	AppendBytes(index, &nbTrials, sizeof(unsigned int));
+	AppendBytes(index, "BIDX", 4);
+	file.seekp(indexOffset);
+	file.write(index.data(), index.size());
+	file.flush(); // the file is complete after each trial
+	if (file.fail())
+	{
+		file.clear();
+		return -1;
+	}
+	return 0;
+}
+
+
+BlockFileReader::BlockFileReader()
+{
+	nbSamples = 0;
+}
+
+BlockFileReader::~BlockFileReader()
+{
+	Close();
+}
+
+
+int BlockFileReader::Open(const std::string filename)
+{
+	Close();
+	if (file.Open(filename) != 0)
+		return -1;
+	const char *data = file.GetData();
+	unsigned __int64 dataSize = file.GetSize();
+	unsigned __int64 position = 0;
+
+	// Block parameters
+	char magic[8];
+	unsigned int version, nbBlockParameters;
+	bool isValid = ReadBytes(data, dataSize, position, magic, 8) && ReadBytes(data, dataSize, position, &version, sizeof(unsigned int)) && ReadBytes(data, dataSize, position, &nbBlockParameters, sizeof(unsigned int));
+	if (!isValid || std::string(magic, 8) != "CUPBLOCK" || version != BLOCK_FILE_VERSION)
+	{
+		std::cout << "Error: " << filename << " is not a block file (or was written by another version of the program)" << std::endl;
+		Close();
+		return -1;
+	}
+	isValid = ReadBytes(data, dataSize, position, &blockHeader.nbHeaderLines, sizeof(double)) && ReadString(data, dataSize, position, blockHeader.taskName);
+	blockHeader.parameters.assign(nbBlockParameters, TrialParameter());
+	blockHeader.nbParameters = nbBlockParameters;
+	for (unsigned int p=0; p<nbBlockParameters && isValid; p++)
+		isValid = ReadParameter(data, dataSize, position, blockHeader.parameters[p]);
+
+	// Last complete index: its footer is the end of the file, or (if the program stopped while a trial was written) the last footer before the incomplete trial
+	unsigned __int64 indexOffset = 0;
+	unsigned int nbTrials = 0;
+	unsigned __int64 endOfIndex = isValid ? dataSize / 8 * 8 : 0;
+	for (; endOfIndex >= position + 16; endOfIndex -= 8)
+	{
+		unsigned __int64 footer = endOfIndex - 16;
+		if (memcmp(data + footer + 12, "BIDX", 4) != 0)
+			continue;
+		ReadBytes(data, dataSize, footer, &indexOffset, sizeof(unsigned __int64));
+		ReadBytes(data, dataSize, footer, &nbTrials, sizeof(unsigned int));
+		if (indexOffset >= position && indexOffset <= endOfIndex - 16 && endOfIndex - 16 - indexOffset == (unsigned __int64)nbTrials * 16)
+			break;
+	}
+	if (endOfIndex < position + 16)
+	{
+		std::cout << "Error: " << filename << " is truncated (no valid index)" << std::endl;
+		Close();
+		return -1;
+	}
+	if (endOfIndex != dataSize)
+		std::cout << "Warning: the end of " << filename << " is incomplete (the program stopped while a trial was written), " << nbTrials << " trials are read" << std::endl;
+	trialNumbers.resize(nbTrials);
+	trialOffsets.resize(nbTrials);
+	position = indexOffset;
+	for (unsigned int t=0; t<nbTrials; t++)
+	{
+		unsigned int zero;
+		ReadBytes(data, dataSize, position, &trialNumbers[t], sizeof(int));
+		ReadBytes(data, dataSize, position, &zero, sizeof(unsigned int));
+		ReadBytes(data, dataSize, position, &trialOffsets[t], sizeof(unsigned __int64));
+	}
+	return 0;
+}
+
+
+void BlockFileReader::Close()
+{
+	file.Close();
+	trialNumbers.clear();
+	trialOffsets.clear();
+	nbSamples = 0;
+	channels.clear();
+}
+
+
+unsigned int BlockFileReader::GetNbTrials()
+{
+	return trialNumbers.size();
+}
+
+
+int BlockFileReader::GetTrialNumber(unsigned int trial)
+{
+	if (trial >= trialNumbers.size())
+		return -1;
+	return trialNumbers[trial];
+}
+
+
+int BlockFileReader::SelectTrial(unsigned int trial)
+{
+	if (trial >= trialOffsets.size())
+		return -1;
+	const char *data = file.GetData();
+	unsigned __int64 dataSize = file.GetSize();
+	unsigned __int64 position = trialOffsets[trial];
+
+	int trialNb;
+	unsigned int nbParameters, nbChangedParameters, nbChannels, zero;
+	bool isValid = ReadBytes(data, dataSize, position, &trialNb, sizeof(int)) && ReadBytes(data, dataSize, position, &nbParameters, sizeof(unsigned int)) && ReadBytes(data, dataSize, position, &nbChangedParameters, sizeof(unsigned int)) &&
+		ReadBytes(data, dataSize, position, &nbChannels, sizeof(unsigned int)) && ReadBytes(data, dataSize, position, &nbSamples, sizeof(unsigned int)) && ReadBytes(data, dataSize, position, &zero, sizeof(unsigned int));
+
+	// Block parameters, replaced by the parameters of the trial
+	header.taskName = blockHeader.taskName;
+	header.nbHeaderLines = blockHeader.nbHeaderLines;
+	header.parameters = blockHeader.parameters;
+	header.parameters.resize(nbParameters);
+	header.nbParameters = nbParameters;
+	for (unsigned int p=0; p<nbChangedParameters && isValid; p++)
+	{
+		unsigned int index;
+		TrialParameter parameter;
+		isValid = ReadBytes(data, dataSize, position, &index, sizeof(unsigned int)) && index < nbParameters && ReadParameter(data, dataSize, position, parameter);
+		if (isValid)
+			header.parameters[index] = parameter;
+	}
+	channelNames.assign(nbChannels, "");
+	channelUnits.assign(nbChannels, "");
+	for (unsigned int c=0; c<nbChannels && isValid; c++)
+		isValid = ReadString(data, dataSize, position, channelNames[c]) && ReadString(data, dataSize, position, channelUnits[c]);
+	position = (position + 7) / 8 * 8;
+	if (!isValid || position > dataSize || (dataSize - position) / sizeof(double) / (nbChannels > 0 ? nbChannels : 1) < nbSamples)
+	{
+		std::cout << "Error: trial " << trialNumbers[trial] << " of the block file is not valid" << std::endl;
+		nbSamples = 0;
+		channels.clear();
+		return -1;
+	}
+
+	channels.resize(nbChannels);
+	for (unsigned int c=0; c<nbChannels; c++)
+		channels[c] = (const double*)(data + position) + (unsigned __int64)c * nbSamples;
+	return 0;
+}
+
+
+const TrialHeader& BlockFileReader::GetHeader()
+{
+	return header;
+}
+
+
+const std::vector<std::string>& BlockFileReader::GetChannelNames()
+{
+	return channelNames;
+}
+
+
+const std::vector<std::string>& BlockFileReader::GetChannelUnits()
+{
+	return channelUnits;
+}
+
+
+unsigned int BlockFileReader::GetNbSamples()
+{
+	return nbSamples;
+}
+
+
+const double* const* BlockFileReader::GetChannels()
+{
+	if (channels.empty())
+		return NULL;
+	return &channels[0];
+}
@@ -0,0 +1,99 @@
+#ifndef BLOCKFILE_H_INCLUDED
+#define BLOCKFILE_H_INCLUDED
+
+/* Data file of a whole block: all the trials of the block in one file, with an index to access any trial directly */
+/*
+	Most of the parameters of a trial are the same for the whole block: they are stored once (the parameters of the first trial of the block),
+	and each trial only stores the parameters which differ (trial number, success, score...). The recorded channels of each trial are stored as
+	in the binary trial files (contiguous columns of doubles aligned on 8 bytes, used in place when the file is mapped in memory).
+	The file is only appended: each trial is written at the end of the file, after the index of the previous trial, and is followed by a new index of all
+	the trials, so that the file is complete (and can be read) after each trial. The previous indexes stay in the file, unused. If the program stops
+	while a trial is written, the reader uses the last complete index, and only the trial which was being written is lost.
+
+	File format (little endian, strings and parameters are stored as in the binary trial files, see trialFile.h):
+		char[8] magic ("CUPBLOCK"), unsigned int version, nbBlockParameters
+		double nbHeaderLines, string taskName
+		nbBlockParameters x parameter
+		for each trial (starting on a multiple of 8):
+			int trialNb, unsigned int nbParameters, nbChangedParameters, nbChannels, nbSamples, 0
+			nbChangedParameters x (unsigned int index, parameter) (parameter index of the trial replaces the block parameter index, or is added after them)
+			nbChannels x (string name, string unit)
+			zeros up to a multiple of 8
+			double samples[nbChannels * nbSamples] (sample i of channel c is at index c * nbSamples + i)
+			index of the trials written so far: nbTrials x (int trialNb, unsigned int 0, unsigned __int64 offset of the trial in the file)
+			unsigned __int64 offset of the index, unsigned int nbTrials, char[4] "BIDX" (the last 16 bytes of the file are the footer of the last index)
+*/
+#include <string>
+#include <vector>
+#include <iostream>
+#include <fstream>
+#include "trialFile.h"
+
+#define BLOCK_FILE_VERSION 1
+
+// Append the trials of a block in a block file (used by the writer thread)
+class BlockFileWriter
+{
+	public:
+		BlockFileWriter();
+		~BlockFileWriter();
+
+		int Open(const std::string filename); // create the file (an existing file is replaced)
+		void Close();
+		bool IsOpen(const std::string filename); // whether filename is the file currently open
+		// Add a trial at the end of the file, followed by a new index. Return -1 if the writing failed (the trial is then not in the file, the next trials can still be added)
+		int AppendTrial(int trialNb, const TrialHeader &header, const std::vector<std::string> &channelNames, const std::vector<std::string> &channelUnits, const double * const *channels, unsigned int nbSamples);
+		// The same in parts, when the samples are not all in memory: BeginTrial writes the parameters, WriteSamples is then called for each column in turn
+		// (in one or several calls, nbSamples samples in total per column), and EndTrial adds the trial to the index
+		int BeginTrial(int trialNb, const TrialHeader &header, const std::vector<std::string> &channelNames, const std::vector<std::string> &channelUnits, unsigned int nbSamples);
+		int WriteSamples(const double *samples, unsigned int nbSamples);
+		int EndTrial();
+
+	private:
+		int WriteIndex();
+
+		std::fstream file;
+		std::string currentFilename;
+		TrialHeader blockHeader; // parameters of the first trial
+		bool isBlockHeaderWritten;
+		unsigned __int64 currentTrialOffset; // trial being written (between BeginTrial and EndTrial)
+		std::vector<int> trialNumbers;
+		std::vector<unsigned __int64> trialOffsets;
+		int currentTrialNb;
+		unsigned __int64 currentTrialSize;
+};
+
+// Read-only access to a block file mapped in memory: select a trial, then use it as a binary trial file (the channels point directly into the file)
+class BlockFileReader
+{
+	public:
+		BlockFileReader();
+		~BlockFileReader();
+
+		int Open(const std::string filename); // return -1 if the file cannot be mapped or is not a valid block file
+		void Close();
+
+		unsigned int GetNbTrials();
+		int GetTrialNumber(unsigned int trial); // number of the trial in the block (as in the trial files)
+		int SelectTrial(unsigned int trial); // read the parameters of trial (0 to GetNbTrials()-1), return -1 if the trial is not valid
+
+		const TrialHeader& GetHeader(); // parameters of the selected trial
+		const std::vector<std::string>& GetChannelNames();
+		const std::vector<std::string>& GetChannelUnits();
+		unsigned int GetNbSamples();
+		const double* const* GetChannels();
+
+	private:
+		MappedFile file;
+		TrialHeader blockHeader;
+		std::vector<int> trialNumbers;
+		std::vector<unsigned __int64> trialOffsets;
+
+		TrialHeader header;
+		std::vector<std::string> channelNames;
+		std::vector<std::string> channelUnits;
+		std::vector<const double*> channels;
+		unsigned int nbSamples;
+};
+
+#endif // BLOCKFILE_H_INCLUDED
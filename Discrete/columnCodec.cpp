@@ -0,0 +1,387 @@
+#include "columnCodec.h"
+#include <math.h>
+
+static unsigned __int64 ZigZag(unsigned __int64 difference)
+{
+	return (difference << 1) ^ (0 - (difference >> 63));
+}
+
+static unsigned __int64 UnZigZag(unsigned __int64 residual)
+{
+	return (residual >> 1) ^ (0 - (residual & 1));
+}
+
+static void AppendToOutput(std::string &output, const void *source, size_t nbBytes)
+{
+	output.append((const char*)source, nbBytes);
+}
+
+
+ColumnEncoder::ColumnEncoder()
+{
+	pOutput = NULL;
+	nbValuesInBlock = 0;
+	block.resize(COLUMN_CODEC_BLOCK_SIZE);
+	for (int p=0; p<COLUMN_CODEC_NB_PREDICTORS; p++)
+		residuals[p].resize(COLUMN_CODEC_BLOCK_SIZE);
+	plane.resize(COLUMN_CODEC_BLOCK_SIZE);
+	ransBuffer.resize(2 * COLUMN_CODEC_BLOCK_SIZE + 16); // at most 12 bits per symbol, plus the final state
+}
+
+ColumnEncoder::~ColumnEncoder()
+{
+}
+
+
+void ColumnEncoder::Begin(std::string &output)
+{
+	pOutput = &output;
+	nbValuesInBlock = 0;
+}
+
+
+void ColumnEncoder::Append(const double *values, unsigned int nbValues)
+{
+	for (unsigned int i=0; i<nbValues; i++)
+	{
+		memcpy(&block[nbValuesInBlock], values + i, sizeof(double));
+		nbValuesInBlock++;
+		if (nbValuesInBlock == COLUMN_CODEC_BLOCK_SIZE)
+			EncodeBlock();
+	}
+}
+
+
+void ColumnEncoder::End()
+{
+	if (nbValuesInBlock > 0)
+		EncodeBlock();
+	pOutput = NULL;
+}
+
+
+void ColumnEncoder::EncodeBlock()
+{
+	// Residuals of the three predictors (the values before the block are taken as 0)
+	unsigned __int64 previous = 0, beforePrevious = 0;
+	for (unsigned int i=0; i<nbValuesInBlock; i++)
+	{
+		residuals[COLUMN_CODEC_XOR][i] = block[i] ^ previous;
+		residuals[COLUMN_CODEC_DELTA][i] = ZigZag(block[i] - previous);
+		residuals[COLUMN_CODEC_DELTA2][i] = ZigZag(block[i] - (2 * previous - beforePrevious));
+		beforePrevious = previous;
+		previous = block[i];
+	}
+
+	// Keep the predictor with the smallest order 0 entropy of the byte planes (in bits: n log2(n) - sum of count log2(count) for each plane)
+	if (countBits.empty())
+	{
+		countBits.resize(COLUMN_CODEC_BLOCK_SIZE + 1);
+		countBits[0] = 0.;
+		for (unsigned int count=1; count<=COLUMN_CODEC_BLOCK_SIZE; count++)
+			countBits[count] = count * log2((double)count);
+	}
+	int predictor = COLUMN_CODEC_XOR;
+	double smallestSize = 0.;
+	for (int p=0; p<COLUMN_CODEC_NB_PREDICTORS; p++)
+	{
+		unsigned int counts[8][256];
+		memset(counts, 0, sizeof(counts));
+		for (unsigned int i=0; i<nbValuesInBlock; i++)
+		{
+			unsigned __int64 residual = residuals[p][i];
+			for (int b=0; b<8; b++)
+				counts[b][(residual >> (8 * b)) & 0xff]++;
+		}
+		double size = 8 * countBits[nbValuesInBlock];
+		for (int b=0; b<8; b++)
+			for (int s=0; s<256; s++)
+				size -= countBits[counts[b][s]];
+		if (p == 0 || size < smallestSize)
+		{
+			predictor = p;
+			smallestSize = size;
+		}
+	}
+
+	unsigned char predictorByte = (unsigned char)predictor;
+	AppendToOutput(*pOutput, &predictorByte, 1);
+	AppendToOutput(*pOutput, &nbValuesInBlock, sizeof(unsigned int));
+	for (int b=0; b<8; b++)
+	{
+		for (unsigned int i=0; i<nbValuesInBlock; i++)
+			plane[i] = (unsigned char)(residuals[predictor][i] >> (8 * b));
+		EncodePlane(&plane[0], nbValuesInBlock);
+	}
+	nbValuesInBlock = 0;
+}
+
+
+void ColumnEncoder::EncodePlane(const unsigned char *symbols, unsigned int nbSymbols)
+{
+	unsigned int counts[256];
+	memset(counts, 0, sizeof(counts));
+	for (unsigned int i=0; i<nbSymbols; i++)
+		counts[symbols[i]]++;
+	unsigned short nbDifferentSymbols = 0;
+	for (int s=0; s<256; s++)
+		if (counts[s] > 0)
+			nbDifferentSymbols++;
+	unsigned char mode;
+	if (nbDifferentSymbols == 1)
+	{
+		mode = COLUMN_CODEC_PLANE_CONSTANT;
+		AppendToOutput(*pOutput, &mode, 1);
+		AppendToOutput(*pOutput, symbols, 1);
+		return;
+	}
+
+	// Frequencies normalized to 1 << RANS_PROB_BITS (every symbol of the plane keeps at least 1)
+	const unsigned int total = 1 << RANS_PROB_BITS;
+	unsigned int frequencies[256], starts[256];
+	unsigned int sum = 0;
+	for (int s=0; s<256; s++)
+	{
+		frequencies[s] = 0;
+		if (counts[s] > 0)
+		{
+			frequencies[s] = (unsigned int)((unsigned __int64)counts[s] * total / nbSymbols);
+			if (frequencies[s] == 0)
+				frequencies[s] = 1;
+		}
+		sum += frequencies[s];
+	}
+	while (sum != total)
+	{
+		int largest = 0;
+		for (int s=1; s<256; s++)
+			if (frequencies[s] > frequencies[largest])
+				largest = s;
+		if (sum < total)
+		{
+			frequencies[largest] += total - sum;
+			sum = total;
+		}
+		else
+		{
+			frequencies[largest]--; // the largest frequency is always far above 1
+			sum--;
+		}
+	}
+	starts[0] = 0;
+	for (int s=1; s<256; s++)
+		starts[s] = starts[s - 1] + frequencies[s - 1];
+
+	// rANS, from the last symbol to the first so that the decoder reads the bytes forwards
+	unsigned char *end = &ransBuffer[0] + ransBuffer.size();
+	unsigned char *ransPosition = end;
+	unsigned int state = RANS_LOWER_BOUND;
+	for (unsigned int i=nbSymbols; i-- > 0;)
+	{
+		unsigned int frequency = frequencies[symbols[i]];
+		unsigned int stateMax = ((RANS_LOWER_BOUND >> RANS_PROB_BITS) << 8) * frequency;
+		while (state >= stateMax)
+		{
+			*--ransPosition = (unsigned char)(state & 0xff);
+			state >>= 8;
+		}
+		state = ((state / frequency) << RANS_PROB_BITS) + (state % frequency) + starts[symbols[i]];
+	}
+	ransPosition -= 4;
+	for (int k=0; k<4; k++)
+		ransPosition[k] = (unsigned char)(state >> (8 * k));
+	unsigned int nbBytes = (unsigned int)(end - ransPosition);
+
+	if (nbBytes + 3 * nbDifferentSymbols + 6 >= nbSymbols)
+	{
+		mode = COLUMN_CODEC_PLANE_RAW;
+		AppendToOutput(*pOutput, &mode, 1);
+		AppendToOutput(*pOutput, symbols, nbSymbols);
+		return;
+	}
+	mode = COLUMN_CODEC_PLANE_RANS;
+	AppendToOutput(*pOutput, &mode, 1);
+	AppendToOutput(*pOutput, &nbDifferentSymbols, sizeof(unsigned short));
+	for (int s=0; s<256; s++)
+		if (frequencies[s] > 0)
+		{
+			unsigned char symbol = (unsigned char)s;
+			unsigned short frequency = (unsigned short)frequencies[s];
+			AppendToOutput(*pOutput, &symbol, 1);
+			AppendToOutput(*pOutput, &frequency, sizeof(unsigned short));
+		}
+	AppendToOutput(*pOutput, &nbBytes, sizeof(unsigned int));
+	AppendToOutput(*pOutput, ransPosition, nbBytes);
+}
+
+
+ColumnDecoder::ColumnDecoder()
+{
+	data = NULL;
+	dataSize = 0;
+	position = 0;
+	nbValuesInBlock = 0;
+	nextValue = 0;
+	block.resize(COLUMN_CODEC_BLOCK_SIZE);
+	lookup.resize(1 << RANS_PROB_BITS);
+}
+
+ColumnDecoder::~ColumnDecoder()
+{
+}
+
+
+void ColumnDecoder::Begin(const char *compressedData, unsigned __int64 size)
+{
+	data = (const unsigned char*)compressedData;
+	dataSize = size;
+	position = 0;
+	nbValuesInBlock = 0;
+	nextValue = 0;
+}
+
+
+int ColumnDecoder::Decode(double *values, unsigned int nbValues)
+{
+	unsigned int nbDecoded = 0;
+	while (nbDecoded < nbValues)
+	{
+		if (nextValue == nbValuesInBlock)
+		{
+			if (position == dataSize) // end of the column
+				break;
+			if (!DecodeBlock())
+				return -1;
+		}
+		unsigned int nbCopied = nbValuesInBlock - nextValue;
+		if (nbCopied > nbValues - nbDecoded)
+			nbCopied = nbValues - nbDecoded;
+		memcpy(values + nbDecoded, &block[nextValue], nbCopied * sizeof(double));
+		nextValue += nbCopied;
+		nbDecoded += nbCopied;
+	}
+	return nbDecoded;
+}
+
+
+bool ColumnDecoder::DecodeBlock()
+{
+	unsigned char predictor;
+	unsigned int nbValues;
+	if (!Read(&predictor, 1) || !Read(&nbValues, sizeof(unsigned int)) || predictor >= COLUMN_CODEC_NB_PREDICTORS || nbValues == 0 || nbValues > COLUMN_CODEC_BLOCK_SIZE)
+		return false;
+	for (unsigned int i=0; i<nbValues; i++)
+		block[i] = 0;
+	for (unsigned int b=0; b<8; b++)
+		if (!DecodePlane(b, nbValues))
+			return false;
+
+	// Undo the prediction
+	unsigned __int64 previous = 0, beforePrevious = 0;
+	for (unsigned int i=0; i<nbValues; i++)
+	{
+		if (predictor == COLUMN_CODEC_XOR)
+			block[i] ^= previous;
+		else if (predictor == COLUMN_CODEC_DELTA)
+			block[i] = UnZigZag(block[i]) + previous;
+		else
+			block[i] = UnZigZag(block[i]) + (2 * previous - beforePrevious);
+		beforePrevious = previous;
+		previous = block[i];
+	}
+	nbValuesInBlock = nbValues;
+	nextValue = 0;
+	return true;
+}
+
+
+bool ColumnDecoder::DecodePlane(unsigned int planeIndex, unsigned int nbSymbols)
+{
+	unsigned int shift = 8 * planeIndex;
+	unsigned char mode;
+	if (!Read(&mode, 1))
+		return false;
+	if (mode == COLUMN_CODEC_PLANE_CONSTANT)
+	{
+		unsigned char symbol;
+		if (!Read(&symbol, 1))
+			return false;
+		for (unsigned int i=0; i<nbSymbols; i++)
+			block[i] |= (unsigned __int64)symbol << shift;
+		return true;
+	}
+	if (mode == COLUMN_CODEC_PLANE_RAW)
+	{
+		if (dataSize - position < nbSymbols)
+			return false;
+		for (unsigned int i=0; i<nbSymbols; i++)
+			block[i] |= (unsigned __int64)data[position + i] << shift;
+		position += nbSymbols;
+		return true;
+	}
+	if (mode != COLUMN_CODEC_PLANE_RANS)
+		return false;
+
+	// Frequencies, and symbol of each slot
+	const unsigned int total = 1 << RANS_PROB_BITS;
+	unsigned int frequencies[256], starts[256];
+	memset(frequencies, 0, sizeof(frequencies));
+	unsigned short nbDifferentSymbols;
+	if (!Read(&nbDifferentSymbols, sizeof(unsigned short)) || nbDifferentSymbols > 256)
+		return false;
+	for (unsigned int k=0; k<nbDifferentSymbols; k++)
+	{
+		unsigned char symbol;
+		unsigned short frequency;
+		if (!Read(&symbol, 1) || !Read(&frequency, sizeof(unsigned short)))
+			return false;
+		frequencies[symbol] = frequency;
+	}
+	unsigned int sum = 0;
+	for (int s=0; s<256; s++)
+	{
+		starts[s] = sum;
+		if (sum + frequencies[s] > total)
+			return false;
+		for (unsigned int slot=sum; slot<sum+frequencies[s]; slot++)
+			lookup[slot] = (unsigned char)s;
+		sum += frequencies[s];
+	}
+	if (sum != total)
+		return false;
+
+	unsigned int nbBytes;
+	if (!Read(&nbBytes, sizeof(unsigned int)) || nbBytes < 4 || dataSize - position < nbBytes)
+		return false;
+	const unsigned char *ransPosition = data + position;
+	const unsigned char *end = ransPosition + nbBytes;
+	position += nbBytes;
+	unsigned int state = 0;
+	for (int k=0; k<4; k++)
+		state |= (unsigned int)ransPosition[k] << (8 * k);
+	ransPosition += 4;
+	for (unsigned int i=0; i<nbSymbols; i++)
+	{
+		unsigned int slot = state & (total - 1);
+		unsigned char symbol = lookup[slot];
+		block[i] |= (unsigned __int64)symbol << shift;
+		state = frequencies[symbol] * (state >> RANS_PROB_BITS) + slot - starts[symbol];
+		while (state < RANS_LOWER_BOUND)
+		{
+			if (ransPosition == end)
+				return false;
+			state = (state << 8) | *ransPosition++;
+		}
+	}
+	return (ransPosition == end && state == RANS_LOWER_BOUND);
+}
+
+
+bool ColumnDecoder::Read(void *destination, unsigned __int64 nbBytes)
+{
+	if (dataSize - position < nbBytes)
+		return false;
+	memcpy(destination, data + position, (size_t)nbBytes);
+	position += nbBytes;
+	return true;
+}
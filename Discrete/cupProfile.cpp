@@ -0,0 +1,196 @@
+#include "cupProfile.h"
+
+CupProfile::CupProfile()
+{
+	edgeAngle = 0.;
+	angleStep = 1.;
+}
+
+CupProfile::~CupProfile()
+{
+}
+
+
+int CupProfile::Build(const std::vector<double> &knots)
+{
+	knotX.clear();
+	knotZ.clear();
+	knotSecondDerivative.clear();
+	table.clear();
+
+	// Check the knots
+	if (knots.size() % 2 != 0 || knots.size() < 4)
+	{
+		std::cout << "Cup profile must be given as pairs x,z of at least 2 knots" << std::endl;
+		return -1;
+	}
+	for (unsigned int i=0; i<knots.size()/2; i++)
+	{
+		knotX.push_back(knots[2*i]);
+		knotZ.push_back(knots[2*i+1] - knots[1]); // the bottom of the cup is the origin of the cup frame
+	}
+	if (knotX[0] != 0.)
+	{
+		std::cout << "Cup profile must start at the bottom of the cup (x = 0)" << std::endl;
+		return -1;
+	}
+	int n = knotX.size() - 1; // number of segments
+	for (int i=0; i<n; i++)
+	{
+		if (knotX[i+1] <= knotX[i])
+		{
+			std::cout << "Cup profile knots must be given with increasing x" << std::endl;
+			return -1;
+		}
+	}
+
+	// Second derivatives of the cubic spline: tridiagonal system (Thomas algorithm)
+	// Zero slope at the bottom: 2 h0 M0 + h0 M1 = 6 (z1 - z0) / h0
+	// Interior knots: h(i-1) M(i-1) + 2 (h(i-1) + h(i)) M(i) + h(i) M(i+1) = 6 ((z(i+1) - z(i)) / h(i) - (z(i) - z(i-1)) / h(i-1))
+	// Parabolic run-out at the edge: M(n) - M(n-1) = 0
+	std::vector<double> lower(n+1, 0.), diagonal(n+1, 0.), upper(n+1, 0.), rhs(n+1, 0.);
+	double h0 = knotX[1] - knotX[0];
+	diagonal[0] = 2. * h0;
+	upper[0] = h0;
+	rhs[0] = 6. * (knotZ[1] - knotZ[0]) / h0;
+	for (int i=1; i<n; i++)
+	{
+		double hPrevious = knotX[i] - knotX[i-1];
+		double hNext = knotX[i+1] - knotX[i];
+		lower[i] = hPrevious;
+		diagonal[i] = 2. * (hPrevious + hNext);
+		upper[i] = hNext;
+		rhs[i] = 6. * ((knotZ[i+1] - knotZ[i]) / hNext - (knotZ[i] - knotZ[i-1]) / hPrevious);
+	}
+	lower[n] = -1.;
+	diagonal[n] = 1.;
+	rhs[n] = 0.;
+	for (int i=1; i<=n; i++)
+	{
+		double factor = lower[i] / diagonal[i-1];
+		diagonal[i] -= factor * upper[i-1];
+		rhs[i] -= factor * rhs[i-1];
+	}
+	knotSecondDerivative.resize(n+1);
+	knotSecondDerivative[n] = rhs[n] / diagonal[n];
+	for (int i=n-1; i>=0; i--)
+		knotSecondDerivative[i] = (rhs[i] - upper[i] * knotSecondDerivative[i+1]) / diagonal[i];
+
+	// Sample the spline finely along x: slope angle, curvature and arc length (trapezoidal integration)
+	int nbSamples = 16 * CUP_PROFILE_TABLE_SIZE;
+	std::vector<double> sampleX(nbSamples), sampleZ(nbSamples), sampleAngle(nbSamples), sampleArcLength(nbSamples), sampleCurvature(nbSamples);
+	double previousSpeed = 1.;
+	for (int k=0; k<nbSamples; k++)
+	{
+		double z, dz, ddz;
+		sampleX[k] = knotX[n] * k / (nbSamples - 1);
+		EvaluateSpline(sampleX[k], z, dz, ddz);
+		if (ddz <= 0.)
+		{
+			std::cout << "Cup profile is not strictly convex (at x = " << sampleX[k] << " m)" << std::endl;
+			return -1;
+		}
+		double speed = sqrt(1. + dz * dz); // ds/dx
+		sampleZ[k] = z;
+		sampleAngle[k] = atan(dz);
+		sampleCurvature[k] = ddz / (speed * speed * speed);
+		sampleArcLength[k] = (k == 0) ? 0. : sampleArcLength[k-1] + 0.5 * (previousSpeed + speed) * (sampleX[k] - sampleX[k-1]);
+		previousSpeed = speed;
+	}
+
+	// Resample everything regularly in angle (the angle is monotonic since the cup is convex)
+	edgeAngle = sampleAngle[nbSamples-1];
+	angleStep = edgeAngle / (CUP_PROFILE_TABLE_SIZE - 1);
+	table.resize(CUP_PROFILE_TABLE_SIZE);
+	int k = 0;
+	for (int i=0; i<CUP_PROFILE_TABLE_SIZE; i++)
+	{
+		double angle = i * angleStep;
+		while (k < nbSamples - 2 && sampleAngle[k+1] < angle)
+			k++;
+		double ratio = (angle - sampleAngle[k]) / (sampleAngle[k+1] - sampleAngle[k]);
+		table[i].horizontal = sampleX[k] + ratio * (sampleX[k+1] - sampleX[k]);
+		table[i].vertical = sampleZ[k] + ratio * (sampleZ[k+1] - sampleZ[k]);
+		table[i].arcLength = sampleArcLength[k] + ratio * (sampleArcLength[k+1] - sampleArcLength[k]);
+		table[i].radius = 1. / (sampleCurvature[k] + ratio * (sampleCurvature[k+1] - sampleCurvature[k]));
+	}
+	// Derivative of the radius of curvature wrt angle (centered differences, odd function so it is zero at the bottom)
+	table[0].radiusDerivative = 0.;
+	for (int i=1; i<CUP_PROFILE_TABLE_SIZE-1; i++)
+		table[i].radiusDerivative = (table[i+1].radius - table[i-1].radius) / (2. * angleStep);
+	table[CUP_PROFILE_TABLE_SIZE-1].radiusDerivative = (table[CUP_PROFILE_TABLE_SIZE-1].radius - table[CUP_PROFILE_TABLE_SIZE-2].radius) / angleStep;
+
+	return 0;
+}
+
+
+void CupProfile::EvaluateSpline(double x, double &z, double &dz, double &ddz)
+{
+	int i = 0;
+	while (i < (int)knotX.size() - 2 && x > knotX[i+1])
+		i++;
+	double h = knotX[i+1] - knotX[i];
+	double a = knotX[i+1] - x;
+	double b = x - knotX[i];
+	double mA = knotSecondDerivative[i];
+	double mB = knotSecondDerivative[i+1];
+	z = mA * a * a * a / (6. * h) + mB * b * b * b / (6. * h) + (knotZ[i] / h - mA * h / 6.) * a + (knotZ[i+1] / h - mB * h / 6.) * b;
+	dz = - mA * a * a / (2. * h) + mB * b * b / (2. * h) - (knotZ[i] / h - mA * h / 6.) + (knotZ[i+1] / h - mB * h / 6.);
+	ddz = (mA * a + mB * b) / h;
+}
+
+
+void CupProfile::GetBallPosition(double angle, double &horizontal, double &vertical)
+{
+	double sign = (angle < 0.) ? -1. : 1.;
+	double position = fabs(angle) / angleStep;
+	if (position >= CUP_PROFILE_TABLE_SIZE - 1)
+		position = CUP_PROFILE_TABLE_SIZE - 1 - 1e-9;
+	int i = (int)position;
+	double ratio = position - i;
+	horizontal = sign * (table[i].horizontal + ratio * (table[i+1].horizontal - table[i].horizontal));
+	vertical = table[i].vertical + ratio * (table[i+1].vertical - table[i].vertical);
+}
+
+
+void CupProfile::GetRadiusOfCurvature(double angle, double &radius, double &radiusDerivative)
+{
+	double sign = (angle < 0.) ? -1. : 1.;
+	double position = fabs(angle) / angleStep;
+	if (position >= CUP_PROFILE_TABLE_SIZE - 1)
+		position = CUP_PROFILE_TABLE_SIZE - 1 - 1e-9;
+	int i = (int)position;
+	double ratio = position - i;
+	radius = table[i].radius + ratio * (table[i+1].radius - table[i].radius);
+	radiusDerivative = sign * (table[i].radiusDerivative + ratio * (table[i+1].radiusDerivative - table[i].radiusDerivative));
+}
+
+
+double CupProfile::GetArcLength(double angle)
+{
+	double sign = (angle < 0.) ? -1. : 1.;
+	double position = fabs(angle) / angleStep;
+	if (position >= CUP_PROFILE_TABLE_SIZE - 1)
+		position = CUP_PROFILE_TABLE_SIZE - 1 - 1e-9;
+	int i = (int)position;
+	double ratio = position - i;
+	return sign * (table[i].arcLength + ratio * (table[i+1].arcLength - table[i].arcLength));
+}
+
+
+double CupProfile::GetEdgeAngle()
+{
+	return edgeAngle;
+}
+
+
+double CupProfile::GetBottomRadius()
+{
+	return table.empty() ? 0. : table[0].radius;
+}
+
+
+int CupProfile::GetNbKnots()
+{
+	return knotX.size();
+}
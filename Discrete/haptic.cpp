@@ -17,9 +17,14 @@ Haptic::Haptic(double inertiaHM, double floorHeight, int pX, int pY, int pZ) //
 		currentVelocity[i] = 0.0;
 		currentAcceleration[i] = 0.0;
 		currentForce[i] = 0.0;
+		commandedBallForce[i] = 0.0;
+		commandedPerturbationForce[i] = 0.0;
+		springDrift[i] = 0.0;
 	}
 
 	waitStateChange = 100;
+	QueryPerformanceFrequency((LARGE_INTEGER*)&timerFrequency);
+	roundTripTime = 0.;
 
 	springStiffness_stiff = 5000.;
 	springDamping_stiff = 10; //2*sqrt(inertia * springStiffness); //10. // Critical damping
@@ -37,6 +42,9 @@ Haptic::Haptic(double inertiaHM, double floorHeight, int pX, int pY, int pZ) //
 	springDirection_X[posX] = 1.0;
 	springDirection_Y[posY] = 1.0;
 	springDirection_Z[posZ] = 1.0;
+	for (int i = 0; i<NB_SPRING_STATES; i++)
+		springStates[i] = 0.;
+	springStates[SPRING_STATE_START_POSITION] = springPosition[posY];
 
 	dampingCoef[0] = 0.;
 	dampingCoef[1] = 30.; // TODO may need adjustments (should it be given as a parameter?) 
@@ -74,15 +82,50 @@ double* Haptic::GetCurrentForce()
 	return currentForce;
 }
 
+double* Haptic::GetCommandedBallForce()
+{
+	return commandedBallForce;
+}
+
+double* Haptic::GetCommandedPerturbationForce()
+{
+	return commandedPerturbationForce;
+}
+
+double* Haptic::GetSpringStates()
+{
+	return springStates;
+}
+
+double* Haptic::GetSpringDrift()
+{
+	return springDrift;
+}
+
+double Haptic::GetMeasurementRoundTripTime()
+{
+	return roundTripTime;
+}
+
 void Haptic::UpdateForcePositionVelocityAcceleration() //TODO check error in returned string
 {
 	char res[400]; // TODO verifier que c'est assez long pour la reponse concatenee
 	char str_pos[100], str_vel[100], str_acc[100], str_force[100];
+	unsigned __int64 requestTimeStamp, answerTimeStamp;
 	
+	QueryPerformanceCounter((LARGE_INTEGER *)&requestTimeStamp);
 	if(haSendCommand(hapticMaster, "get modelpos; get modelvel; get modelacc; get measforce", res) || strstr(res, ERROR_MSG))
 		std::cout << "Error on reading HM position/velocity/acceleration/force" << std::endl;
 	else	
 	{
+		// Time of a full request/answer exchange with the HM (smoothed because the network delay is noisy)
+		QueryPerformanceCounter((LARGE_INTEGER *)&answerTimeStamp);
+		double lastRoundTripTime = (1. * (answerTimeStamp - requestTimeStamp)) / timerFrequency;
+		if (roundTripTime == 0.)
+			roundTripTime = lastRoundTripTime;
+		else
+			roundTripTime = 0.9 * roundTripTime + 0.1 * lastRoundTripTime;
+
 		BreakResponse(str_pos, res, 1); // TODO verifier les indices si commence a 0 ou 1
 		ParseFloatVec(str_pos, currentPosition[posX], currentPosition[posY], currentPosition[posZ]);
 
@@ -94,6 +137,11 @@ void Haptic::UpdateForcePositionVelocityAcceleration() //TODO check error in ret
 		
 		BreakResponse(str_force, res, 4);
 		ParseFloatVec(str_force, currentForce[posX], currentForce[posY], currentForce[posZ]);
+
+		// Distance to the positions the springs pull towards (spring_Y only acts when it is enabled)
+		springDrift[posX] = currentPosition[posX] - springPosition[posX];
+		springDrift[posY] = currentPosition[posY] - springStates[SPRING_STATE_START_POSITION];
+		springDrift[posZ] = currentPosition[posZ] - springPosition[posZ];
 	}	
 }
 
@@ -252,6 +300,7 @@ void Haptic::EnableDamper()
 	char res[100];
 	if (haSendCommand(hapticMaster, "set damper enable", res) || strstr(res, ERROR_MSG))
 		std::cout << "ERROR on damper enabling" << std::endl;
+	springStates[SPRING_STATE_DAMPER_ENABLED] = 1.;
 }
 
 void Haptic::DisableDamper()
@@ -259,6 +308,7 @@ void Haptic::DisableDamper()
 	char res[100];
 	if (haSendCommand(hapticMaster, "set damper disable", res) || strstr(res, ERROR_MSG))
 		std::cout << "ERROR on damper disabling" << std::endl;
+	springStates[SPRING_STATE_DAMPER_ENABLED] = 0.;
 }
 
 void Haptic::EnableStartPositionSpring()
@@ -266,6 +316,7 @@ void Haptic::EnableStartPositionSpring()
 	char res[100];
 	if (haSendCommand(hapticMaster, "set spring_Y enable", res) || strstr(res, ERROR_MSG))
 		std::cout << "ERROR on spring enabling" << std::endl;
+	springStates[SPRING_STATE_START_ENABLED] = 1.;
 }
 
 void Haptic::DisableStartPositionSpring()
@@ -273,6 +324,7 @@ void Haptic::DisableStartPositionSpring()
 	char res[100];
 	if (haSendCommand(hapticMaster, "set spring_Y disable", res) || strstr(res, ERROR_MSG))
 		std::cout << "ERROR on spring disabling" << std::endl;
+	springStates[SPRING_STATE_START_ENABLED] = 0.;
 }
 
 
@@ -281,6 +333,7 @@ void Haptic::UpdateStartPositionSpring(double referencePosition[3])
 	char res[100];
 	if(haSendCommand(hapticMaster, "set spring_Y pos", referencePosition[posX], referencePosition[posY], referencePosition[posZ], res) || strstr(res, ERROR_MSG))
 		std::cout << "ERROR on spring_Y position updating" << std::endl;
+	springStates[SPRING_STATE_START_POSITION] = referencePosition[posY];
 }
 
 void Haptic::EnableRestrict1DMotion()
@@ -293,6 +346,7 @@ void Haptic::EnableRestrict1DMotion()
 	if (haSendCommand(hapticMaster, "set spring_Z stiffness", springStiffness_stiff, res) || strstr(res, ERROR_MSG) ||
 		haSendCommand(hapticMaster, "set spring_Z dampfactor", springDamping_stiff, res)	|| strstr(res, ERROR_MSG))
 		std::cout << "ERROR on spring_Z stiffening" << std::endl;
+	springStates[SPRING_STATE_CONSTRAINT] = 1.;
 }
 
 void Haptic::DisableRestrict1DMotion()
@@ -305,6 +359,32 @@ void Haptic::DisableRestrict1DMotion()
 	if (haSendCommand(hapticMaster, "set spring_Z stiffness", springStiffness_smooth, res) || strstr(res, ERROR_MSG) ||
 		haSendCommand(hapticMaster, "set spring_Z dampfactor", springDamping_smooth, res)	|| strstr(res, ERROR_MSG))
 		std::cout << "ERROR on spring_Z smoothing" << std::endl;
+	springStates[SPRING_STATE_CONSTRAINT] = 0.;
+}
+
+
+void Haptic::EnableRestrictPlanarMotion()
+{
+	char res[100];
+	if (haSendCommand(hapticMaster, "set spring_X disable", res) || strstr(res, ERROR_MSG))
+		std::cout << "ERROR on spring_X disabling" << std::endl;
+
+	if (haSendCommand(hapticMaster, "set spring_Z stiffness", springStiffness_stiff, res) || strstr(res, ERROR_MSG) ||
+		haSendCommand(hapticMaster, "set spring_Z dampfactor", springDamping_stiff, res)	|| strstr(res, ERROR_MSG))
+		std::cout << "ERROR on spring_Z stiffening" << std::endl;
+	springStates[SPRING_STATE_CONSTRAINT] = 2.;
+}
+
+void Haptic::DisableRestrictPlanarMotion()
+{
+	char res[100];
+	if (haSendCommand(hapticMaster, "set spring_X enable", res) || strstr(res, ERROR_MSG))
+		std::cout << "ERROR on spring_X enabling" << std::endl;
+
+	if (haSendCommand(hapticMaster, "set spring_Z stiffness", springStiffness_smooth, res) || strstr(res, ERROR_MSG) ||
+		haSendCommand(hapticMaster, "set spring_Z dampfactor", springDamping_smooth, res)	|| strstr(res, ERROR_MSG))
+		std::cout << "ERROR on spring_Z smoothing" << std::endl;
+	springStates[SPRING_STATE_CONSTRAINT] = 0.;
 }
 
 
@@ -320,6 +400,8 @@ void Haptic::UpdateBallForce(double force[3])
 	}
 	if(haSendCommand(hapticMaster, "set ballForce force", force[posX], force[posY], force[posZ], res) || strstr(res, ERROR_MSG))  // no time limit, the current force is valid until a new one is calculated
 		std::cout << "ERROR on ballForce updating" << std::endl;
+	for (int i=0; i<3; i++)
+		commandedBallForce[i] = force[i];
 }
 
 
@@ -332,6 +414,8 @@ void Haptic::EnableBallForce()
 		force[i] = 0;
 	if(haSendCommand(hapticMaster, "set ballForce force", force[posX], force[posY], force[posZ], res)  || strstr(res, ERROR_MSG) || haSendCommand(hapticMaster, "set ballForce enable", res) || strstr(res, ERROR_MSG))
 		std::cout << "ERROR on ballForce enabling" << std::endl;
+	for (int i=0; i<3; i++)
+		commandedBallForce[i] = 0.;
 }
 
 void Haptic::DisableBallForce()
@@ -339,6 +423,8 @@ void Haptic::DisableBallForce()
 	char res[100];
 	if(haSendCommand(hapticMaster, "set ballForce disable", res) || strstr(res, ERROR_MSG))
 		std::cout << "ERROR on ballForce disabling" << std::endl;
+	for (int i=0; i<3; i++)
+		commandedBallForce[i] = 0.;
 }
 
 void Haptic::ApplyPerturbationForce(double force[3])
@@ -346,6 +432,8 @@ void Haptic::ApplyPerturbationForce(double force[3])
 	char res[100];
 	if(haSendCommand(hapticMaster, "set perturbationForce force", force[posX], force[posY], force[posZ], res) || strstr(res, ERROR_MSG) || haSendCommand(hapticMaster, "set perturbationForce enable", res) || strstr(res, ERROR_MSG))
 		std::cout << "ERROR on perturbationForce enabling" << std::endl;	
+	for (int i=0; i<3; i++)
+		commandedPerturbationForce[i] = force[i];
 }
 
 void Haptic::StopPerturbationForce()
@@ -353,6 +441,8 @@ void Haptic::StopPerturbationForce()
 	char res[100];
 	if(haSendCommand(hapticMaster, "set perturbationForce disable", res) || strstr(res, ERROR_MSG))
 		std::cout << "ERROR on perturbationForce disabling" << std::endl;
+	for (int i=0; i<3; i++)
+		commandedPerturbationForce[i] = 0.;
 }
 
 
@@ -8,6 +8,13 @@
 #define IPADDRESS "10.30.203.37"
 #define  ERROR_MSG "--- ERROR:" // TODO espace ou pas avant ERROR
 
+// Indices of the states of the springs and damper (see GetSpringStates)
+#define SPRING_STATE_START_ENABLED 0 // 1 if spring_Y brings the end-effector back to the start position
+#define SPRING_STATE_START_POSITION 1 // (m) reference position of spring_Y along posY
+#define SPRING_STATE_CONSTRAINT 2 // 0: X and Z springs smooth, 1: stiff (1D motion), 2: planar motion (X spring disabled, Z spring stiff)
+#define SPRING_STATE_DAMPER_ENABLED 3 // 1 if the damper is enabled
+#define NB_SPRING_STATES 4
+
 class Haptic
 {
 	// Methods
@@ -21,6 +28,12 @@ public:
 	double* GetCurrentVelocity();
 	double* GetCurrentAcceleration();
 	double* GetCurrentForce();
+	// Commands sent to the HM (kept for the recording, the arrays are updated in place)
+	double* GetCommandedBallForce(); // force of ballForce after the limitation to maxAllowedFeedbackForce (0 when ballForce is disabled)
+	double* GetCommandedPerturbationForce(); // 0 when perturbationForce is disabled
+	double* GetSpringStates(); // see SPRING_STATE_...
+	double* GetSpringDrift(); // (m) current position minus the position of the X/Y/Z springs
+	double GetMeasurementRoundTripTime(); // (s) smoothed duration of the request of the current position/velocity/acceleration/force (i.e. age of the measurement when it is received)
 	// Functions used by glut display
 	void UpdateForcePositionVelocityAcceleration();
 	void Terminate();
@@ -32,6 +45,9 @@ public:
 	void UpdateStartPositionSpring(double referencePosition[3]);
 	void EnableRestrict1DMotion();
 	void DisableRestrict1DMotion();
+	// Same as above for the 2D cup task: the end-effector is only constrained to stay in the horizontal plane (X spring disabled, Z spring stiffened)
+	void EnableRestrictPlanarMotion();
+	void DisableRestrictPlanarMotion();
 	void EnableDamper();
 	void DisableDamper();
 	void UpdateBallForce(double force[3]);
@@ -48,7 +64,13 @@ private:
 	double currentVelocity[3];
 	double currentAcceleration[3];
 	double currentForce[3];
+	double commandedBallForce[3];
+	double commandedPerturbationForce[3];
+	double springStates[NB_SPRING_STATES];
+	double springDrift[3];
 	int waitStateChange;
+	unsigned __int64 timerFrequency;
+	double roundTripTime;
 
 	// define axes orientation
 	int posX, posY, posZ;
@@ -0,0 +1,88 @@
+#ifndef JOURNAL_H_INCLUDED
+#define JOURNAL_H_INCLUDED
+
+/* Journal of the recorded trials, so that the data files can be recovered after a crash */
+/*
+	The data files are written by a background thread (see trialWriter.h): until a file is on the disk, its trial only exists in memory
+	(queue of the writer, chunks of the current trial), and is lost if the program is stopped (exit, abort, power loss). The writer thread first appends
+	the raw samples of what it receives to the journal of the block (much faster than formatting the data files), and makes all the records appended
+	since its last wake-up durable with a single FlushFileBuffers (group commit). Once a data file is written and flushed to the disk, the trial is marked
+	as written, and the journal is emptied as soon as no trial is left in it, so that it stays small.
+	At the next start (see TrialWriter::OpenJournal, which reads all the journals of the Output folder: the name of the block changes with its date),
+	the trials which are in a journal but not written are recovered: the submitted trials are written
+	as they would have been, the trials interrupted during the motion are truncated to their last durable chunk and written in CSV (_partial.csv).
+	A record cut by the crash (or damaged) ends the journal.
+
+	Record (little endian, strings and parameters as in the binary trial files, see trialFile.h):
+		unsigned int magic (JOURNAL_RECORD_MAGIC), type, payloadSize, payload, unsigned int checksum (FNV-1a of the payload)
+	Payload:
+		JOURNAL_RECORD_CHUNK: int trialNb, string filename, then samples: unsigned int nbChannels, nbSamples, nbChannels x (string name, string unit),
+			double samples[nbChannels * nbSamples] (columns)
+		JOURNAL_RECORD_TRIAL: int trialNb, string filename, unsigned int format, double nbHeaderLines, string taskName, unsigned int nbParameters,
+			nbParameters x parameter, then the last samples of the trial (as in JOURNAL_RECORD_CHUNK)
+		JOURNAL_RECORD_WRITTEN: int trialNb, string filename
+*/
+#include <windows.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <iostream>
+#include "recorder.h"
+#include "trialFile.h"
+
+#define JOURNAL_RECORD_MAGIC 0x4C4E524A // "JRNL"
+#define JOURNAL_RECORD_CHUNK 1 // samples of a trial recorded in chunks, during the motion
+#define JOURNAL_RECORD_TRIAL 2 // submitted trial: parameters and last samples
+#define JOURNAL_RECORD_WRITTEN 3 // the data file of the trial is on the disk
+
+// Trial read from a journal (the samples of all its records)
+struct JournalTrial
+{
+	int trialNb;
+	std::string filename;
+	bool isSubmitted; // JOURNAL_RECORD_TRIAL found (otherwise the trial was interrupted)
+	bool isWritten;
+	int format;
+	TrialHeader header;
+	std::vector<std::string> channelNames;
+	std::vector<std::string> channelUnits;
+	std::vector<std::vector<double> > channels;
+};
+
+// Append-only journal, used by the writer thread only
+class TrialJournal
+{
+	public:
+		TrialJournal();
+		~TrialJournal();
+
+		// Open an empty journal (the trials of an existing journal must have been recovered before, see Read). Return -1 if the file cannot be opened
+		int Open(const std::string &filename);
+		void Close();
+		bool IsOpen();
+		// Append a record (not durable until Commit). Return -1 if the writing failed
+		int AppendChunk(int trialNb, const std::string &filename, Recorder &data);
+		int AppendTrial(int trialNb, const std::string &filename, int format, const TrialHeader &header, Recorder &data);
+		// The data file is written: when no trial is left in the journal, the journal is emptied
+		int AppendWritten(int trialNb, const std::string &filename);
+		// Make the records appended since the last commit durable. Return -1 if it failed
+		int Commit();
+
+		// Read the trials of a journal file, in the order of their first record. Return -1 if the file cannot be read (an empty or missing journal has no trial)
+		// nbIgnoredBytes is the size of the end of the file which is not a valid record (cut by a crash)
+		static int Read(const std::string &filename, std::vector<JournalTrial> &trials, unsigned __int64 &nbIgnoredBytes);
+
+	private:
+		void AppendSamples(Recorder &data);
+		int WriteRecord(unsigned int type);
+		void AddPendingTrial(int trialNb, const std::string &filename);
+
+		HANDLE fileHandle;
+		std::string record; // payload of the record being written (memory reused)
+		std::vector<std::pair<int, std::string> > pendingTrials; // trials in the journal whose data file is not written
+};
+
+// Flush a written file to the disk (the data of the file which are still in the cache of the system). Return -1 if it failed
+int SyncFile(const std::string &filename);
+
+#endif // JOURNAL_H_INCLUDED
@@ -0,0 +1,179 @@
+#include "loopScheduler.h"
+
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002 // Windows 10 (1803) and later
+#endif
+
+LoopScheduler::LoopScheduler()
+{
+	overrunPolicy = LOOP_OVERRUN_SKIP;
+	maxNbCatchUpTicks = LOOP_SCHEDULER_MAX_CATCH_UP_TICKS;
+	pTickFunction = NULL;
+	tickFunctionID = 0;
+	timerFrequency = 1;
+	periodTicks = 1;
+	timerHandle = NULL;
+	isTimerPeriodSet = false;
+	realTimePriority = REAL_TIME_OFF;
+	realTimeCpu = -1;
+	isRunning = false;
+	nbTicks = 0;
+	nbOverruns = 0;
+	nbSkippedTicks = 0;
+}
+
+LoopScheduler::~LoopScheduler()
+{
+	Stop();
+}
+
+
+int LoopScheduler::SetOverrunPolicy(int policy, unsigned int maxCatchUpTicks)
+{
+	if (isRunning || (policy != LOOP_OVERRUN_SKIP && policy != LOOP_OVERRUN_CATCH_UP))
+		return -1;
+	overrunPolicy = policy;
+	maxNbCatchUpTicks = maxCatchUpTicks;
+	return 0;
+}
+
+
+void LoopScheduler::SetRealTime(int priority, int cpu)
+{
+	realTimePriority = priority;
+	realTimeCpu = cpu;
+}
+
+
+int LoopScheduler::Start(int period, void (*tickFunction)(int), int tickID)
+{
+	if (isRunning || period <= 0 || tickFunction == NULL)
+		return -1;
+
+	timerHandle = CreateWaitableTimerExW(NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+	if (timerHandle == NULL)
+	{
+		// Older systems: the resolution of the timer is the resolution of the system clock (15.6 ms by default)
+		timerHandle = CreateWaitableTimer(NULL, FALSE, NULL);
+		if (timerHandle == NULL)
+		{
+			std::cout << "Error: the timer of the control loop cannot be created" << std::endl;
+			return -1;
+		}
+		timeBeginPeriod(1);
+		isTimerPeriodSet = true;
+	}
+
+	QueryPerformanceFrequency((LARGE_INTEGER *)&timerFrequency);
+	periodTicks = (period * timerFrequency) / 1000;
+	pTickFunction = tickFunction;
+	tickFunctionID = tickID;
+	nbTicks = 0;
+	nbOverruns = 0;
+	nbSkippedTicks = 0;
+	isRunning = true;
+	schedulerThread = std::thread(&LoopScheduler::Run, this);
+
+	// Before the first deadline (one period later)
+	if (realTimePriority != REAL_TIME_OFF)
+	{
+		SetRealTimePriority((HANDLE)schedulerThread.native_handle(), realTimePriority);
+		if (realTimeCpu >= 0)
+			PinThreadToCpu((HANDLE)schedulerThread.native_handle(), realTimeCpu);
+	}
+	return 0;
+}
+
+
+void LoopScheduler::Stop()
+{
+	isRunning = false;
+	if (schedulerThread.joinable())
+		schedulerThread.join();
+	if (timerHandle != NULL)
+		CloseHandle(timerHandle);
+	timerHandle = NULL;
+	if (isTimerPeriodSet)
+		timeEndPeriod(1);
+	isTimerPeriodSet = false;
+}
+
+
+unsigned int LoopScheduler::GetNbTicks()
+{
+	return nbTicks;
+}
+
+
+unsigned int LoopScheduler::GetNbOverruns()
+{
+	return nbOverruns;
+}
+
+
+unsigned int LoopScheduler::GetNbSkippedTicks()
+{
+	return nbSkippedTicks;
+}
+
+
+void LoopScheduler::Run()
+{
+	unsigned __int64 deadline, now;
+	unsigned int nbCatchUpTicks = 0; // late ticks still to run at once
+	QueryPerformanceCounter((LARGE_INTEGER *)&deadline);
+	deadline += periodTicks;
+
+	while (isRunning)
+	{
+		WaitUntil(deadline);
+		if (!isRunning)
+			break;
+		pTickFunction(tickFunctionID);
+		nbTicks++;
+
+		// Next deadline on the grid, whatever the duration of the tick
+		deadline += periodTicks;
+		QueryPerformanceCounter((LARGE_INTEGER *)&now);
+		if (nbCatchUpTicks > 0)
+			nbCatchUpTicks--; // the deadline of this tick was already passed
+		if (nbCatchUpTicks == 0 && now >= deadline) // also after the last late tick: if it ends after the next deadline, this is a new overrun
+		{
+			nbOverruns++;
+			unsigned __int64 nbMissedTicks = (now - deadline) / periodTicks + 1; // deadlines already passed
+			unsigned __int64 nbRunTicks = 0;
+			if (overrunPolicy == LOOP_OVERRUN_CATCH_UP)
+				nbRunTicks = (nbMissedTicks < maxNbCatchUpTicks) ? nbMissedTicks : maxNbCatchUpTicks;
+			deadline += (nbMissedTicks - nbRunTicks) * periodTicks;
+			nbSkippedTicks += (unsigned int)(nbMissedTicks - nbRunTicks);
+			nbCatchUpTicks = (unsigned int)nbRunTicks;
+		}
+	}
+}
+
+
+void LoopScheduler::WaitUntil(unsigned __int64 deadline)
+{
+	unsigned __int64 now;
+	QueryPerformanceCounter((LARGE_INTEGER *)&now);
+	if (now >= deadline)
+		return;
+
+	// Sleep until shortly before the deadline (in 100 ns units, negative for a relative time: the absolute times of the timer follow the system clock, which can be adjusted)
+	double sleepDuration = (double)(deadline - now) / timerFrequency - LOOP_SCHEDULER_SPIN_TIME;
+	if (sleepDuration > 0.)
+	{
+		LARGE_INTEGER dueTime;
+		dueTime.QuadPart = -(__int64)(sleepDuration * 1e7);
+		if (SetWaitableTimer(timerHandle, &dueTime, 0, NULL, NULL, FALSE))
+			WaitForSingleObject(timerHandle, INFINITE);
+	}
+
+	// Then poll the counter up to the deadline
+	do
+	{
+		YieldProcessor();
+		QueryPerformanceCounter((LARGE_INTEGER *)&now);
+	}
+	while (now < deadline);
+}
@@ -0,0 +1,245 @@
+#include "loopTiming.h"
+
+static const char *phaseNames[LOOP_TIMING_NB_PHASES] = {"Tick", "Period", "DeviceRead", "Model", "ForceWrite", "Recording"};
+
+static void ResetHistogram(TimingHistogram &histogram)
+{
+	for (int b=0; b<LOOP_TIMING_NB_BINS; b++)
+		histogram.bins[b].store(0, std::memory_order_relaxed);
+	histogram.nbValues.store(0, std::memory_order_relaxed);
+	histogram.nbOverBudget.store(0, std::memory_order_relaxed);
+	histogram.sum.store(0., std::memory_order_relaxed);
+	histogram.sumSquares.store(0., std::memory_order_relaxed);
+	histogram.max.store(0., std::memory_order_relaxed);
+}
+
+
+// Only one thread writes in a histogram: no read-modify-write is needed, each counter is simply stored again
+static void AddHistogram(TimingHistogram &destination, const TimingHistogram &source)
+{
+	for (int b=0; b<LOOP_TIMING_NB_BINS; b++)
+		destination.bins[b].store(destination.bins[b].load(std::memory_order_relaxed) + source.bins[b].load(std::memory_order_relaxed), std::memory_order_relaxed);
+	destination.nbValues.store(destination.nbValues.load(std::memory_order_relaxed) + source.nbValues.load(std::memory_order_relaxed), std::memory_order_relaxed);
+	destination.nbOverBudget.store(destination.nbOverBudget.load(std::memory_order_relaxed) + source.nbOverBudget.load(std::memory_order_relaxed), std::memory_order_relaxed);
+	destination.sum.store(destination.sum.load(std::memory_order_relaxed) + source.sum.load(std::memory_order_relaxed), std::memory_order_relaxed);
+	destination.sumSquares.store(destination.sumSquares.load(std::memory_order_relaxed) + source.sumSquares.load(std::memory_order_relaxed), std::memory_order_relaxed);
+	if (source.max.load(std::memory_order_relaxed) > destination.max.load(std::memory_order_relaxed))
+		destination.max.store(source.max.load(std::memory_order_relaxed), std::memory_order_relaxed);
+}
+
+
+static double ComputeStd(unsigned int nbValues, double sum, double sumSquares)
+{
+	if (nbValues < 2)
+		return 0.;
+	double variance = (sumSquares - sum * sum / nbValues) / (nbValues - 1);
+	return (variance > 0.) ? sqrt(variance) : 0.;
+}
+
+
+// (s) upper bound of the bin where the fraction of the values is reached
+static double ComputePercentile(const TimingHistogram &histogram, double fraction)
+{
+	unsigned int nbValues = histogram.nbValues.load(std::memory_order_relaxed);
+	unsigned int nbBelow = 0;
+	for (int b=0; b<LOOP_TIMING_NB_BINS; b++)
+	{
+		nbBelow += histogram.bins[b].load(std::memory_order_relaxed);
+		if (nbBelow >= fraction * nbValues)
+			return (b + 1) * LOOP_TIMING_BIN_WIDTH;
+	}
+	return histogram.max.load(std::memory_order_relaxed);
+}
+
+
+LoopTiming::LoopTiming(const char * const *stateNames, int nbStates)
+{
+	nbStatesUsed = (nbStates < LOOP_TIMING_MAX_STATES) ? nbStates : LOOP_TIMING_MAX_STATES;
+	for (int s=0; s<nbStatesUsed; s++)
+		names[s] = stateNames[s];
+	timeBudget = 0.;
+	QueryPerformanceFrequency((LARGE_INTEGER *)&timerFrequency);
+	tickStart = 0;
+	previousTickStart = 0;
+	phaseStart = 0;
+	tickState = 0;
+	for (int s=0; s<LOOP_TIMING_MAX_STATES; s++)
+		for (int p=0; p<LOOP_TIMING_NB_PHASES; p++)
+		{
+			ResetHistogram(trialHistograms[s][p]);
+			ResetHistogram(blockHistograms[s][p]);
+		}
+}
+
+LoopTiming::~LoopTiming()
+{
+}
+
+
+void LoopTiming::SetBudget(double budget)
+{
+	timeBudget = budget;
+}
+
+
+double LoopTiming::GetBudget()
+{
+	return timeBudget;
+}
+
+
+void LoopTiming::BeginTick(int state)
+{
+	QueryPerformanceCounter((LARGE_INTEGER *)&tickStart);
+	tickState = (state >= 0 && state < nbStatesUsed) ? state : 0;
+	if (previousTickStart != 0)
+		Add(trialHistograms[tickState][LOOP_PHASE_PERIOD], (double)(tickStart - previousTickStart) / timerFrequency);
+	previousTickStart = tickStart;
+}
+
+
+void LoopTiming::BeginPhase()
+{
+	QueryPerformanceCounter((LARGE_INTEGER *)&phaseStart);
+}
+
+
+void LoopTiming::EndPhase(int phase)
+{
+	unsigned __int64 now;
+	QueryPerformanceCounter((LARGE_INTEGER *)&now);
+	Add(trialHistograms[tickState][phase], (double)(now - phaseStart) / timerFrequency);
+}
+
+
+void LoopTiming::EndTick()
+{
+	unsigned __int64 now;
+	QueryPerformanceCounter((LARGE_INTEGER *)&now);
+	double duration = (double)(now - tickStart) / timerFrequency;
+	TimingHistogram &histogram = trialHistograms[tickState][LOOP_PHASE_TICK];
+	Add(histogram, duration);
+	if (timeBudget > 0. && duration > timeBudget)
+		histogram.nbOverBudget.store(histogram.nbOverBudget.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+
+unsigned int LoopTiming::GetTrialNbOverBudget()
+{
+	unsigned int nbOverBudget = 0;
+	for (int s=0; s<nbStatesUsed; s++)
+		nbOverBudget += trialHistograms[s][LOOP_PHASE_TICK].nbOverBudget.load(std::memory_order_relaxed);
+	return nbOverBudget;
+}
+
+
+double LoopTiming::GetTrialMax(int phase)
+{
+	double max = 0.;
+	for (int s=0; s<nbStatesUsed; s++)
+		if (trialHistograms[s][phase].max.load(std::memory_order_relaxed) > max)
+			max = trialHistograms[s][phase].max.load(std::memory_order_relaxed);
+	return max;
+}
+
+
+double LoopTiming::GetTrialStd(int phase)
+{
+	unsigned int nbValues = 0;
+	double sum = 0., sumSquares = 0.;
+	for (int s=0; s<nbStatesUsed; s++)
+	{
+		nbValues += trialHistograms[s][phase].nbValues.load(std::memory_order_relaxed);
+		sum += trialHistograms[s][phase].sum.load(std::memory_order_relaxed);
+		sumSquares += trialHistograms[s][phase].sumSquares.load(std::memory_order_relaxed);
+	}
+	return ComputeStd(nbValues, sum, sumSquares);
+}
+
+
+void LoopTiming::EndTrial(int trialNb)
+{
+	char trial[16];
+	sprintf_s(trial, "%d", trialNb);
+	AppendRows(trial, trialHistograms, trialRows);
+	for (int s=0; s<nbStatesUsed; s++)
+		for (int p=0; p<LOOP_TIMING_NB_PHASES; p++)
+		{
+			AddHistogram(blockHistograms[s][p], trialHistograms[s][p]);
+			ResetHistogram(trialHistograms[s][p]);
+		}
+}
+
+
+int LoopTiming::WriteFile(const std::string &filename)
+{
+	std::ofstream timing_file(filename.c_str());
+	if (!timing_file)
+	{
+		std::cout << "Error on file opening: " << filename << std::endl;
+		return -1;
+	}
+	char budget[64];
+	sprintf_s(budget, "%.3f", timeBudget * 1000.);
+	timing_file << "TimeBudget (ms)," << budget << std::endl;
+	timing_file << "Trial,State,Phase,Count,Mean,Std,Max,P50,P99,OverBudget,Histogram" << std::endl;
+	std::string blockRows;
+	AppendRows("Block", blockHistograms, blockRows);
+	timing_file << trialRows << blockRows;
+	timing_file.close();
+	if (timing_file.fail())
+		return -1;
+	return 0;
+}
+
+
+void LoopTiming::Add(TimingHistogram &histogram, double value)
+{
+	int bin = (int)(value / LOOP_TIMING_BIN_WIDTH);
+	if (bin >= LOOP_TIMING_NB_BINS)
+		bin = LOOP_TIMING_NB_BINS - 1;
+	histogram.bins[bin].store(histogram.bins[bin].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	histogram.nbValues.store(histogram.nbValues.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	histogram.sum.store(histogram.sum.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+	histogram.sumSquares.store(histogram.sumSquares.load(std::memory_order_relaxed) + value * value, std::memory_order_relaxed);
+	if (value > histogram.max.load(std::memory_order_relaxed))
+		histogram.max.store(value, std::memory_order_relaxed);
+}
+
+
+void LoopTiming::AppendRows(const std::string &trial, TimingHistogram (*histograms)[LOOP_TIMING_NB_PHASES], std::string &text)
+{
+	char row[256];
+	for (int s=0; s<nbStatesUsed; s++)
+		for (int p=0; p<LOOP_TIMING_NB_PHASES; p++)
+		{
+			const TimingHistogram &histogram = histograms[s][p];
+			unsigned int nbValues = histogram.nbValues.load(std::memory_order_relaxed);
+			if (nbValues == 0)
+				continue;
+			double sum = histogram.sum.load(std::memory_order_relaxed);
+			double deviation = ComputeStd(nbValues, sum, histogram.sumSquares.load(std::memory_order_relaxed));
+			sprintf_s(row, ",%u,%.3f,%.3f,%.3f,%.3f,%.3f,", nbValues, 1000. * sum / nbValues, 1000. * deviation, 1000. * histogram.max.load(std::memory_order_relaxed),
+				1000. * ComputePercentile(histogram, 0.5), 1000. * ComputePercentile(histogram, 0.99));
+			text += trial + "," + names[s] + "," + phaseNames[p] + row;
+			if (p == LOOP_PHASE_TICK)
+			{
+				sprintf_s(row, "%u", histogram.nbOverBudget.load(std::memory_order_relaxed));
+				text += row;
+			}
+			else
+				text += "N/A";
+			text += ",";
+			bool isFirstBin = true;
+			for (int b=0; b<LOOP_TIMING_NB_BINS; b++)
+			{
+				unsigned int nbInBin = histogram.bins[b].load(std::memory_order_relaxed);
+				if (nbInBin == 0)
+					continue;
+				sprintf_s(row, "%s%.1f:%u", isFirstBin ? "" : " ", 1000. * b * LOOP_TIMING_BIN_WIDTH, nbInBin);
+				text += row;
+				isFirstBin = false;
+			}
+			text += "\n";
+		}
+}
@@ -0,0 +1,92 @@
+#ifndef LOOPTIMING_H_INCLUDED
+#define LOOPTIMING_H_INCLUDED
+
+/* Timing of the ticks of the control loop, by status of the task and by phase of the tick */
+/*
+	The timeStep of each tick is used to integrate the ball dynamics, so the jitter of the loop (and the ticks which take too long) directly changes the motion
+	of the ball. For each status of the task (WAITFORSTART, INMOTION...) and each phase of the tick, the durations are accumulated in a histogram
+	(bins of LOOP_TIMING_BIN_WIDTH, the last bin holds everything above), with their count, sum, sum of squares and maximum:
+	- LOOP_PHASE_TICK: the whole tick, and the number of ticks longer than the budget
+	- LOOP_PHASE_PERIOD: interval since the start of the previous tick (the measured timeStep, its spread is the jitter)
+	- LOOP_PHASE_DEVICE_READ, LOOP_PHASE_MODEL, LOOP_PHASE_FORCE_WRITE, LOOP_PHASE_RECORDING: parts of the tick (not all the ticks have all the parts)
+	A tick is counted in the status it starts in.
+
+	The histograms are only written by the loop thread, with atomic counters (no lock), so that they can be read by any thread at any time.
+	There is one set of histograms for the current trial and one for the block: at the end of each trial (EndTrial), the rows of the trial are formatted
+	and the trial histograms are added to the block ones. WriteFile writes the rows of all the trials, then those of the block:
+		Trial,State,Phase,Count,Mean,Std,Max,P50,P99,OverBudget,Histogram
+	with the times in ms, Trial = Block for the rows of the whole block, only the non-empty histograms, and Histogram = the non-empty bins as
+	"lower bound of the bin (ms):count" separated by spaces.
+*/
+#include <windows.h>
+#include <math.h>
+#include <stdio.h>
+#include <string>
+#include <fstream>
+#include <iostream>
+#include <atomic>
+
+#define LOOP_PHASE_TICK 0
+#define LOOP_PHASE_PERIOD 1
+#define LOOP_PHASE_DEVICE_READ 2
+#define LOOP_PHASE_MODEL 3
+#define LOOP_PHASE_FORCE_WRITE 4
+#define LOOP_PHASE_RECORDING 5
+#define LOOP_TIMING_NB_PHASES 6
+
+#define LOOP_TIMING_MAX_STATES 16
+#define LOOP_TIMING_BIN_WIDTH 0.0001 // (s)
+#define LOOP_TIMING_NB_BINS 300 // up to 30 ms
+
+struct TimingHistogram
+{
+	std::atomic<unsigned int> bins[LOOP_TIMING_NB_BINS];
+	std::atomic<unsigned int> nbValues;
+	std::atomic<unsigned int> nbOverBudget;
+	std::atomic<double> sum, sumSquares, max; // (s)
+};
+
+class LoopTiming
+{
+	public:
+		// stateNames: name of each status of the task (written in the file), nbStates at most LOOP_TIMING_MAX_STATES
+		LoopTiming(const char * const *stateNames, int nbStates);
+		~LoopTiming();
+
+		// (s) ticks longer than the budget are counted
+		void SetBudget(double budget);
+		double GetBudget();
+
+		// Tick of the control loop (loop thread only): BeginTick, then each measured phase between BeginPhase and EndPhase, then EndTick
+		void BeginTick(int state);
+		void BeginPhase();
+		void EndPhase(int phase);
+		void EndTick();
+
+		// Current trial, all the states together
+		unsigned int GetTrialNbOverBudget();
+		double GetTrialMax(int phase); // (s)
+		double GetTrialStd(int phase); // (s)
+
+		// End of the trial (loop thread only): the rows of the trial are formatted, its histograms are added to those of the block and reset
+		void EndTrial(int trialNb);
+		// Write the rows of the trials and of the block. Return -1 if the file cannot be written
+		int WriteFile(const std::string &filename);
+
+	private:
+		void Add(TimingHistogram &histogram, double value);
+		void AppendRows(const std::string &trial, TimingHistogram (*histograms)[LOOP_TIMING_NB_PHASES], std::string &text);
+
+		std::string names[LOOP_TIMING_MAX_STATES];
+		int nbStatesUsed;
+		double timeBudget; // (s)
+		unsigned __int64 timerFrequency;
+		unsigned __int64 tickStart, previousTickStart, phaseStart;
+		int tickState;
+
+		TimingHistogram trialHistograms[LOOP_TIMING_MAX_STATES][LOOP_TIMING_NB_PHASES];
+		TimingHistogram blockHistograms[LOOP_TIMING_MAX_STATES][LOOP_TIMING_NB_PHASES];
+		std::string trialRows; // rows of the trials already ended
+};
+
+#endif // LOOPTIMING_H_INCLUDED
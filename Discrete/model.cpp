@@ -1,4 +1,5 @@
 #include "model.h"
+#include <iostream>
 
 Model::Model(double massOfPendulum, double lengthOfPendulum,  double dampingInPendulum, double pendulumInitialAngle, double pendulumInitialVelocity, double gravityMagnitude)
 {
@@ -6,6 +7,10 @@ Model::Model(double massOfPendulum, double lengthOfPendulum,  double dampingInPe
 	pendulumMass = massOfPendulum;
 	pendulumLength = lengthOfPendulum;
 	pendulumDamping = dampingInPendulum;
+	cupProfile = NULL;
+
+	ComputeLinearModelConstants();
+	smallAngleThreshold = 0.;
 
 	InitializeState(pendulumInitialAngle, pendulumInitialVelocity);
 }
@@ -18,6 +23,12 @@ Model::~Model()
 double Model::ComputePendulumForceOnCart(double cartAcceleration)
 {
 	// Compute the force exerted by the pendulum on the cart (assume pendulum state is up to date)
+	if (cupProfile != NULL)
+	{
+		double radius, radiusDerivative;
+		cupProfile->GetRadiusOfCurvature(pendulumAngle, radius, radiusDerivative);
+		return - pendulumMass * (radius * cos(pendulumAngle) * pendulumAcceleration + (radiusDerivative * cos(pendulumAngle) - radius * sin(pendulumAngle)) * pendulumVelocity * pendulumVelocity);
+	}
 	double forceOnCart = pendulumMass * pendulumLength * ( - cos(pendulumAngle) * pendulumAcceleration + sin(pendulumAngle) * pendulumVelocity * pendulumVelocity );
 	return forceOnCart;
 }
@@ -44,11 +55,25 @@ void Model::InitializeState(double pendulumInitialAngle, double pendulumInitialV
 	pendulumAngle = pendulumInitialAngle;
 	pendulumVelocity = pendulumInitialVelocity;
 	pendulumAcceleration = 0.;
+
+	// Forget the past (a new trial starts)
+	modelTime = 0.;
+	historyNewest = -1;
+	nbAnalyticSteps = 0;
+	nbNumericSteps = 0;
+	historyCount = 0;
 }
 
 
 double Model::ComputePendulumAcceleration(double cartAcceleration, double pendAngle, double pendVel)
 {
+	if (cupProfile != NULL)
+	{
+		// Two table reads and one interpolation, the shape of the cup is never evaluated here
+		double radius, radiusDerivative;
+		cupProfile->GetRadiusOfCurvature(pendAngle, radius, radiusDerivative);
+		return (- cartAcceleration * cos(pendAngle) - gravity * sin(pendAngle) - radiusDerivative * pendVel * pendVel) / radius - pendulumDamping / (pendulumMass * pendulumLength * pendulumLength) * pendVel;
+	}
 	double acceleration = - (cartAcceleration / pendulumLength * cos(pendAngle) + gravity / pendulumLength * sin(pendAngle)) - pendulumDamping / (pendulumMass * pendulumLength * pendulumLength) * pendVel;
 	return acceleration;
 }
@@ -59,6 +84,150 @@ void Model::UpdatePendulumState(double cartAcceleration, double integrationTimeS
 	// Compute current pendulum acceleration from the cart motion, and update the pendulum state by integrating acceleration
 	pendulumAcceleration = ComputePendulumAcceleration(cartAcceleration, pendulumAngle, pendulumVelocity);
 
+	IntegrateOneStep(cartAcceleration, integrationTimeStep);
+	modelTime += integrationTimeStep;
+}
+
+
+void Model::UpdatePendulumState(double cartAcceleration, double integrationTimeStep, double measurementDelay)
+{
+	if (measurementDelay <= 0.)
+	{
+		UpdatePendulumState(cartAcceleration, integrationTimeStep);
+		return;
+	}
+
+	// Store the state at the beginning of this step (the oldest entry is overwritten when the buffer is full)
+	historyNewest = (historyNewest + 1) % MODEL_HISTORY_SIZE;
+	if (historyCount < MODEL_HISTORY_SIZE)
+		historyCount++;
+	historyTime[historyNewest] = modelTime;
+	historyAngle[historyNewest] = pendulumAngle;
+	historyVelocity[historyNewest] = pendulumVelocity;
+	historyCartAcceleration[historyNewest] = cartAcceleration;
+	historyTimeStep[historyNewest] = integrationTimeStep;
+	modelTime += integrationTimeStep;
+
+	// Rewind to the oldest stored state which is not older than the measurement (if the delay is longer than the history, rewind as far as possible)
+	double measurementTime = modelTime - measurementDelay;
+	int nbStepsBack = 1;
+	while (nbStepsBack < historyCount && historyTime[(historyNewest - nbStepsBack + MODEL_HISTORY_SIZE) % MODEL_HISTORY_SIZE] >= measurementTime)
+		nbStepsBack++;
+	int index = (historyNewest - nbStepsBack + 1 + MODEL_HISTORY_SIZE) % MODEL_HISTORY_SIZE;
+	pendulumAngle = historyAngle[index];
+	pendulumVelocity = historyVelocity[index];
+
+	// Re-simulate forward to now with the measured acceleration (the best knowledge of the cart motion since the measurement was taken), and correct the stored states on the way
+	for (int i=0; i<nbStepsBack; i++)
+	{
+		index = (historyNewest - nbStepsBack + 1 + i + MODEL_HISTORY_SIZE) % MODEL_HISTORY_SIZE;
+		historyAngle[index] = pendulumAngle;
+		historyVelocity[index] = pendulumVelocity;
+		historyCartAcceleration[index] = cartAcceleration;
+		// As without delay, the acceleration (and the force) is the one at the beginning of the new step, from the corrected state
+		if (i == nbStepsBack - 1)
+			pendulumAcceleration = ComputePendulumAcceleration(cartAcceleration, pendulumAngle, pendulumVelocity);
+		IntegrateOneStep(cartAcceleration, historyTimeStep[index], i == nbStepsBack - 1); // only the new step is counted
+	}
+}
+
+
+void Model::SetSmallAngleApproximation(double angleThreshold)
+{
+	smallAngleThreshold = fabs(angleThreshold);
+	if (smallAngleThreshold > 0. && !isUnderdamped)
+		std::cout << "Pendulum is not underdamped, small-angle approximation is not used" << std::endl;
+}
+
+
+unsigned long Model::GetNbAnalyticSteps()
+{
+	return nbAnalyticSteps;
+}
+
+
+unsigned long Model::GetNbNumericSteps()
+{
+	return nbNumericSteps;
+}
+
+
+void Model::SetCupProfile(CupProfile *profile)
+{
+	cupProfile = profile;
+	if (cupProfile != NULL)
+	{
+		pendulumLength = cupProfile->GetBottomRadius();
+		ComputeLinearModelConstants(); // the small-angle approximation is the same as for a circular cup of radius rho0
+	}
+}
+
+
+void Model::GetBallPositionInCupFrame(double &horizontal, double &vertical)
+{
+	GetBallPositionInCupFrame(pendulumAngle, horizontal, vertical);
+}
+
+
+void Model::GetBallPositionInCupFrame(double angle, double &horizontal, double &vertical)
+{
+	if (cupProfile != NULL)
+		cupProfile->GetBallPosition(angle, horizontal, vertical);
+	else
+	{
+		horizontal = pendulumLength * sin(angle);
+		vertical = pendulumLength * (1. - cos(angle));
+	}
+}
+
+
+void Model::ComputeLinearModelConstants()
+{
+	// Constants of the linearised model: ddtheta = - ddx / l - g / l * theta - b / (m * l * l) * dtheta
+	naturalFrequency = sqrt(gravity / pendulumLength);
+	dampingRate = 0.5 * pendulumDamping / (pendulumMass * pendulumLength * pendulumLength);
+	isUnderdamped = dampingRate < naturalFrequency;
+	dampedFrequency = isUnderdamped ? sqrt(naturalFrequency * naturalFrequency - dampingRate * dampingRate) : 0.;
+	propagatorTimeStep = -1.;
+}
+
+
+void Model::PropagateLinearModel(double cartAcceleration, double integrationTimeStep)
+{
+	// With a constant cart acceleration, the linearised pendulum oscillates around the equilibrium angle - ddx / g:
+	// 	x(t) = exp(-s t) * (x0 cos(wd t) + (v0 + s x0) / wd sin(wd t))
+	// 	v(t) = exp(-s t) * (v0 cos(wd t) - (w0^2 x0 + s v0) / wd sin(wd t))
+	// where x = theta - equilibrium, v = dtheta, w0 = sqrt(g/l), s = b / (2 m l^2) and wd = sqrt(w0^2 - s^2)
+	if (integrationTimeStep != propagatorTimeStep)
+	{
+		double decay = exp(- dampingRate * integrationTimeStep);
+		double c = cos(dampedFrequency * integrationTimeStep);
+		double s = sin(dampedFrequency * integrationTimeStep);
+		propagator[0][0] = decay * (c + dampingRate / dampedFrequency * s);
+		propagator[0][1] = decay * s / dampedFrequency;
+		propagator[1][0] = - decay * naturalFrequency * naturalFrequency / dampedFrequency * s;
+		propagator[1][1] = decay * (c - dampingRate / dampedFrequency * s);
+		propagatorTimeStep = integrationTimeStep;
+	}
+	double equilibriumAngle = - cartAcceleration / gravity;
+	double relativeAngle = pendulumAngle - equilibriumAngle;
+	pendulumAngle = equilibriumAngle + propagator[0][0] * relativeAngle + propagator[0][1] * pendulumVelocity;
+	pendulumVelocity = propagator[1][0] * relativeAngle + propagator[1][1] * pendulumVelocity;
+}
+
+
+void Model::IntegrateOneStep(double cartAcceleration, double integrationTimeStep, bool isCounted)
+{
+	if (smallAngleThreshold > 0. && isUnderdamped && fabs(pendulumAngle) < smallAngleThreshold)
+	{
+		PropagateLinearModel(cartAcceleration, integrationTimeStep);
+		if (isCounted)
+			nbAnalyticSteps++;
+		return;
+	}
+	if (isCounted)
+		nbNumericSteps++;
+
 	// Use Runge-Kutta to ingrate the equation of motion to give the current ball angle (theta) and angular velocity (omega)
 	// RK4 avec derivee 2nd (cf Wikipedia)
 	double k1 = ComputePendulumAcceleration(cartAcceleration, pendulumAngle, pendulumVelocity);
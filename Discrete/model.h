@@ -21,8 +21,16 @@
 
 	The force applied by the pendulum on the cart is 
 		Fb = - m l ddtheta cos(theta) + m l (dtheta)^2 * sin(theta)
+
+	For a non-circular cup (see cupProfile.h), theta is the slope angle of the cup at the ball position, l is replaced by the radius of curvature rho(theta)
+	of the cup at the ball position, and the pendulum length is the radius of curvature at the bottom of the cup rho0:
+		rho ddtheta = - ddx cos(theta) - g sin(theta) - b / (m * rho0 * rho0) * rho * dtheta - drho/dtheta * (dtheta)^2
+		Fb = - m rho ddtheta cos(theta) - m (drho/dtheta * cos(theta) - rho * sin(theta)) * (dtheta)^2
 */
 #include "math.h"
+#include "cupProfile.h"
+
+#define MODEL_HISTORY_SIZE 64 // number of past steps kept for latency compensation (0.64 s with the control loop at 10 ms)
 
 class Model
 {
@@ -38,6 +46,24 @@ class Model
 		void InitializeState(double pendulumInitialAngle, double pendulumInitialVelocity); // reset the angle/velocity/acceleration and Cartesian pos/vel for the next trial
 		// Compute acceleration and integrate (RK4) to get new pendulum state
 		void UpdatePendulumState(double cartAcceleration, double integrationTimeStep);
+		// Same as above, but the cart acceleration is a measurement which is measurementDelay seconds old (latency compensation, similar to lag compensation in networked games):
+		// the model rewinds to the state it had when the measurement was taken, substitutes the measured acceleration to the one used at that time and re-simulates forward to now
+		// If measurementDelay <= 0, this is exactly UpdatePendulumState(cartAcceleration, integrationTimeStep). In both cases, the angular acceleration (and the force on the cart)
+		// is the one at the beginning of the new step (here from the corrected state)
+		void UpdatePendulumState(double cartAcceleration, double integrationTimeStep, double measurementDelay);
+		// Small-angle fast path: while |angle| < angleThreshold (rad), the linearised damped pendulum driven by a constant cart acceleration is propagated with its exact solution
+		// (valid for any timestep, a few multiplies once the coefficients for the timestep are computed). Outside, the nonlinear model is integrated with RK4. 0 (default) disables the fast path
+		void SetSmallAngleApproximation(double angleThreshold);
+		// Number of steps computed with each path since the state was initialized (one per call to UpdatePendulumState)
+		unsigned long GetNbAnalyticSteps();
+		unsigned long GetNbNumericSteps();
+		// Use an arbitrary convex cup instead of the circular one (NULL goes back to the circular cup). The profile is not owned by the model and must stay valid while it is used
+		// The pendulum length becomes the radius of curvature at the bottom of the cup
+		void SetCupProfile(CupProfile *profile);
+		// Position of the ball (m) in the cup frame (origin at the bottom of the cup, vertical is up)
+		void GetBallPositionInCupFrame(double &horizontal, double &vertical);
+		// Same for any pendulum angle (the state is not used, so it can be called from another thread than the one which updates the model)
+		void GetBallPositionInCupFrame(double angle, double &horizontal, double &vertical);
 
 	private:
 		// This is written for the HM axis, assuming X is the depth axis, Y is the horizontal axis and Z is the vertical axis
@@ -46,6 +72,13 @@ class Model
 		void ComputePendulumCartesianVelocityInCartFrame();
 		// Compute current pendulum acceleration from the cart motion
 		double ComputePendulumAcceleration(double cartAcceleration, double pendAngle, double pendVel);
+		// Integrate (RK4) the pendulum state (angle and velocity) over one timestep with a constant cart acceleration
+		// isCounted: false for the past steps simulated again by the latency compensation (each step is counted once in the statistics of the paths)
+		void IntegrateOneStep(double cartAcceleration, double integrationTimeStep, bool isCounted = true);
+		// Exact propagation of the linearised model (only valid for small angles and an underdamped pendulum)
+		void PropagateLinearModel(double cartAcceleration, double integrationTimeStep);
+		// Compute the constants of the linearised model (depend on the pendulum length)
+		void ComputeLinearModelConstants();
 
 		double gravity;
 		double pendulumLength;
@@ -54,6 +87,29 @@ class Model
 		double pendulumAngle;
 		double pendulumVelocity;
 		double pendulumAcceleration;
+		CupProfile *cupProfile; // NULL for a circular cup
+
+		// Small-angle fast path
+		double smallAngleThreshold; // (rad)
+		bool isUnderdamped; // the closed form solution is only implemented for the underdamped case (always true without damping)
+		double naturalFrequency; // (rad/s) sqrt(g/l)
+		double dampedFrequency; // (rad/s)
+		double dampingRate; // (1/s) half of b/(m*l*l)
+		double propagatorTimeStep; // timestep for which the coefficients below were computed (the timestep is almost constant, so they are rarely recomputed)
+		double propagator[2][2]; // (angle, velocity) at t+dt = propagator * (angle, velocity) at t, relative to the equilibrium angle of the current cart acceleration
+		unsigned long nbAnalyticSteps;
+		unsigned long nbNumericSteps;
+
+		// Ring buffer of the past states and inputs (fixed size so that nothing is allocated in the control loop)
+		// Entry i is the state at time historyTime[i] and the cart acceleration which was used to integrate from there during historyTimeStep[i]
+		double modelTime; // (s) time since the state was initialized
+		double historyTime[MODEL_HISTORY_SIZE];
+		double historyAngle[MODEL_HISTORY_SIZE];
+		double historyVelocity[MODEL_HISTORY_SIZE];
+		double historyCartAcceleration[MODEL_HISTORY_SIZE];
+		double historyTimeStep[MODEL_HISTORY_SIZE];
+		int historyNewest; // index of the most recent entry
+		int historyCount; // number of valid entries
 		
 };
 
@@ -12,9 +12,11 @@
 #define TYPE_INT "int"
 #define TYPE_BOOL "bool"
 #define TYPE_DOUBLE "double"
+#define TYPE_VECTOR "vector" // list of doubles separated by commas (or semicolons), can be empty
 #define FILENAME_OUTPUT "outputFilename"
 
 int parseParamFile(const std::string filename_input, std::string &filename_output, std::vector<std::pair<std::string, std::string> > &param_name_type, std::map<std::string, int> &param_map_int, std::map<std::string, bool> &param_map_bool, std::map<std::string, double> &param_map_double);
+int parseParamFile(const std::string filename_input, std::string &filename_output, std::vector<std::pair<std::string, std::string> > &param_name_type, std::map<std::string, int> &param_map_int, std::map<std::string, bool> &param_map_bool, std::map<std::string, double> &param_map_double, std::map<std::string, std::vector<double> > &param_map_vector);
 
 
 #endif // PARSEPARAMFILE_H_INCLUDED
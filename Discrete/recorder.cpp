@@ -0,0 +1,157 @@
+#include "recorder.h"
+
+Recorder::Recorder()
+{
+	capacity = 0;
+	nbSamples = 0;
+	nbGrowths = 0;
+}
+
+Recorder::~Recorder()
+{
+}
+
+
+int Recorder::AddChannel(const std::string name, const std::string unit)
+{
+	if (channelNames.size() >= RECORDER_MAX_CHANNELS)
+	{
+		std::cout << "Too many recorded channels, " << name << " is not recorded" << std::endl;
+		return -1;
+	}
+	// The existing samples (if any) would not have a value for the new channel
+	Clear();
+	channelNames.push_back(name);
+	channelUnits.push_back(unit);
+	samples.assign(channelNames.size() * capacity, 0.);
+	return channelNames.size() - 1;
+}
+
+
+void Recorder::Reserve(unsigned int nbSamplesMax)
+{
+	if (nbSamplesMax > capacity)
+		Grow(nbSamplesMax);
+}
+
+
+void Recorder::Clear()
+{
+	nbSamples = 0;
+	nbGrowths = 0;
+}
+
+
+void Recorder::Append(const double *values)
+{
+	if (nbSamples == capacity) // should not happen if the buffer was reserved for the longest trial
+	{
+		Grow(2 * capacity + 1);
+		nbGrowths++;
+	}
+	double *sample = &samples[0] + nbSamples;
+	for (unsigned int c=0; c<channelNames.size(); c++)
+		sample[c * capacity] = values[c];
+	nbSamples++;
+}
+
+
+void Recorder::HandOver(Recorder &destination)
+{
+	if (destination.channelNames != channelNames)
+	{
+		destination.channelNames = channelNames;
+		destination.channelUnits = channelUnits;
+	}
+	samples.swap(destination.samples);
+	destination.capacity = capacity;
+	destination.nbSamples = nbSamples;
+	destination.nbGrowths = nbGrowths;
+	// The buffer received may have been used with another number of channels
+	if (channelNames.empty())
+		capacity = 0;
+	else
+		capacity = samples.size() / channelNames.size();
+	nbSamples = 0;
+	nbGrowths = 0;
+}
+
+
+void Recorder::CopyChannels(Recorder &source)
+{
+	if (source.channelNames == channelNames && source.channelUnits == channelUnits)
+		return;
+	channelNames = source.channelNames;
+	channelUnits = source.channelUnits;
+	samples.clear();
+	capacity = 0;
+	nbSamples = 0;
+	nbGrowths = 0;
+}
+
+
+void Recorder::Grow(unsigned int newCapacity)
+{
+	std::vector<double> newSamples(channelNames.size() * newCapacity, 0.);
+	for (unsigned int c=0; c<channelNames.size(); c++)
+		for (unsigned int i=0; i<nbSamples; i++)
+			newSamples[c * newCapacity + i] = samples[c * capacity + i];
+	samples.swap(newSamples);
+	capacity = newCapacity;
+}
+
+
+unsigned int Recorder::GetNbSamples()
+{
+	return nbSamples;
+}
+
+
+unsigned int Recorder::GetNbChannels()
+{
+	return channelNames.size();
+}
+
+
+unsigned int Recorder::GetCapacity()
+{
+	return capacity;
+}
+
+
+unsigned int Recorder::GetNbGrowths()
+{
+	return nbGrowths;
+}
+
+
+const double* Recorder::GetChannel(int channel)
+{
+	if (samples.empty())
+		return NULL;
+	return &samples[0] + channel * capacity;
+}
+
+
+const std::string& Recorder::GetChannelName(int channel)
+{
+	return channelNames[channel];
+}
+
+
+const std::string& Recorder::GetChannelUnit(int channel)
+{
+	return channelUnits[channel];
+}
+
+
+const std::vector<std::string>& Recorder::GetChannelNames()
+{
+	return channelNames;
+}
+
+
+const std::vector<std::string>& Recorder::GetChannelUnits()
+{
+	return channelUnits;
+}
@@ -0,0 +1,74 @@
+#ifndef SCOPE_H_INCLUDED
+#define SCOPE_H_INCLUDED
+
+/* Plots of signals of the control loop for the experimenter, in a second window */
+/*
+	At each tick, the control loop pushes one sample of the SCOPE_NB_CHANNELS channels in a ring of SCOPE_RING_SIZE samples (one writer and one reader,
+	no lock: the loop never waits for the drawing, and if the drawing is late by more than the ring, the oldest samples are lost).
+	At each frame, the display reads the new samples and reduces them into SCOPE_NB_COLUMNS columns over the last SCOPE_DURATION seconds, keeping the
+	minimum, the maximum and the last value of each channel in each column. The plot only draws the columns, so its cost does not depend on the rate of the loop,
+	and a peak which lasts a single tick (a stall of the loop, a spike of the force) is still drawn.
+	Each channel has a fixed range, extended to the values shown if they go beyond it, and optional reference lines (e.g. the nominal period, the edge of the cup).
+*/
+#include <string>
+#include <atomic>
+#include <math.h>
+#include <stdio.h>
+#include "stdlib.h" // needed otherwise conflict with glut
+#include <GL/glut.h>
+
+#define SCOPE_NB_CHANNELS 4
+#define SCOPE_RING_SIZE 8192 // samples (8 s of a 1 ms loop)
+#define SCOPE_NB_COLUMNS 600
+#define SCOPE_DURATION 5. // (s) plotted
+#define SCOPE_MAX_REFERENCES 2 // reference lines per channel
+
+class Scope
+{
+	public:
+		Scope();
+
+		// Before the loop starts: name (with its unit) and range of a channel, and its reference lines
+		void SetChannel(int channel, const std::string &name, double minimum, double maximum);
+		void AddReference(int channel, double value);
+
+		// Control loop thread: sample of all the channels at time (s). Never waits
+		void Push(double time, const double values[SCOPE_NB_CHANNELS]);
+
+		// Display thread, in the window of the scope: read the new samples and draw the channels one below the other in the whole window
+		void Draw();
+
+	private:
+		struct Sample
+		{
+			double time;
+			float values[SCOPE_NB_CHANNELS];
+		};
+		struct Column
+		{
+			long long index; // time / column duration (-1: empty)
+			float minimum[SCOPE_NB_CHANNELS], maximum[SCOPE_NB_CHANNELS], last[SCOPE_NB_CHANNELS];
+		};
+
+		void ReadSamples(); // into the columns
+		void DrawChannel(int channel, double bottom, double height, long long lastColumnIndex);
+		void DrawText(double x, double y, const std::string &text);
+
+		// Channels
+		std::string names[SCOPE_NB_CHANNELS];
+		double minimums[SCOPE_NB_CHANNELS], maximums[SCOPE_NB_CHANNELS];
+		double references[SCOPE_NB_CHANNELS][SCOPE_MAX_REFERENCES];
+		int nbReferences[SCOPE_NB_CHANNELS];
+
+		// Written by the loop
+		Sample ring[SCOPE_RING_SIZE];
+		std::atomic<unsigned int> nbPushed;
+
+		// Only used by the display
+		unsigned int nbRead;
+		unsigned int nbLost; // samples overwritten before they were read
+		double lastTime;
+		Column columns[SCOPE_NB_COLUMNS]; // circular, by column index
+};
+
+#endif // SCOPE_H_INCLUDED
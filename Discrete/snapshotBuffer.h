@@ -0,0 +1,56 @@
+#ifndef SNAPSHOTBUFFER_H_INCLUDED
+#define SNAPSHOTBUFFER_H_INCLUDED
+
+/* Snapshots of the state of the task, published by the control loop and read by the display */
+/*
+	The control loop and the display run in different threads (see loopScheduler.h). With a mutex, a tick could wait for the end of a frame.
+	Here the loop writes a copy of what the display needs (a snapshot, T must be trivially copyable) at the end of each tick, and the display reads the
+	last two snapshots to interpolate between them: neither thread ever waits for the other.
+
+	The snapshots are written in a ring of SNAPSHOT_BUFFER_SIZE slots, and the number of snapshots published is incremented after each write.
+	The reader copies the last two slots, then reads the number again: if the loop has meanwhile come back to one of the copied slots
+	(SNAPSHOT_BUFFER_SIZE - 2 snapshots published during the copy, which takes a few microseconds), the copy is done again.
+	One writer thread and one reader thread only.
+*/
+#include <atomic>
+
+#define SNAPSHOT_BUFFER_SIZE 8
+
+template <typename T> class SnapshotBuffer
+{
+	public:
+		SnapshotBuffer()
+		{
+			nbPublished = 0;
+		}
+
+		// Writer thread (control loop)
+		void Publish(const T &snapshot)
+		{
+			unsigned int index = nbPublished.load(std::memory_order_relaxed);
+			slots[index % SNAPSHOT_BUFFER_SIZE] = snapshot;
+			nbPublished.store(index + 1, std::memory_order_release);
+		}
+
+		// Reader thread (display): the last two snapshots. Return false if less than two snapshots were published
+		bool Read(T &previous, T &last)
+		{
+			while (true)
+			{
+				unsigned int index = nbPublished.load(std::memory_order_acquire);
+				if (index < 2)
+					return false;
+				previous = slots[(index - 2) % SNAPSHOT_BUFFER_SIZE];
+				last = slots[(index - 1) % SNAPSHOT_BUFFER_SIZE];
+				std::atomic_thread_fence(std::memory_order_acquire);
+				if (nbPublished.load(std::memory_order_relaxed) - index < SNAPSHOT_BUFFER_SIZE - 2)
+					return true;
+			}
+		}
+
+	private:
+		T slots[SNAPSHOT_BUFFER_SIZE];
+		std::atomic<unsigned int> nbPublished;
+};
+
+#endif // SNAPSHOTBUFFER_H_INCLUDED
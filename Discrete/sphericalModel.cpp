@@ -0,0 +1,153 @@
+#include "sphericalModel.h"
+
+SphericalModel::SphericalModel(double massOfPendulum, double lengthOfPendulum, double dampingInPendulum, double pendulumInitialAngle, double pendulumInitialVelocity, double gravityMagnitude)
+{
+	gravity = gravityMagnitude;
+	pendulumMass = massOfPendulum;
+	pendulumLength = lengthOfPendulum;
+	pendulumDamping = dampingInPendulum;
+
+	InitializeState(pendulumInitialAngle, pendulumInitialVelocity);
+}
+
+SphericalModel::~SphericalModel()
+{
+	// Do nothing, no dynamic memory allocation
+}
+
+
+void SphericalModel::InitializeState(double pendulumInitialAngle, double pendulumInitialVelocity)
+{
+	pendulumDirection[0] = sin(pendulumInitialAngle);
+	pendulumDirection[1] = 0.;
+	pendulumDirection[2] = - cos(pendulumInitialAngle);
+	pendulumDirectionVelocity[0] = cos(pendulumInitialAngle) * pendulumInitialVelocity;
+	pendulumDirectionVelocity[1] = 0.;
+	pendulumDirectionVelocity[2] = sin(pendulumInitialAngle) * pendulumInitialVelocity;
+	for (int i=0; i<3; i++)
+		pendulumDirectionAcceleration[i] = 0.;
+	cartAcceleration[0] = 0.;
+	cartAcceleration[1] = 0.;
+}
+
+
+void SphericalModel::ComputeDirectionAcceleration(const double direction[3], const double directionVel[3], double directionAcc[3])
+{
+	// External acceleration (gravity - cart acceleration) projected on the plane tangent to the sphere
+	double external[3];
+	external[0] = - cartAcceleration[0] / pendulumLength;
+	external[1] = - cartAcceleration[1] / pendulumLength;
+	external[2] = - gravity / pendulumLength;
+	double radialExternal = external[0] * direction[0] + external[1] * direction[1] + external[2] * direction[2];
+	double squaredVelocity = directionVel[0] * directionVel[0] + directionVel[1] * directionVel[1] + directionVel[2] * directionVel[2];
+	double dampingFactor = pendulumDamping / (pendulumMass * pendulumLength * pendulumLength);
+	for (int i=0; i<3; i++)
+		directionAcc[i] = external[i] - radialExternal * direction[i] - squaredVelocity * direction[i] - dampingFactor * directionVel[i];
+}
+
+
+void SphericalModel::UpdatePendulumState(double cartAccelerationAlongMotion, double cartAccelerationAcrossMotion, double integrationTimeStep)
+{
+	cartAcceleration[0] = cartAccelerationAlongMotion;
+	cartAcceleration[1] = cartAccelerationAcrossMotion;
+
+	// RK4 on the state (u, du)
+	double h = integrationTimeStep;
+	double u2[3], u3[3], u4[3], v2[3], v3[3], v4[3];
+	double k1[3], k2[3], k3[3], k4[3]; // accelerations
+	ComputeDirectionAcceleration(pendulumDirection, pendulumDirectionVelocity, k1);
+	for (int i=0; i<3; i++)
+	{
+		u2[i] = pendulumDirection[i] + 0.5 * h * pendulumDirectionVelocity[i];
+		v2[i] = pendulumDirectionVelocity[i] + 0.5 * h * k1[i];
+	}
+	ComputeDirectionAcceleration(u2, v2, k2);
+	for (int i=0; i<3; i++)
+	{
+		u3[i] = pendulumDirection[i] + 0.5 * h * v2[i];
+		v3[i] = pendulumDirectionVelocity[i] + 0.5 * h * k2[i];
+	}
+	ComputeDirectionAcceleration(u3, v3, k3);
+	for (int i=0; i<3; i++)
+	{
+		u4[i] = pendulumDirection[i] + h * v3[i];
+		v4[i] = pendulumDirectionVelocity[i] + h * k3[i];
+	}
+	ComputeDirectionAcceleration(u4, v4, k4);
+	for (int i=0; i<3; i++)
+	{
+		pendulumDirection[i] += h / 6.0 * (pendulumDirectionVelocity[i] + 2*v2[i] + 2*v3[i] + v4[i]);
+		pendulumDirectionVelocity[i] += h / 6.0 * (k1[i] + 2*k2[i] + 2*k3[i] + k4[i]);
+	}
+
+	// Project back on the constraints: |u| = 1 and du orthogonal to u
+	double norm = sqrt(pendulumDirection[0] * pendulumDirection[0] + pendulumDirection[1] * pendulumDirection[1] + pendulumDirection[2] * pendulumDirection[2]);
+	for (int i=0; i<3; i++)
+		pendulumDirection[i] /= norm;
+	double radialVelocity = pendulumDirection[0] * pendulumDirectionVelocity[0] + pendulumDirection[1] * pendulumDirectionVelocity[1] + pendulumDirection[2] * pendulumDirectionVelocity[2];
+	for (int i=0; i<3; i++)
+		pendulumDirectionVelocity[i] -= radialVelocity * pendulumDirection[i];
+
+	// Acceleration in the new state (used for the force on the cart)
+	ComputeDirectionAcceleration(pendulumDirection, pendulumDirectionVelocity, pendulumDirectionAcceleration);
+}
+
+
+void SphericalModel::ComputePendulumForceOnCart(double &forceAlongMotion, double &forceAcrossMotion)
+{
+	forceAlongMotion = - pendulumMass * pendulumLength * pendulumDirectionAcceleration[0];
+	forceAcrossMotion = - pendulumMass * pendulumLength * pendulumDirectionAcceleration[1];
+}
+
+
+double SphericalModel::GetPendulumAngle()
+{
+	double cosAngle = - pendulumDirection[2];
+	if (cosAngle > 1.)
+		cosAngle = 1.;
+	else if (cosAngle < -1.)
+		cosAngle = -1.;
+	return acos(cosAngle);
+}
+
+
+double SphericalModel::GetPendulumAngularVelocity()
+{
+	// d(angle)/dt = d|u_horizontal|/dt / cos(angle), and |du| when the ball is exactly at the bottom (the direction of the motion is then the direction of du)
+	double horizontalNorm = sqrt(pendulumDirection[0] * pendulumDirection[0] + pendulumDirection[1] * pendulumDirection[1]);
+	if (horizontalNorm < 1e-9)
+		return sqrt(pendulumDirectionVelocity[0] * pendulumDirectionVelocity[0] + pendulumDirectionVelocity[1] * pendulumDirectionVelocity[1] + pendulumDirectionVelocity[2] * pendulumDirectionVelocity[2]);
+	return (pendulumDirection[0] * pendulumDirectionVelocity[0] + pendulumDirection[1] * pendulumDirectionVelocity[1]) / (horizontalNorm * (- pendulumDirection[2]));
+}
+
+
+double SphericalModel::GetPendulumAngularAcceleration()
+{
+	// With -cos(angle) = u2: sin(angle) dangle = du2 and sin(angle) ddangle = ddu2 - cos(angle) dangle^2 (at the bottom, the horizontal acceleration is returned instead)
+	double sinAngle = sqrt(pendulumDirection[0] * pendulumDirection[0] + pendulumDirection[1] * pendulumDirection[1]);
+	if (sinAngle < 1e-6)
+		return sqrt(pendulumDirectionAcceleration[0] * pendulumDirectionAcceleration[0] + pendulumDirectionAcceleration[1] * pendulumDirectionAcceleration[1]);
+	double angularVelocity = GetPendulumAngularVelocity();
+	return (pendulumDirectionAcceleration[2] - (- pendulumDirection[2]) * angularVelocity * angularVelocity) / sinAngle;
+}
+
+
+double SphericalModel::GetPendulumAzimuth()
+{
+	return atan2(pendulumDirection[1], pendulumDirection[0]);
+}
+
+
+void SphericalModel::GetBallPositionInCupFrame(double position[3])
+{
+	position[0] = pendulumLength * pendulumDirection[0];
+	position[1] = pendulumLength * pendulumDirection[1];
+	position[2] = pendulumLength * (1. + pendulumDirection[2]);
+}
+
+
+void SphericalModel::GetBallVelocityInCupFrame(double velocity[3])
+{
+	for (int i=0; i<3; i++)
+		velocity[i] = pendulumLength * pendulumDirectionVelocity[i];
+}
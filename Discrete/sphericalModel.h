@@ -0,0 +1,57 @@
+#ifndef SPHERICALMODEL_H_INCLUDED
+#define SPHERICALMODEL_H_INCLUDED
+
+/* Define the mathematical model of the 3D cart-pendulum model (spherical pendulum on a cart moving in the horizontal plane) which is used as a model for the ball in a 2D cup */
+/* Same approximation as the 2D cart-pendulum model (see model.h): the ball only slides in the cup (circular cup of radius l), without friction */
+/*
+	The state of the pendulum is the unit vector u from the pivot to the ball (u = (0, 0, -1) when the ball is at the bottom of the cup) and its time derivative du.
+	This avoids the singularity of the spherical angles at the bottom of the cup, which is where the ball spends most of the time.
+	The equation of motion of the damped spherical pendulum on a cart of horizontal acceleration ddx = (ddx0, ddx1, 0) is:
+		ddu = (I - u u^T) (G - ddx) / l - |du|^2 u - b / (m * l * l) * du
+	where G = (0, 0, -g). After each integration step, u is normalized and du is projected on the plane tangent to the sphere, so that the integration error does not
+	accumulate in the constraints. For a motion in the plane (u0, u2), this is exactly the equation of the 2D model with u = (sin(theta), 0, -cos(theta)).
+
+	The force applied by the pendulum on the cart is the opposite of the horizontal part of the force needed to accelerate the ball relative to the cart:
+		Fb = - m l ddu (horizontal components)
+
+	Axes: 0 and 1 are the horizontal axes (0 is the main axis of motion of the task, 1 is the other horizontal axis), 2 is the vertical axis (up)
+	Everything is stored in fixed size arrays: nothing is allocated after construction, so that the model can be used in the control loop
+*/
+#include "math.h"
+
+class SphericalModel
+{
+	public:
+		SphericalModel(double massOfPendulum, double lengthOfPendulum, double dampingInPendulum, double pendulumInitialAngle, double pendulumInitialVelocity, double gravityMagnitude = 9.81);
+
+		~SphericalModel();
+
+		// Initial state in the vertical plane of the main axis of motion (same parameters as the 2D model)
+		void InitializeState(double pendulumInitialAngle, double pendulumInitialVelocity);
+		// Compute acceleration and integrate (RK4) to get new pendulum state
+		void UpdatePendulumState(double cartAccelerationAlongMotion, double cartAccelerationAcrossMotion, double integrationTimeStep);
+		// Horizontal force applied by the pendulum on the cart (assume pendulum state is up to date)
+		void ComputePendulumForceOnCart(double &forceAlongMotion, double &forceAcrossMotion);
+		double GetPendulumAngle(); // (rad) angle between the pendulum and the vertical (>= 0, compared to half the arc of the cup to detect the escape)
+		double GetPendulumAngularVelocity(); // (rad/s) time derivative of the above
+		double GetPendulumAngularAcceleration(); // (rad/s/s) second time derivative of the angle
+		double GetPendulumAzimuth(); // (rad) direction of the ball in the horizontal plane (0 along the main axis of motion)
+		// Position (m) and velocity (m/s) of the ball relative to the cup, in the cup frame (origin at the bottom of the cup, axis 2 is up)
+		void GetBallPositionInCupFrame(double position[3]);
+		void GetBallVelocityInCupFrame(double velocity[3]);
+
+	private:
+		// Acceleration of the unit vector for a given state (the result is written in directionAcc)
+		void ComputeDirectionAcceleration(const double direction[3], const double directionVel[3], double directionAcc[3]);
+
+		double gravity;
+		double pendulumLength;
+		double pendulumMass;
+		double pendulumDamping;
+		double cartAcceleration[2]; // horizontal cart acceleration used for the current step
+		double pendulumDirection[3]; // unit vector from the pivot to the ball
+		double pendulumDirectionVelocity[3];
+		double pendulumDirectionAcceleration[3];
+};
+
+#endif // SPHERICALMODEL_H_INCLUDED
@@ -0,0 +1,521 @@
+#include "trialFile.h"
+
+TrialHeader::TrialHeader()
+{
+	nbHeaderLines = 0.;
+	nbParameters = 0;
+}
+
+TrialHeader::~TrialHeader()
+{
+}
+
+
+void TrialHeader::Clear(const std::string &nameOfTask, double nbLines)
+{
+	taskName = nameOfTask;
+	nbHeaderLines = nbLines;
+	nbParameters = 0;
+}
+
+
+void TrialHeader::Swap(TrialHeader &other)
+{
+	taskName.swap(other.taskName);
+	std::swap(nbHeaderLines, other.nbHeaderLines);
+	parameters.swap(other.parameters);
+	std::swap(nbParameters, other.nbParameters);
+}
+
+
+TrialParameter& TrialHeader::AddParameter(const std::string &name, int type, const std::string &unit)
+{
+	if (nbParameters == parameters.size())
+		parameters.push_back(TrialParameter());
+	TrialParameter &parameter = parameters[nbParameters];
+	nbParameters++;
+	parameter.name = name;
+	parameter.unit = unit;
+	parameter.type = type;
+	parameter.value = 0.;
+	parameter.intValue = 0;
+	parameter.values.clear();
+	return parameter;
+}
+
+
+void TrialHeader::AddDouble(const std::string &name, double value, const std::string &unit)
+{
+	AddParameter(name, PARAMETER_DOUBLE, unit).value = value;
+}
+
+
+void TrialHeader::AddInt(const std::string &name, __int64 value, const std::string &unit)
+{
+	AddParameter(name, PARAMETER_INT, unit).intValue = value;
+}
+
+
+void TrialHeader::AddBool(const std::string &name, bool value, const std::string &unit)
+{
+	AddParameter(name, PARAMETER_BOOL, unit).intValue = value ? 1 : 0;
+}
+
+
+void TrialHeader::AddVector(const std::string &name, const std::vector<double> &values, const std::string &unit)
+{
+	AddParameter(name, PARAMETER_VECTOR, unit).values = values;
+}
+
+
+void TrialHeader::AddNotAvailable(const std::string &name, const std::string &unit)
+{
+	AddParameter(name, PARAMETER_NONE, unit);
+}
+
+
+int WriteTrialCsv(std::ostream &file, const TrialHeader &header, const std::vector<std::string> &channelNames, const std::vector<std::string> &channelUnits, const double * const *channels, unsigned int nbSamples, CsvEmitter &emitter)
+{
+	if (WriteTrialCsvHeader(file, header, channelNames, channelUnits) != 0)
+		return -1;
+	return WriteTrialCsvSamples(file, channels, channelNames.size(), nbSamples, emitter);
+}
+
+
+int WriteTrialCsvHeader(std::ostream &file, const TrialHeader &header, const std::vector<std::string> &channelNames, const std::vector<std::string> &channelUnits)
+{
+	// Parameters (lines end with "\n" and not std::endl, which would flush the file at each line)
+	file << header.taskName << ";" << header.nbHeaderLines << "\n";
+	for (unsigned int p=0; p<header.nbParameters; p++)
+	{
+		const TrialParameter &parameter = header.parameters[p];
+		file << parameter.name << ";";
+		if (parameter.type == PARAMETER_DOUBLE)
+			file << parameter.value;
+		else if (parameter.type == PARAMETER_INT || parameter.type == PARAMETER_BOOL)
+			file << parameter.intValue;
+		else if (parameter.type == PARAMETER_VECTOR && !parameter.values.empty())
+		{
+			for (unsigned int i=0; i<parameter.values.size(); i++)
+				file << ((i > 0) ? "," : "") << parameter.values[i];
+		}
+		else
+			file << "N/A";
+		file << ";" << parameter.unit << "\n";
+	}
+
+	// Names and units of the channels
+	unsigned int nbChannels = channelNames.size();
+	for (unsigned int c=0; c<nbChannels; c++)
+		file << ((c > 0) ? ";" : "") << channelNames[c];
+	file << "\n";
+	for (unsigned int c=0; c<nbChannels; c++)
+		file << ((c > 0) ? ";" : "") << channelUnits[c];
+	file << "\n";
+
+	if (file.fail())
+		return -1;
+	return 0;
+}
+
+
+int WriteTrialCsvSamples(std::ostream &file, const double * const *channels, unsigned int nbChannels, unsigned int nbSamples, CsvEmitter &emitter)
+{
+	return emitter.WriteSamples(file, channels, nbChannels, nbSamples);
+}
+
+
+void AppendBytes(std::string &buffer, const void *source, size_t nbBytes)
+{
+	buffer.append((const char*)source, nbBytes);
+}
+
+
+void AppendString(std::string &buffer, const std::string &text)
+{
+	unsigned int length = text.size();
+	AppendBytes(buffer, &length, sizeof(unsigned int));
+	buffer.append(text);
+}
+
+
+void AppendParameter(std::string &buffer, const TrialParameter &parameter)
+{
+	AppendString(buffer, parameter.name);
+	AppendString(buffer, parameter.unit);
+	unsigned char type = parameter.type;
+	AppendBytes(buffer, &type, sizeof(unsigned char));
+	if (parameter.type == PARAMETER_DOUBLE)
+		AppendBytes(buffer, &parameter.value, sizeof(double));
+	else if (parameter.type == PARAMETER_INT)
+		AppendBytes(buffer, &parameter.intValue, sizeof(__int64));
+	else if (parameter.type == PARAMETER_BOOL)
+	{
+		unsigned char value = (parameter.intValue != 0);
+		AppendBytes(buffer, &value, sizeof(unsigned char));
+	}
+	else if (parameter.type == PARAMETER_VECTOR)
+	{
+		unsigned int nbValues = parameter.values.size();
+		AppendBytes(buffer, &nbValues, sizeof(unsigned int));
+		if (nbValues > 0)
+			AppendBytes(buffer, &parameter.values[0], nbValues * sizeof(double));
+	}
+}
+
+
+bool IsSameParameter(const TrialParameter &parameter1, const TrialParameter &parameter2)
+{
+	if (parameter1.name != parameter2.name || parameter1.unit != parameter2.unit || parameter1.type != parameter2.type)
+		return false;
+	if (parameter1.type == PARAMETER_DOUBLE)
+		return memcmp(&parameter1.value, &parameter2.value, sizeof(double)) == 0; // bitwise, so that the value written is exactly the same
+	if (parameter1.type == PARAMETER_INT || parameter1.type == PARAMETER_BOOL)
+		return parameter1.intValue == parameter2.intValue;
+	if (parameter1.type == PARAMETER_VECTOR)
+		return parameter1.values.size() == parameter2.values.size() && (parameter1.values.empty() || memcmp(&parameter1.values[0], &parameter2.values[0], parameter1.values.size() * sizeof(double)) == 0);
+	return true;
+}
+
+
+bool ReadBytes(const char *data, unsigned __int64 dataSize, unsigned __int64 &position, void *destination, size_t nbBytes)
+{
+	if (position > dataSize || nbBytes > dataSize - position)
+		return false;
+	memcpy(destination, data + position, nbBytes);
+	position += nbBytes;
+	return true;
+}
+
+
+bool ReadString(const char *data, unsigned __int64 dataSize, unsigned __int64 &position, std::string &text)
+{
+	unsigned int length;
+	if (!ReadBytes(data, dataSize, position, &length, sizeof(unsigned int)) || length > dataSize - position)
+		return false;
+	text.assign(data + position, length);
+	position += length;
+	return true;
+}
+
+
+bool ReadParameter(const char *data, unsigned __int64 dataSize, unsigned __int64 &position, TrialParameter &parameter)
+{
+	unsigned char type = PARAMETER_NONE;
+	parameter.value = 0.;
+	parameter.intValue = 0;
+	parameter.values.clear();
+	if (!ReadString(data, dataSize, position, parameter.name) || !ReadString(data, dataSize, position, parameter.unit) || !ReadBytes(data, dataSize, position, &type, sizeof(unsigned char)))
+		return false;
+	parameter.type = type;
+	if (type == PARAMETER_DOUBLE)
+		return ReadBytes(data, dataSize, position, &parameter.value, sizeof(double));
+	if (type == PARAMETER_INT)
+		return ReadBytes(data, dataSize, position, &parameter.intValue, sizeof(__int64));
+	if (type == PARAMETER_BOOL)
+	{
+		unsigned char value;
+		if (!ReadBytes(data, dataSize, position, &value, sizeof(unsigned char)))
+			return false;
+		parameter.intValue = value;
+		return true;
+	}
+	if (type == PARAMETER_VECTOR)
+	{
+		unsigned int nbValues;
+		if (!ReadBytes(data, dataSize, position, &nbValues, sizeof(unsigned int)) || nbValues > (dataSize - position) / sizeof(double))
+			return false;
+		parameter.values.resize(nbValues);
+		return nbValues == 0 || ReadBytes(data, dataSize, position, &parameter.values[0], nbValues * sizeof(double));
+	}
+	return type == PARAMETER_NONE;
+}
+
+
+int WriteTrialBinary(std::ostream &file, const TrialHeader &header, const std::vector<std::string> &channelNames, const std::vector<std::string> &channelUnits, const double * const *channels, unsigned int nbSamples)
+{
+	if (WriteTrialBinaryHeader(file, header, channelNames, channelUnits, nbSamples) != 0)
+		return -1;
+
+	// Columns
+	for (unsigned int c=0; c<channelNames.size(); c++)
+		if (nbSamples > 0)
+			file.write((const char*)channels[c], nbSamples * sizeof(double));
+
+	if (file.fail())
+		return -1;
+	return 0;
+}
+
+
+int WriteTrialCompressed(std::ostream &file, const TrialHeader &header, const std::vector<std::string> &channelNames, const std::vector<std::string> &channelUnits, const double * const *channels, unsigned int nbSamples, ColumnEncoder &encoder, std::string &column)
+{
+	if (WriteTrialBinaryHeader(file, header, channelNames, channelUnits, nbSamples, true) != 0)
+		return -1;
+	for (unsigned int c=0; c<channelNames.size(); c++)
+	{
+		column.clear();
+		encoder.Begin(column);
+		encoder.Append(channels[c], nbSamples);
+		encoder.End();
+		if (WriteTrialCompressedColumn(file, column) != 0)
+			return -1;
+	}
+	return 0;
+}
+
+
+int WriteTrialCompressedColumn(std::ostream &file, const std::string &column)
+{
+	unsigned __int64 nbBytes = column.size();
+	file.write((const char*)&nbBytes, sizeof(unsigned __int64));
+	file.write(column.data(), column.size());
+	if (file.fail())
+		return -1;
+	return 0;
+}
+
+
+int WriteTrialBinaryHeader(std::ostream &file, const TrialHeader &header, const std::vector<std::string> &channelNames, const std::vector<std::string> &channelUnits, unsigned int nbSamples, bool isCompressed)
+{
+	unsigned int nbChannels = channelNames.size();
+
+	// Metadata (built in memory first, to know where the columns start)
+	std::string metadata;
+	AppendBytes(metadata, &header.nbHeaderLines, sizeof(double));
+	AppendString(metadata, header.taskName);
+	for (unsigned int p=0; p<header.nbParameters; p++)
+		AppendParameter(metadata, header.parameters[p]);
+	for (unsigned int c=0; c<nbChannels; c++)
+	{
+		AppendString(metadata, channelNames[c]);
+		AppendString(metadata, channelUnits[c]);
+	}
+
+	// Fixed size part (40 bytes), then metadata and padding so that the columns are aligned on 8 bytes
+	char magic[8] = {'C', 'U', 'P', 'T', 'R', 'I', 'A', 'L'};
+	if (isCompressed)
+		magic[7] = 'C';
+	unsigned int version = TRIAL_FILE_VERSION;
+	unsigned int nbParameters = header.nbParameters;
+	unsigned __int64 dataOffset = 8 + 4 * sizeof(unsigned int) + sizeof(unsigned __int64) + metadata.size();
+	dataOffset = (dataOffset + 7) / 8 * 8;
+	file.write(magic, 8);
+	file.write((const char*)&version, sizeof(unsigned int));
+	file.write((const char*)&nbParameters, sizeof(unsigned int));
+	file.write((const char*)&nbChannels, sizeof(unsigned int));
+	file.write((const char*)&nbSamples, sizeof(unsigned int));
+	file.write((const char*)&dataOffset, sizeof(unsigned __int64));
+	file.write(metadata.data(), metadata.size());
+	char padding[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+	file.write(padding, dataOffset - (8 + 4 * sizeof(unsigned int) + sizeof(unsigned __int64) + metadata.size()));
+
+	if (file.fail())
+		return -1;
+	return 0;
+}
+
+
+MappedFile::MappedFile()
+{
+	fileHandle = INVALID_HANDLE_VALUE;
+	mappingHandle = NULL;
+	fileView = NULL;
+	fileSize = 0;
+}
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+
+int MappedFile::Open(const std::string filename)
+{
+	Close();
+	fileHandle = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (fileHandle == INVALID_HANDLE_VALUE)
+	{
+		std::cout << "Error: cannot open " << filename << std::endl;
+		return -1;
+	}
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(fileHandle, &size) || size.QuadPart == 0)
+	{
+		std::cout << "Error: " << filename << " is empty" << std::endl;
+		Close();
+		return -1;
+	}
+	fileSize = size.QuadPart;
+	mappingHandle = CreateFileMappingA(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mappingHandle != NULL)
+		fileView = (const char*)MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+	if (fileView == NULL)
+	{
+		std::cout << "Error: cannot map " << filename << " in memory" << std::endl;
+		Close();
+		return -1;
+	}
+	return 0;
+}
+
+
+void MappedFile::Close()
+{
+	if (fileView != NULL)
+		UnmapViewOfFile(fileView);
+	if (mappingHandle != NULL)
+		CloseHandle(mappingHandle);
+	if (fileHandle != INVALID_HANDLE_VALUE)
+		CloseHandle(fileHandle);
+	fileView = NULL;
+	mappingHandle = NULL;
+	fileHandle = INVALID_HANDLE_VALUE;
+	fileSize = 0;
+}
+
+
+const char* MappedFile::GetData()
+{
+	return fileView;
+}
+
+
+unsigned __int64 MappedFile::GetSize()
+{
+	return fileSize;
+}
+
+
+TrialFileReader::TrialFileReader()
+{
+	nbSamples = 0;
+}
+
+TrialFileReader::~TrialFileReader()
+{
+	Close();
+}
+
+
+int TrialFileReader::Open(const std::string filename)
+{
+	Close();
+	if (file.Open(filename) != 0)
+		return -1;
+	const char *data = file.GetData();
+	unsigned __int64 dataSize = file.GetSize();
+	unsigned __int64 position = 0;
+
+	// Fixed size part
+	char magic[8];
+	unsigned int version, nbParameters, nbChannels;
+	unsigned __int64 dataOffset;
+	bool isValid = ReadBytes(data, dataSize, position, magic, 8) && ReadBytes(data, dataSize, position, &version, sizeof(unsigned int)) && ReadBytes(data, dataSize, position, &nbParameters, sizeof(unsigned int)) &&
+		ReadBytes(data, dataSize, position, &nbChannels, sizeof(unsigned int)) && ReadBytes(data, dataSize, position, &nbSamples, sizeof(unsigned int)) && ReadBytes(data, dataSize, position, &dataOffset, sizeof(unsigned __int64));
+	bool isCompressed = (std::string(magic, 8) == "CUPTRIAC");
+	if (!isValid || (std::string(magic, 8) != "CUPTRIAL" && !isCompressed) || version != TRIAL_FILE_VERSION)
+	{
+		std::cout << "Error: " << filename << " is not a trial file (or was written by another version of the program)" << std::endl;
+		Close();
+		return -1;
+	}
+	if (dataOffset % 8 != 0 || dataOffset > dataSize || (!isCompressed && (dataSize - dataOffset) / sizeof(double) / (nbChannels > 0 ? nbChannels : 1) < nbSamples))
+	{
+		std::cout << "Error: " << filename << " is truncated" << std::endl;
+		Close();
+		return -1;
+	}
+
+	// Metadata
+	isValid = ReadBytes(data, dataSize, position, &header.nbHeaderLines, sizeof(double)) && ReadString(data, dataSize, position, header.taskName);
+	header.parameters.assign(nbParameters, TrialParameter());
+	header.nbParameters = nbParameters;
+	for (unsigned int p=0; p<nbParameters && isValid; p++)
+		isValid = ReadParameter(data, dataSize, position, header.parameters[p]);
+	channelNames.assign(nbChannels, "");
+	channelUnits.assign(nbChannels, "");
+	for (unsigned int c=0; c<nbChannels && isValid; c++)
+		isValid = ReadString(data, dataSize, position, channelNames[c]) && ReadString(data, dataSize, position, channelUnits[c]);
+	if (!isValid || position > dataOffset)
+	{
+		std::cout << "Error: " << filename << " has invalid parameters" << std::endl;
+		Close();
+		return -1;
+	}
+
+	// Compressed columns: decompressed one after the other
+	channels.resize(nbChannels);
+	if (isCompressed)
+	{
+		decompressedSamples.resize((size_t)nbChannels * nbSamples);
+		position = dataOffset;
+		for (unsigned int c=0; c<nbChannels && isValid; c++)
+		{
+			unsigned __int64 nbBytes;
+			isValid = ReadBytes(data, dataSize, position, &nbBytes, sizeof(unsigned __int64)) && nbBytes <= dataSize - position;
+			if (isValid)
+			{
+				double *column = decompressedSamples.empty() ? NULL : &decompressedSamples[0] + (size_t)c * nbSamples;
+				decoder.Begin(data + position, nbBytes);
+				double extraValue;
+				isValid = (decoder.Decode(column, nbSamples) == (int)nbSamples && decoder.Decode(&extraValue, 1) == 0);
+				position += nbBytes;
+				channels[c] = column;
+			}
+		}
+		if (!isValid)
+		{
+			std::cout << "Error: " << filename << " has invalid compressed data (or is truncated)" << std::endl;
+			Close();
+			return -1;
+		}
+		return 0;
+	}
+
+	// The columns are used in place (the view starts on a page boundary, so they are aligned)
+	for (unsigned int c=0; c<nbChannels; c++)
+		channels[c] = (const double*)(data + dataOffset) + (unsigned __int64)c * nbSamples;
+	return 0;
+}
+
+
+void TrialFileReader::Close()
+{
+	file.Close();
+	nbSamples = 0;
+	channels.clear();
+	decompressedSamples.clear();
+}
+
+
+const TrialHeader& TrialFileReader::GetHeader()
+{
+	return header;
+}
+
+
+const std::vector<std::string>& TrialFileReader::GetChannelNames()
+{
+	return channelNames;
+}
+
+
+const std::vector<std::string>& TrialFileReader::GetChannelUnits()
+{
+	return channelUnits;
+}
+
+
+unsigned int TrialFileReader::GetNbSamples()
+{
+	return nbSamples;
+}
+
+
+const double* const* TrialFileReader::GetChannels()
+{
+	if (channels.empty())
+		return NULL;
+	return &channels[0];
+}
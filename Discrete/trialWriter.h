@@ -0,0 +1,113 @@
+#ifndef TRIALWRITER_H_INCLUDED
+#define TRIALWRITER_H_INCLUDED
+
+/* Writing of the data files in a background thread */
+/*
+	Opening a file and formatting thousands of samples takes much longer than one period of the control loop. To avoid freezing the HapticMaster
+	(the subject is still holding the handle at the end of a trial), the display only formats the short header and hands the recorded samples over
+	to the writer (no copy, see Recorder::HandOver). The files are then written one after the other by a background thread, in CSV or binary format (see trialFile.h),
+	in a MAT-file (see matFile.h), or appended to the file of the block (see blockFile.h).
+	The queue is bounded: if it is full (the disk is much slower than the trials), Submit does not wait and the display submits the trial again at the next ticks.
+	Write errors are stored and can be polled by the display with GetFailedTrial.
+
+	Long trials can also be recorded in chunks of a fixed number of samples, so that the memory used does not depend on the duration of the trial:
+	each full chunk is handed over with SubmitChunk during the motion and appended by the thread to a temporary file (filename.part, raw columns of each chunk).
+	When the trial is submitted, the last samples are appended too and the data file is written from the temporary file, one chunk at a time
+	(the file is identical to the file written from a single recording), then the temporary file is deleted.
+
+	With a journal (see journal.h), the thread first appends all the trials and chunks waiting in the queue to the journal and makes them durable at once,
+	before writing the data files. The trials of the journals of interrupted runs are written again when the journal of the next run is opened.
+*/
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <cstdio>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "recorder.h"
+#include "trialFile.h"
+#include "blockFile.h"
+#include "matFile.h"
+#include "journal.h"
+
+#define TRIAL_WRITER_QUEUE_SIZE 4 // maximal number of trials waiting to be written
+
+class TrialWriter
+{
+	public:
+		TrialWriter();
+		~TrialWriter(); // wait until all the queued trials are written
+
+		// Queue a trial file (format is TRIAL_FILE_CSV, TRIAL_FILE_CSV_EXACT, TRIAL_FILE_BINARY, TRIAL_FILE_COMPRESSED, TRIAL_FILE_MAT or TRIAL_FILE_BLOCK, in which case filename is the block file): the parameters of the trial, then the channels of recorder. The samples of
+		// recorder and the parameters of header are handed over to the writer (both get back the memory of an older trial, which can be reused for the next trial). Never waits: return false if the queue is full,
+		// in which case nothing is queued and recorder and header keep their contents, the trial must be submitted again later
+		bool Submit(int trialNb, const std::string &filename, int format, TrialHeader &header, Recorder &recorder);
+		// Recording in chunks: before the block (the control loop is not running yet), wait until the queue is empty and give every slot a buffer of chunkNbSamples
+		// samples with the channels of recorder, so that the buffers exchanged by SubmitChunk during the motion do not need to grow
+		void PrepareChunks(Recorder &recorder, unsigned int chunkNbSamples);
+		// Before the block (real-time mode, see realTime.h): give every slot a buffer of nbSamples samples with the channels of recorder, so that the buffers
+		// exchanged by Submit and SubmitChunk are all allocated and touched before the first trial
+		void Reserve(Recorder &recorder, unsigned int nbSamples);
+		// Queue the samples of recorder (handed over as in Submit) to be appended to the temporary file of the trial. Never waits: return false if the queue is full,
+		// in which case recorder keeps its samples (and grows) until the next call. The trial is then submitted as usual with Submit (the last samples)
+		bool SubmitChunk(int trialNb, const std::string &filename, Recorder &recorder);
+		// Return the number of a trial whose file could not be written (and forget it), or -1 if no error happened since the last call
+		int GetFailedTrial();
+		unsigned int GetNbPendingTrials(); // number of trials queued or being written
+		// Wait until all the queued trials are written
+		void Flush();
+		// Journal the trials from now on in filename (must be called before the first trial is submitted). The trials left in the journals of directory
+		// (ending with the separator) by previous runs which were interrupted are written first, and these journals are deleted (a journal which cannot be
+		// read or recovered is kept). Return the number of recovered trials, or -1 if the journal cannot be opened (the trials are then not journaled)
+		int OpenJournal(const std::string &directory, const std::string &filename);
+		// Writer thread (to keep it off the CPU of the control loop)
+		HANDLE GetThreadHandle();
+
+	private:
+		struct TrialFile
+		{
+			bool isChunk; // samples of the temporary file of the trial (format and header are not used)
+			int trialNb;
+			std::string filename;
+			int format;
+			TrialHeader header;
+			Recorder data;
+		};
+
+		void Run(); // writer thread
+		int WriteTrial(TrialFile &trialFile);
+		int WriteChunk(TrialFile &trialFile);
+		int WriteTrialFromChunks(TrialFile &trialFile);
+		bool ReadChunk(unsigned int chunk, unsigned int firstChannel, unsigned int nbChannels); // columns of a chunk of the temporary file, in chunkBuffer
+		void CloseChunks(); // and delete the temporary file
+		int RecoverJournal(const std::string &filename); // write the trials of the journal which are not written. Return their number, or -1 if the journal cannot be read or a trial written
+		void JournalQueue(std::unique_lock<std::mutex> &lock); // append the queued trials and chunks which are not in the journal yet, and commit
+
+		TrialFile queue[TRIAL_WRITER_QUEUE_SIZE]; // circular buffer, a slot is released once its file is written
+		unsigned int firstTrialFile;
+		unsigned int nbTrialFiles;
+		std::vector<int> failedTrials;
+		BlockFileWriter blockFile; // only used by the writer thread
+		CsvEmitter csvEmitter; // only used by the writer thread
+		ColumnEncoder columnEncoder; // only used by the writer thread
+		std::string compressedColumn;
+		// Temporary file of the trial recorded in chunks (only used by the writer thread)
+		std::fstream chunkFile;
+		std::string chunkFilename;
+		int chunkTrialNb;
+		bool isChunkFileValid; // false if a chunk could not be written
+		unsigned int chunkNbGrowths;
+		std::vector<unsigned __int64> chunkOffsets;
+		std::vector<unsigned int> chunkSizes;
+		std::vector<double> chunkBuffer;
+		TrialJournal journal; // only used by the writer thread once opened
+		unsigned int nbJournaledTrialFiles; // first trial files of the queue which are already in the journal
+		bool isStopping;
+		std::mutex queueMutex;
+		std::condition_variable queueChanged;
+		std::thread writerThread;
+};
+
+#endif // TRIALWRITER_H_INCLUDED
@@ -0,0 +1,247 @@
+#include "viability.h"
+#include "model.h"
+#include <thread>
+
+ViabilityTable::ViabilityTable()
+{
+	nbAngles = 0;
+	nbVelocities = 0;
+	nbAccelerations = 0;
+	maxHorizon = 0;
+	angleMin = 0.;
+	angleMax = 0.;
+	angleStep = 1.;
+	velocityMin = 0.;
+	velocityMax = 0.;
+	velocityStep = 1.;
+	maxCartAcceleration = 0.;
+	timeStep = 0.;
+	gravity = 0.;
+	pendulumMass = 0.;
+	pendulumLength = 0.;
+	pendulumDamping = 0.;
+	arcOfCup = 0.;
+}
+
+ViabilityTable::~ViabilityTable()
+{
+}
+
+
+void ViabilityTable::Compute(double massOfPendulum, double lengthOfPendulum, double dampingInPendulum, double arcCup, double gravityMagnitude, double maxCartAccelerationInModel, int nbAnglesInGrid, int nbVelocitiesInGrid, int nbAccelerationsInGrid, double integrationTimeStep, int nbThreads)
+{
+	pendulumMass = massOfPendulum;
+	pendulumLength = lengthOfPendulum;
+	pendulumDamping = dampingInPendulum;
+	arcOfCup = arcCup;
+	gravity = gravityMagnitude;
+	maxCartAcceleration = fabs(maxCartAccelerationInModel);
+	timeStep = integrationTimeStep;
+	nbAngles = nbAnglesInGrid;
+	nbVelocities = nbVelocitiesInGrid;
+	nbAccelerations = (nbAccelerationsInGrid < 2) ? 2 : nbAccelerationsInGrid; // at least the two extreme accelerations
+	maxHorizon = VIABLE_CELL - 1;
+
+	// The angle grid covers exactly the cup. The velocity grid covers the velocity the ball would reach if it was released from the cup edge and pushed by the maximal acceleration all the way down (a viable state cannot be much faster than that)
+	angleMin = - arcOfCup / 2.;
+	angleMax = arcOfCup / 2.;
+	velocityMax = 2. * sqrt(2. * (gravity + maxCartAcceleration) / pendulumLength * (1. - cos(arcOfCup / 2.)) + maxCartAcceleration / pendulumLength * arcOfCup);
+	velocityMin = - velocityMax;
+	angleStep = (angleMax - angleMin) / (nbAngles - 1);
+	velocityStep = (velocityMax - velocityMin) / (nbVelocities - 1);
+
+	// At the beginning, every state inside the cup is viable
+	std::vector<unsigned char> previousCells(nbAngles * nbVelocities, VIABLE_CELL);
+	std::vector<unsigned char> nextCells(previousCells);
+
+	if (nbThreads <= 0)
+		nbThreads = std::thread::hardware_concurrency();
+	if (nbThreads <= 0)
+		nbThreads = 1;
+
+	for (unsigned int iteration=1; iteration <= maxHorizon; iteration++)
+	{
+		std::vector<std::thread> threads;
+		std::vector<int> nbChanges(nbThreads, 0);
+		int nbRowsPerThread = (nbAngles + nbThreads - 1) / nbThreads;
+		for (int t=0; t<nbThreads; t++)
+		{
+			int firstAngle = t * nbRowsPerThread;
+			int lastAngle = (firstAngle + nbRowsPerThread > (int)nbAngles) ? nbAngles : firstAngle + nbRowsPerThread;
+			if (firstAngle < lastAngle)
+				threads.push_back(std::thread(&ViabilityTable::ComputeRows, this, firstAngle, lastAngle, iteration, &previousCells, &nextCells, &nbChanges[t]));
+		}
+		int nbChangesInIteration = 0;
+		for (unsigned int t=0; t<threads.size(); t++)
+		{
+			threads[t].join();
+			nbChangesInIteration += nbChanges[t];
+		}
+		previousCells = nextCells;
+		std::cout << "Iteration " << iteration << ": " << nbChangesInIteration << " cells lost" << std::endl;
+		if (nbChangesInIteration == 0) // the kernel is found
+			break;
+	}
+	cells = previousCells;
+}
+
+
+void ViabilityTable::ComputeRows(int firstAngle, int lastAngle, int iteration, const std::vector<unsigned char> *previousCells, std::vector<unsigned char> *nextCells, int *nbChanges)
+{
+	// Each thread needs its own model since the model stores the state
+	Model model(pendulumMass, pendulumLength, pendulumDamping, 0., 0., gravity);
+	for (int i=firstAngle; i<lastAngle; i++)
+	{
+		double angle = angleMin + i * angleStep;
+		for (unsigned int j=0; j<nbVelocities; j++)
+		{
+			if ((*previousCells)[i * nbVelocities + j] != VIABLE_CELL) // already lost
+				continue;
+			double angularVelocity = velocityMin + j * velocityStep;
+			bool isViable = false;
+			for (unsigned int k=0; k<nbAccelerations && !isViable; k++)
+			{
+				double cartAcceleration = - maxCartAcceleration + k * 2. * maxCartAcceleration / (nbAccelerations - 1);
+				model.InitializeState(angle, angularVelocity);
+				model.UpdatePendulumState(cartAcceleration, timeStep);
+				double nextAngle = model.GetPendulumAngle();
+				double nextVelocity = model.GetPendulumAngularVelocity();
+				if (fabs(nextAngle) > arcOfCup / 2.) // ball escaped
+					continue;
+				int iNext = (int)floor((nextAngle - angleMin) / angleStep + 0.5);
+				int jNext = (int)floor((nextVelocity - velocityMin) / velocityStep + 0.5);
+				if (iNext >= 0 && iNext < (int)nbAngles && jNext >= 0 && jNext < (int)nbVelocities && (*previousCells)[iNext * nbVelocities + jNext] == VIABLE_CELL)
+					isViable = true;
+			}
+			if (!isViable)
+			{
+				(*nextCells)[i * nbVelocities + j] = (unsigned char)(iteration - 1); // number of timeSteps the ball can still stay in the cup
+				(*nbChanges)++;
+			}
+		}
+	}
+}
+
+
+int ViabilityTable::Save(const std::string filename)
+{
+	std::ofstream file(filename.c_str(), std::ios::binary);
+	if (!file)
+	{
+		std::cout << "Error on viability table file opening" << std::endl;
+		return -1;
+	}
+	file.write("CUPVIAB1", 8);
+	file.write((const char*)&nbAngles, sizeof(unsigned int));
+	file.write((const char*)&nbVelocities, sizeof(unsigned int));
+	file.write((const char*)&nbAccelerations, sizeof(unsigned int));
+	file.write((const char*)&maxHorizon, sizeof(unsigned int));
+	file.write((const char*)&angleMin, sizeof(double));
+	file.write((const char*)&angleMax, sizeof(double));
+	file.write((const char*)&velocityMin, sizeof(double));
+	file.write((const char*)&velocityMax, sizeof(double));
+	file.write((const char*)&maxCartAcceleration, sizeof(double));
+	file.write((const char*)&timeStep, sizeof(double));
+	file.write((const char*)&gravity, sizeof(double));
+	file.write((const char*)&pendulumMass, sizeof(double));
+	file.write((const char*)&pendulumLength, sizeof(double));
+	file.write((const char*)&pendulumDamping, sizeof(double));
+	file.write((const char*)&arcOfCup, sizeof(double));
+	file.write((const char*)&cells[0], cells.size());
+	return 0;
+}
+
+
+int ViabilityTable::Load(const std::string filename)
+{
+	char magic[8];
+	std::ifstream file(filename.c_str(), std::ios::binary);
+	if (!file)
+	{
+		std::cout << "No viability table found (" << filename << "), escape risk is not computed" << std::endl;
+		return -1;
+	}
+	file.read(magic, 8);
+	if (!file || std::string(magic, 8) != "CUPVIAB1")
+	{
+		std::cout << "Error: " << filename << " is not a viability table" << std::endl;
+		return -1;
+	}
+	file.read((char*)&nbAngles, sizeof(unsigned int));
+	file.read((char*)&nbVelocities, sizeof(unsigned int));
+	file.read((char*)&nbAccelerations, sizeof(unsigned int));
+	file.read((char*)&maxHorizon, sizeof(unsigned int));
+	file.read((char*)&angleMin, sizeof(double));
+	file.read((char*)&angleMax, sizeof(double));
+	file.read((char*)&velocityMin, sizeof(double));
+	file.read((char*)&velocityMax, sizeof(double));
+	file.read((char*)&maxCartAcceleration, sizeof(double));
+	file.read((char*)&timeStep, sizeof(double));
+	file.read((char*)&gravity, sizeof(double));
+	file.read((char*)&pendulumMass, sizeof(double));
+	file.read((char*)&pendulumLength, sizeof(double));
+	file.read((char*)&pendulumDamping, sizeof(double));
+	file.read((char*)&arcOfCup, sizeof(double));
+	if (!file || nbAngles < 2 || nbVelocities < 2 || maxHorizon == 0)
+	{
+		std::cout << "Error: viability table header is corrupted" << std::endl;
+		return -1;
+	}
+	cells.resize(nbAngles * nbVelocities);
+	file.read((char*)&cells[0], cells.size());
+	if (!file)
+	{
+		std::cout << "Error: viability table is truncated" << std::endl;
+		cells.clear();
+		return -1;
+	}
+	angleStep = (angleMax - angleMin) / (nbAngles - 1);
+	velocityStep = (velocityMax - velocityMin) / (nbVelocities - 1);
+	return 0;
+}
+
+
+bool ViabilityTable::IsCompatible(double massOfPendulum, double lengthOfPendulum, double dampingInPendulum, double arcCup, double gravityMagnitude, double maxCartAccelerationInModel, double integrationTimeStep)
+{
+	double tolerance = 1e-6;
+	return fabs(pendulumMass - massOfPendulum) <= tolerance * fabs(massOfPendulum) && fabs(pendulumLength - lengthOfPendulum) <= tolerance * fabs(lengthOfPendulum) &&
+		fabs(pendulumDamping - dampingInPendulum) <= tolerance * (1. + fabs(dampingInPendulum)) && fabs(arcOfCup - arcCup) <= tolerance * fabs(arcCup) &&
+		fabs(gravity - gravityMagnitude) <= tolerance * fabs(gravityMagnitude) &&
+		fabs(maxCartAcceleration - fabs(maxCartAccelerationInModel)) <= tolerance * fabs(maxCartAccelerationInModel) && fabs(timeStep - integrationTimeStep) <= tolerance * fabs(integrationTimeStep);
+}
+
+
+unsigned char ViabilityTable::GetCell(double angle, double angularVelocity)
+{
+	if (cells.empty())
+		return VIABLE_CELL; // no table: no risk information
+	int i = (int)floor((angle - angleMin) / angleStep + 0.5);
+	int j = (int)floor((angularVelocity - velocityMin) / velocityStep + 0.5);
+	if (i < 0 || i >= (int)nbAngles || j < 0 || j >= (int)nbVelocities)
+		return 0;
+	return cells[i * nbVelocities + j];
+}
+
+
+bool ViabilityTable::IsViable(double angle, double angularVelocity)
+{
+	return GetCell(angle, angularVelocity) == VIABLE_CELL;
+}
+
+
+double ViabilityTable::GetEscapeRisk(double angle, double angularVelocity)
+{
+	unsigned char cell = GetCell(angle, angularVelocity);
+	if (cell == VIABLE_CELL)
+		return 0.;
+	return 1. - (1. * cell) / maxHorizon;
+}
+
+
+double ViabilityTable::GetTimeBeforeEscape(double angle, double angularVelocity)
+{
+	unsigned char cell = GetCell(angle, angularVelocity);
+	if (cell == VIABLE_CELL)
+		return -1.;
+	return cell * timeStep;
+}
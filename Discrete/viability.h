@@ -0,0 +1,70 @@
+#ifndef VIABILITY_H_INCLUDED
+#define VIABILITY_H_INCLUDED
+
+/* Precomputed viability (escape-risk) table of the cart-pendulum model */
+/*
+	A state (angle, angular velocity) of the pendulum is viable if there exists a cart acceleration, bounded by maxCartAcceleration,
+	which keeps the ball inside the cup (|angle| <= arcCup/2) for ever.
+	The viability kernel is computed offline (see GenerateViabilityTable.cpp) on a regular grid of angle and angular velocity:
+		- at the first iteration, all the cells inside the cup are viable
+		- at iteration k, a cell stays viable if at least one of the (discretized) bounded cart accelerations brings it, after one timeStep,
+		  in a cell which was still viable at iteration k-1
+	Each cell stores the number of iterations it survived, i.e. the number of timeSteps before the ball escapes whatever the user does with the cart,
+	or VIABLE_CELL if it is still viable when the iteration stops.
+	The table is loaded once at startup and the current state is looked up at each tick in O(1) (no simulation in the control loop).
+
+	File format (binary, little endian):
+		char[8] magic ("CUPVIAB1"), unsigned int nbAngles, nbVelocities, nbAccelerations, maxHorizon
+		double angleMin, angleMax, velocityMin, velocityMax, maxCartAcceleration, timeStep, gravity, pendulumMass, pendulumLength, pendulumDamping, arcCup
+		unsigned char cells[nbAngles * nbVelocities] (cell of angle i and velocity j is at index i * nbVelocities + j)
+*/
+#include <string>
+#include <vector>
+#include <iostream>
+#include <fstream>
+#include "math.h"
+
+#define VIABLE_CELL 255
+
+class ViabilityTable
+{
+	public:
+		ViabilityTable();
+		~ViabilityTable();
+
+		// Offline computation of the table (parallelized over the angle dimension, nbThreads <= 0 means use all the cores)
+		void Compute(double massOfPendulum, double lengthOfPendulum, double dampingInPendulum, double arcCup, double gravityMagnitude, double maxCartAccelerationInModel, int nbAnglesInGrid, int nbVelocitiesInGrid, int nbAccelerationsInGrid, double integrationTimeStep, int nbThreads = 0);
+		int Save(const std::string filename);
+		int Load(const std::string filename);
+		// Whether the table was computed with the same parameters as the current block: cart-pendulum, bound on the cart acceleration seen by the model (amplified)
+		// and time step (period of the control loop). Otherwise the risk and the time before escape would be meaningless
+		bool IsCompatible(double massOfPendulum, double lengthOfPendulum, double dampingInPendulum, double arcCup, double gravityMagnitude, double maxCartAccelerationInModel, double integrationTimeStep);
+
+		// O(1) lookups used in the control loop
+		bool IsViable(double angle, double angularVelocity);
+		double GetEscapeRisk(double angle, double angularVelocity); // 0 if the state is viable, otherwise grows up to 1 when the escape cannot be delayed anymore
+		double GetTimeBeforeEscape(double angle, double angularVelocity); // (s) minimal time before the ball escapes whatever the cart does (-1 if the state is viable)
+
+	private:
+		// Return the cell value (number of timeSteps survived) of the grid node closest to the given state. States outside of the grid are considered as lost (0)
+		unsigned char GetCell(double angle, double angularVelocity);
+		// One iteration of the kernel computation for the rows [firstAngle, lastAngle[ (called in parallel by Compute)
+		void ComputeRows(int firstAngle, int lastAngle, int iteration, const std::vector<unsigned char> *previousCells, std::vector<unsigned char> *nextCells, int *nbChanges);
+
+		unsigned int nbAngles;
+		unsigned int nbVelocities;
+		unsigned int nbAccelerations;
+		unsigned int maxHorizon; // maximal number of iterations (must be < VIABLE_CELL)
+		double angleMin, angleMax, angleStep;
+		double velocityMin, velocityMax, velocityStep;
+		double maxCartAcceleration; // (m/s/s) bound on the cart acceleration seen by the model (i.e. already amplified)
+		double timeStep;
+		double gravity;
+		double pendulumMass;
+		double pendulumLength;
+		double pendulumDamping;
+		double arcOfCup;
+		std::vector<unsigned char> cells;
+};
+
+#endif // VIABILITY_H_INCLUDED
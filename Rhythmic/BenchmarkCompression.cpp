@@ -0,0 +1,121 @@
+#include <windows.h>
+#include <iostream>
+#include <sstream>
+#include <cstdlib>
+#include <cmath>
+#include <string.h>
+#include "recorder.h"
+#include "trialFile.h"
+#include "columnCodec.h"
+#include "loopScheduler.h"
+
+// Benchmark of the compression of the recorded channels (separate executable, not part of the experiment program)
+// Usage: BenchmarkCompression [trial file (.bin or .cbin)] [number of repetitions]
+// For each channel of the trial (by default a simulated 20 s rhythmic trial with the channels of the experiment program), prints the compressed size and the
+// compression and decompression throughputs (MB of doubles per second), and checks that the decompressed values are exactly the recorded ones.
+// The sizes of the whole trial in CSV, binary and compressed binary are printed at the end
+
+// Simulated rhythmic trial: oscillation of the cart at about 1 Hz with the ball swinging in the cup, one sample per loop period
+void SimulateTrial(Recorder &recorder)
+{
+	const char *names[11] = {"Time", "Pendulum_Angle", "Pendulum_AngularVel", "Pendulum_AngularAcc", "Cart_Pos_X", "Cart_Vel_X", "Cart_Acc_X", "Ball_Force", "User_Force_X", "User_Force_Y", "User_Force_Z"};
+	for (int c=0; c<11; c++)
+		recorder.AddChannel(names[c], "");
+	double durationOfOneTrial = 20.; // (s) as in param.txt
+	double loopPeriod = CONTROL_LOOP_PERIOD / 1000.; // (s) period of the control loop
+	unsigned int nbSamples = (unsigned int)(durationOfOneTrial / loopPeriod) + 1;
+	recorder.Reserve(nbSamples);
+	double omega = 2. * 3.1415926 * 1.1;
+	for (unsigned int i=0; i<nbSamples; i++)
+	{
+		double t = i * (loopPeriod + 0.0003 * sin(0.7 * i)); // the real loop period is not constant
+		double sample[11] = {t, 0.3 * sin(omega * t + 0.5), 0.3 * omega * cos(omega * t + 0.5), -0.3 * omega * omega * sin(omega * t + 0.5),
+			0.15 * sin(omega * t), 0.15 * omega * cos(omega * t), -0.15 * omega * omega * sin(omega * t), 1.7 * sin(omega * t + 0.2),
+			2.1 * sin(omega * t - 0.1), 0.05 * cos(3. * t), -0.4 + 0.02 * sin(5. * t)};
+		recorder.Append(sample);
+	}
+}
+
+
+int main(int argc, char** argv)
+{
+	int nbRepetitions = 200;
+	Recorder recorder;
+	TrialFileReader reader;
+	std::vector<std::string> names;
+	std::vector<const double*> channels;
+	unsigned int nbSamples;
+	if (argc > 1)
+	{
+		if (reader.Open(argv[1]) != 0)
+			return -1;
+		names = reader.GetChannelNames();
+		nbSamples = reader.GetNbSamples();
+		for (unsigned int c=0; c<names.size(); c++)
+			channels.push_back(reader.GetChannels()[c]);
+		std::cout << argv[1] << ": " << nbSamples << " samples" << std::endl;
+	}
+	else
+	{
+		SimulateTrial(recorder);
+		names = recorder.GetChannelNames();
+		nbSamples = recorder.GetNbSamples();
+		for (unsigned int c=0; c<names.size(); c++)
+			channels.push_back(recorder.GetChannel(c));
+		std::cout << "Simulated 20 s rhythmic trial: " << nbSamples << " samples" << std::endl;
+	}
+	if (argc > 2)
+		nbRepetitions = atoi(argv[2]);
+	unsigned __int64 timerFrequency, startStamp, endStamp;
+	QueryPerformanceFrequency((LARGE_INTEGER*)&timerFrequency);
+
+	ColumnEncoder encoder;
+	ColumnDecoder decoder;
+	std::string column;
+	std::vector<double> decoded(nbSamples + 1);
+	unsigned __int64 totalCompressedSize = 0;
+	double rawMegabytes = nbSamples * sizeof(double) / 1e6;
+	for (unsigned int c=0; c<names.size(); c++)
+	{
+		QueryPerformanceCounter((LARGE_INTEGER*)&startStamp);
+		for (int r=0; r<nbRepetitions; r++)
+		{
+			column.clear();
+			encoder.Begin(column);
+			encoder.Append(channels[c], nbSamples);
+			encoder.End();
+		}
+		QueryPerformanceCounter((LARGE_INTEGER*)&endStamp);
+		double compressionTime = (1. * (endStamp - startStamp)) / timerFrequency / nbRepetitions;
+
+		// Decompression as in a streaming reader, a few hundred values at a time
+		bool isExact = true;
+		QueryPerformanceCounter((LARGE_INTEGER*)&startStamp);
+		for (int r=0; r<nbRepetitions; r++)
+		{
+			decoder.Begin(column.data(), column.size());
+			unsigned int nbDecoded = 0;
+			int nbValues;
+			while ((nbValues = decoder.Decode(&decoded[nbDecoded], (nbSamples + 1 - nbDecoded < 256) ? nbSamples + 1 - nbDecoded : 256)) > 0)
+				nbDecoded += nbValues;
+			if (nbValues < 0 || nbDecoded != nbSamples)
+				isExact = false;
+		}
+		QueryPerformanceCounter((LARGE_INTEGER*)&endStamp);
+		double decompressionTime = (1. * (endStamp - startStamp)) / timerFrequency / nbRepetitions;
+		if (nbSamples > 0 && memcmp(&decoded[0], channels[c], nbSamples * sizeof(double)) != 0)
+			isExact = false;
+
+		totalCompressedSize += sizeof(unsigned __int64) + column.size();
+		std::cout << names[c] << ": " << column.size() << " bytes (" << (column.empty() ? 0. : 1. * nbSamples * sizeof(double) / column.size()) << " times smaller), compression "
+			<< rawMegabytes / compressionTime << " MB/s, decompression " << rawMegabytes / decompressionTime << " MB/s" << (isExact ? "" : " ERROR: not the recorded values") << std::endl;
+	}
+
+	// Whole trial (the samples only, the parameters take the same place in all the formats)
+	CsvEmitter emitter;
+	std::ostringstream csvText;
+	emitter.WriteSamples(csvText, channels.empty() ? NULL : &channels[0], names.size(), nbSamples);
+	std::cout << "Samples of the trial: " << csvText.str().size() << " bytes in CSV, " << (unsigned __int64)names.size() * nbSamples * sizeof(double) << " bytes in binary, "
+		<< totalCompressedSize << " bytes in compressed binary" << std::endl;
+	return 0;
+}
@@ -0,0 +1,96 @@
+#include <windows.h>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+#include <cstdio>
+#include <cmath>
+#include "recorder.h"
+#include "csvEmitter.h"
+#include "loopScheduler.h"
+
+// Benchmark of the formatting of the samples in the CSV data files (separate executable, not part of the experiment program)
+// Usage: BenchmarkCsv [number of trials]
+// Writes the samples of a 20 s rhythmic trial (same channels as the experiment program, one sample per loop period) in BenchmarkCsv.csv, with operator<< as the
+// data files were written before, then with the CSV emitter in strict and shortest modes, and prints the number of lines written per second for each.
+// Also checks that the strict mode writes exactly the same text as operator<<
+
+// Samples written one value at a time with operator<< (the previous writer, kept as the reference)
+void WriteWithStream(std::ostream &file, const double * const *channels, unsigned int nbChannels, unsigned int nbSamples)
+{
+	for (unsigned int i=0; i<nbSamples; i++)
+	{
+		file << channels[0][i];
+		for (unsigned int c=1; c<nbChannels; c++)
+			file << ";" << channels[c][i];
+		file << std::endl;
+	}
+}
+
+
+int main(int argc, char** argv)
+{
+	int nbTrials = 200;
+	if (argc > 1)
+		nbTrials = atoi(argv[1]);
+	double durationOfOneTrial = 20.; // (s) as in param.txt
+	double loopPeriod = CONTROL_LOOP_PERIOD / 1000.; // (s) period of the control loop
+	unsigned int nbSamples = (unsigned int)(durationOfOneTrial / loopPeriod) + 1;
+	unsigned __int64 timerFrequency, startStamp, endStamp;
+	QueryPerformanceFrequency((LARGE_INTEGER*)&timerFrequency);
+
+	// Rhythmic trial: oscillation of the cart at about 1 Hz with the ball swinging in the cup
+	const char *names[11] = {"Time", "Pendulum_Angle", "Pendulum_AngularVel", "Pendulum_AngularAcc", "Cart_Pos_X", "Cart_Vel_X", "Cart_Acc_X", "Ball_Force", "User_Force_X", "User_Force_Y", "User_Force_Z"};
+	Recorder recorder;
+	for (int c=0; c<11; c++)
+		recorder.AddChannel(names[c], "");
+	recorder.Reserve(nbSamples);
+	double omega = 2. * 3.1415926 * 1.1;
+	for (unsigned int i=0; i<nbSamples; i++)
+	{
+		double t = i * (loopPeriod + 0.0003 * sin(0.7 * i)); // the real loop period is not constant
+		double sample[11] = {t, 0.3 * sin(omega * t + 0.5), 0.3 * omega * cos(omega * t + 0.5), -0.3 * omega * omega * sin(omega * t + 0.5),
+			0.15 * sin(omega * t), 0.15 * omega * cos(omega * t), -0.15 * omega * omega * sin(omega * t), 1.7 * sin(omega * t + 0.2),
+			2.1 * sin(omega * t - 0.1), 0.05 * cos(3. * t), -0.4 + 0.02 * sin(5. * t)};
+		recorder.Append(sample);
+	}
+	const double *channels[11];
+	for (int c=0; c<11; c++)
+		channels[c] = recorder.GetChannel(c);
+
+	// The strict mode must not change the existing files
+	CsvEmitter emitter(CSV_EMITTER_STRICT);
+	std::ostringstream streamText, emitterText;
+	WriteWithStream(streamText, channels, 11, nbSamples);
+	emitter.WriteSamples(emitterText, channels, 11, nbSamples);
+	if (streamText.str() != emitterText.str())
+		std::cout << "Error: the strict mode does not write the same text as operator<<" << std::endl;
+	else
+		std::cout << "Strict mode: same text as operator<< (" << nbSamples << " lines per trial)" << std::endl;
+
+	const char *methods[3] = {"operator<< and std::endl", "emitter, strict (6 digits)", "emitter, shortest round trip"};
+	for (int m=0; m<3; m++)
+	{
+		std::ofstream file("BenchmarkCsv.csv"); // text mode, as the data files
+		if (!file)
+		{
+			std::cout << "Error on file opening: BenchmarkCsv.csv" << std::endl;
+			return -1;
+		}
+		emitter.SetMode((m == 2) ? CSV_EMITTER_SHORTEST : CSV_EMITTER_STRICT);
+		QueryPerformanceCounter((LARGE_INTEGER*)&startStamp);
+		for (int trial=0; trial<nbTrials; trial++)
+		{
+			if (m == 0)
+				WriteWithStream(file, channels, 11, nbSamples);
+			else
+				emitter.WriteSamples(file, channels, 11, nbSamples);
+		}
+		file.close();
+		QueryPerformanceCounter((LARGE_INTEGER*)&endStamp);
+		double totalTime = (1. * (endStamp - startStamp)) / timerFrequency;
+		std::cout << methods[m] << ": " << (double)nbTrials * nbSamples / totalTime << " lines per second (" << 1e3 * totalTime / nbTrials << " ms per trial)" << std::endl;
+	}
+	remove("BenchmarkCsv.csv");
+	return 0;
+}
@@ -0,0 +1,111 @@
+#include "trialFile.h"
+#include "blockFile.h"
+#include "matFile.h"
+
+// Converter of the binary trial files and block files into CSV files (separate executable, not part of the experiment program)
+// Usage: ConvertTrialFile [-exact | -mat] file1.bin [file2.blk ...]
+// Each file.bin (or compressed file.cbin) is converted into file.csv, and each block file name.blk into one name_trial_<n>.csv file per trial. The CSV files are identical to the files
+// the experiment program writes when outputFormat = 0, so that the existing scripts (csv2mat.m...) can be used
+// With -exact, the values are written with all their digits, as with outputFormat = 3 (see csvEmitter.h)
+// With -mat, the files are converted into the .mat files written with outputFormat = 5 instead (see matFile.h)
+
+// Write one CSV file from a reader (TrialFileReader or BlockFileReader with a selected trial)
+template <class Reader>
+int ConvertToCsv(Reader &reader, const std::string csv_filename, CsvEmitter &emitter)
+{
+	std::ofstream csv_file(csv_filename.c_str()); // text mode, as in the experiment program (same end of lines)
+	if (!csv_file || WriteTrialCsv(csv_file, reader.GetHeader(), reader.GetChannelNames(), reader.GetChannelUnits(), reader.GetChannels(), reader.GetNbSamples(), emitter) != 0)
+	{
+		std::cout << "Error on file opening: " << csv_filename << std::endl;
+		return -1;
+	}
+	std::cout << " -> " << csv_filename << " (" << reader.GetNbSamples() << " samples)" << std::endl;
+	return 0;
+}
+
+
+// Write one MAT-file from a reader
+template <class Reader>
+int ConvertToMat(Reader &reader, const std::string mat_filename)
+{
+	std::ofstream mat_file(mat_filename.c_str(), std::ios::binary);
+	if (!mat_file || WriteTrialMat(mat_file, reader.GetHeader(), reader.GetChannelNames(), reader.GetChannelUnits(), reader.GetChannels(), reader.GetNbSamples()) != 0)
+	{
+		std::cout << "Error on file opening: " << mat_filename << std::endl;
+		return -1;
+	}
+	std::cout << " -> " << mat_filename << " (" << reader.GetNbSamples() << " samples)" << std::endl;
+	return 0;
+}
+
+
+template <class Reader>
+int Convert(Reader &reader, const std::string base_filename, CsvEmitter &emitter, bool isMat)
+{
+	if (isMat)
+		return ConvertToMat(reader, base_filename + ".mat");
+	return ConvertToCsv(reader, base_filename + ".csv", emitter);
+}
+
+
+int main(int argc, char** argv)
+{
+	CsvEmitter emitter(CSV_EMITTER_STRICT);
+	bool isMat = false;
+	int firstFile = 1;
+	if (argc > 1 && std::string(argv[1]) == "-exact")
+	{
+		emitter.SetMode(CSV_EMITTER_SHORTEST);
+		firstFile = 2;
+	}
+	else if (argc > 1 && std::string(argv[1]) == "-mat")
+	{
+		isMat = true;
+		firstFile = 2;
+	}
+	if (argc <= firstFile)
+	{
+		std::cout << "Usage: ConvertTrialFile [-exact | -mat] file1.bin [file2.blk ...]" << std::endl;
+		return -1;
+	}
+
+	int nbErrors = 0;
+	TrialFileReader trialReader;
+	BlockFileReader blockReader;
+	for (int i=firstFile; i<argc; i++)
+	{
+		std::string input_filename = argv[i];
+		std::string base_filename = input_filename;
+		size_t extension = base_filename.rfind('.');
+		if (extension != std::string::npos && base_filename.find_first_of("/\\", extension) == std::string::npos)
+			base_filename.erase(extension);
+		bool isBlockFile = (input_filename.size() > 4 && input_filename.compare(input_filename.size() - 4, 4, ".blk") == 0);
+
+		std::cout << input_filename << std::endl;
+		if (!isBlockFile)
+		{
+			if (trialReader.Open(input_filename) != 0 || Convert(trialReader, base_filename, emitter, isMat) != 0)
+				nbErrors++;
+			trialReader.Close();
+			continue;
+		}
+
+		// Block file: same file names as the trial files of the block
+		if (blockReader.Open(input_filename) != 0)
+		{
+			nbErrors++;
+			continue;
+		}
+		for (unsigned int t=0; t<blockReader.GetNbTrials(); t++)
+		{
+			char nbTrialChar[12];
+			sprintf_s(nbTrialChar, "%d", blockReader.GetTrialNumber(t));
+			if (blockReader.SelectTrial(t) != 0 || Convert(blockReader, base_filename + "_trial_" + (std::string)nbTrialChar, emitter, isMat) != 0)
+				nbErrors++;
+		}
+		blockReader.Close();
+	}
+	if (nbErrors > 0)
+		return -1;
+	return 0;
+}
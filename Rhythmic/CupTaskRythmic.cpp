@@ -6,7 +6,7 @@ Display* pDisplay; // needs to be global because of GLUT functions
 
 int main(int argc, char** argv)
 {
-	int mainLoopPeriod = 10; // (ms) The real timestep cannot go below 16ms (and the real timestep is used for model integration), so this parameter does not really matter (except if you set a very long timeStep, you will see it graphically)
+	int mainLoopPeriod = CONTROL_LOOP_PERIOD; // (ms) period of the control loop, kept at fixed deadlines by the scheduler (see loopScheduler.h). The real timestep is still measured and used for model integration
 	int mainLoopTimerID = 1;
 	std::string output_filename = "Default"; // Name of file where results are written. Name is modified when reading parameters file
 	
@@ -16,6 +16,7 @@ int main(int argc, char** argv)
 	std::map<std::string, int> param_map_int;
 	std::map<std::string, bool> param_map_bool;
 	std::map<std::string, double> param_map_double;
+	std::map<std::string, std::vector<double> > param_map_vector;
 	
 	// Fill in vectors with the parameters that should be read in the param file
 	param_name_type.push_back(std::pair<std::string, std::string>("nbTrials", TYPE_INT));					// number of trials in one block	
@@ -33,6 +34,7 @@ int main(int argc, char** argv)
 	param_name_type.push_back(std::pair<std::string, std::string>("startToTargetDistance", TYPE_DOUBLE));  	// (m)
 	param_name_type.push_back(std::pair<std::string, std::string>("accuracyFactor", TYPE_DOUBLE));			// (%) ratio between the size of the target and the size of the cup (must be >1). Target is reached when the cup stops entirely inside target block
 	param_name_type.push_back(std::pair<std::string, std::string>("accelerationAmplification", TYPE_DOUBLE)); // amplify the acceleration of the cart in the model (compared to the ral acceleration of the HM)
+	param_name_type.push_back(std::pair<std::string, std::string>("maxCartAcceleration", TYPE_DOUBLE));		// (m/s/s) maximal acceleration the subject can give to the HM, to check the escape-risk table
 	param_name_type.push_back(std::pair<std::string, std::string>("inertiaHM", TYPE_DOUBLE));				// of the HM (related to cart + pendulum mass)
 	param_name_type.push_back(std::pair<std::string, std::string>("arcCup", TYPE_DOUBLE));					// (degres for simplicity) length of the arc representing the cup. The cup is symetric wrt verical axis. The shape of the cup is defined both by arcCup (portion of full circle) and by pendulumLength (curvature)
 	param_name_type.push_back(std::pair<std::string, std::string>("pendulumMass", TYPE_DOUBLE));				// (kg)
@@ -40,15 +42,30 @@ int main(int argc, char** argv)
 	param_name_type.push_back(std::pair<std::string, std::string>("pendulumDamping", TYPE_DOUBLE));			// (N.m.s)
 	param_name_type.push_back(std::pair<std::string, std::string>("pendulumInitialAngle", TYPE_DOUBLE));		// (degree for simplicity)
 	param_name_type.push_back(std::pair<std::string, std::string>("pendulumInitialVelocity", TYPE_DOUBLE));	// (degree/s)
+	param_name_type.push_back(std::pair<std::string, std::string>("cupProfile", TYPE_VECTOR));				// (m) knots x0,z0,x1,z1,... of the half profile of a non-circular cup (empty: circular cup defined by arcCup and pendulumLength)
+	param_name_type.push_back(std::pair<std::string, std::string>("outputFormat", TYPE_INT));				// 0: csv, 1: binary, 2: one file per block, 3: csv with all the digits, 4: compressed binary, 5: MATLAB .mat
+	param_name_type.push_back(std::pair<std::string, std::string>("recordingChunkDuration", TYPE_DOUBLE));	// (s) the trials are written to disk in chunks of this duration during the motion (0: whole trial in memory)
+	param_name_type.push_back(std::pair<std::string, std::string>("auxiliaryChannelDecimation", TYPE_INT));	// 0: only the channels of the task, N: also the 3D motion, commanded force and spring states of the HM every N ticks
+	param_name_type.push_back(std::pair<std::string, std::string>("loopOverrunPolicy", TYPE_INT));			// 0: the deadlines missed by a late tick of the control loop are skipped, 1: the missed ticks are run at once
+	param_name_type.push_back(std::pair<std::string, std::string>("loopTimeBudget", TYPE_DOUBLE));			// (s) ticks of the control loop longer than this are counted (trial files and timing file of the block)
+	param_name_type.push_back(std::pair<std::string, std::string>("realTimePriority", TYPE_INT));			// 0: normal, 1: high priority, 2: real-time priority (administrator), with the memory of the program locked
+	param_name_type.push_back(std::pair<std::string, std::string>("realTimeCpu", TYPE_INT));				// CPU the control loop is pinned to in real-time mode (-1: any)
+	param_name_type.push_back(std::pair<std::string, std::string>("displayPredictionHorizon", TYPE_DOUBLE));	// (s) furthest the cup and ball are predicted to when the frame is seen (0: no prediction)
+	param_name_type.push_back(std::pair<std::string, std::string>("captureFrames", TYPE_BOOL));				// whether every frame of the trials is saved as an image
+	param_name_type.push_back(std::pair<std::string, std::string>("scopeWindow", TYPE_BOOL));				// whether the experimenter sees the plots of the control loop in a second window
+	param_name_type.push_back(std::pair<std::string, std::string>("audioSink", TYPE_INT));					// 0: sound card, 1: no output, 2: Output/outputFilename_audio.wav
+	param_name_type.push_back(std::pair<std::string, std::string>("smallAngleThreshold", TYPE_DOUBLE));		// (degree for simplicity) below this angle the model uses its closed-form small-angle solution (0: never)
+	param_name_type.push_back(std::pair<std::string, std::string>("latencyCompensation", TYPE_DOUBLE));		// (s) age of the HM measurements compensated in the model (0: none, <0: estimated round trip)
 	
 	// Actually read in file (and check whether all the parameters are given a value otherwise abort)
-	if(parseParamFile(param_filename, output_filename, param_name_type, param_map_int, param_map_bool, param_map_double) == -1)
+	if(parseParamFile(param_filename, output_filename, param_name_type, param_map_int, param_map_bool, param_map_double, param_map_vector) == -1)
 		return -1;
 
 	// Convert degrees to rad (easier for all trigonometry operations)
 	param_map_double["arcCup"] *= M_PI / 180.; 
 	param_map_double["pendulumInitialAngle"] *= M_PI / 180.;
 	param_map_double["pendulumInitialVelocity"] *= M_PI / 180.;
+	param_map_double["smallAngleThreshold"] *= M_PI / 180.;
 
 	// Create pointer (hence "new" mandatory) to object which takes care of basically everything
 	pDisplay = new Display(mainLoopPeriod, mainLoopTimerID, output_filename, 
@@ -75,6 +92,21 @@ int main(int argc, char** argv)
 							param_map_bool["sound"],
 							param_map_bool["speedHint"]);
 
+	pDisplay->SetCupProfile(param_map_vector["cupProfile"]);
+	pDisplay->SetLatencyCompensation(param_map_double["latencyCompensation"]);
+	pDisplay->SetSmallAngleApproximation(param_map_double["smallAngleThreshold"]);
+	pDisplay->SetOutputFormat(param_map_int["outputFormat"]);
+	pDisplay->SetRecordingChunkDuration(param_map_double["recordingChunkDuration"]);
+	pDisplay->SetAuxiliaryChannels(param_map_int["auxiliaryChannelDecimation"]);
+	pDisplay->SetLoopOverrunPolicy(param_map_int["loopOverrunPolicy"]);
+	pDisplay->SetLoopTimeBudget(param_map_double["loopTimeBudget"]);
+	pDisplay->SetRealTimeMode(param_map_int["realTimePriority"], param_map_int["realTimeCpu"]);
+	pDisplay->SetDisplayPrediction(param_map_double["displayPredictionHorizon"]);
+	pDisplay->SetFrameCapture(param_map_bool["captureFrames"]);
+	pDisplay->SetScopeWindow(param_map_bool["scopeWindow"]);
+	pDisplay->SetAudioSink(param_map_int["audioSink"]);
+	pDisplay->SetMaxCartAcceleration(param_map_double["maxCartAcceleration"]);
+
 	// Initialize HM and visual 	
 	if (pDisplay->Initialize(argc, argv) != 0) // if HM initialization fails
 	{
@@ -0,0 +1,115 @@
+#include <windows.h>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <cstdio>
+#include "recorder.h"
+#include "trialFile.h"
+#include "journal.h"
+#include "trialWriter.h"
+
+// Test of the recovery of the trials after a crash (separate executable, not part of the experiment program)
+// Usage: TestJournal
+// Writes in the folder TestJournal the journal of a block which was interrupted (a submitted trial whose data file was not written, and the first chunk of
+// a trial interrupted during the motion), then starts a writer for a later block, whose name is different (date of the block), and checks that both trials
+// are recovered in their data files and that the journal of the interrupted block is deleted. Prints the result and returns 0 if all the checks passed
+
+#define TEST_DIRECTORY "TestJournal/"
+
+int nbFailedChecks = 0;
+
+void Check(bool isPassed, const std::string &description)
+{
+	std::cout << (isPassed ? "OK     " : "FAILED ") << description << std::endl;
+	if (!isPassed)
+		nbFailedChecks++;
+}
+
+
+bool FileExists(const std::string &filename)
+{
+	std::ifstream file(filename.c_str());
+	return file.good();
+}
+
+
+// Last line of the samples of a CSV data file (empty if the file cannot be read)
+std::string LastLine(const std::string &filename)
+{
+	std::ifstream file(filename.c_str());
+	std::string line, lastLine;
+	while (getline(file, line))
+		if (!line.empty())
+			lastLine = line;
+	return lastLine;
+}
+
+
+// Samples of a trial: time (s, loop period of 10 ms) and position
+void RecordSamples(Recorder &recorder, unsigned int firstSample, unsigned int nbSamples)
+{
+	recorder.Clear();
+	for (unsigned int i=firstSample; i<firstSample+nbSamples; i++)
+	{
+		double sample[2] = {i * 0.01, 0.1 * i};
+		recorder.Append(sample);
+	}
+}
+
+
+int main(int argc, char** argv)
+{
+	std::string interruptedJournal = TEST_DIRECTORY "block_19Oct2026_10-00-00.journal";
+	std::string laterJournal = TEST_DIRECTORY "block_19Oct2026_10-05-00.journal";
+	std::string submittedFilename = TEST_DIRECTORY "block_19Oct2026_10-00-00_trial_1.csv";
+	std::string interruptedFilename = TEST_DIRECTORY "block_19Oct2026_10-00-00_trial_2.csv";
+	std::string partialFilename = TEST_DIRECTORY "block_19Oct2026_10-00-00_trial_2_partial.csv";
+	CreateDirectoryA(TEST_DIRECTORY, NULL);
+	DeleteFileA(interruptedJournal.c_str());
+	DeleteFileA(laterJournal.c_str());
+	DeleteFileA(submittedFilename.c_str());
+	DeleteFileA(partialFilename.c_str());
+
+	// Interrupted block: trial 1 submitted, trial 2 recorded in chunks, the program stopped before the writer wrote the data files
+	Recorder recorder;
+	recorder.AddChannel("Time", "s");
+	recorder.AddChannel("Cart_Pos_X", "m");
+	recorder.Reserve(100);
+	TrialHeader header;
+	header.Clear("Rhythmic", 3);
+	header.AddInt("TrialNumber", 1, "N/A");
+	{
+		TrialJournal journal;
+		Check(journal.Open(interruptedJournal) == 0, "journal of the interrupted block opened");
+		RecordSamples(recorder, 0, 100);
+		journal.AppendTrial(1, submittedFilename, TRIAL_FILE_CSV, header, recorder);
+		RecordSamples(recorder, 0, 50);
+		journal.AppendChunk(2, interruptedFilename, recorder);
+		Check(journal.Commit() == 0, "journal of the interrupted block committed");
+		journal.Close();
+	}
+
+	// Later block, with another name: the trials of the interrupted block are recovered when its journal is opened
+	{
+		TrialWriter writer;
+		int nbRecovered = writer.OpenJournal(TEST_DIRECTORY, laterJournal);
+		Check(nbRecovered == 2, "2 trials recovered (" + std::to_string(nbRecovered) + ")");
+	}
+	Check(LastLine(submittedFilename).compare(0, 5, "0.99;") == 0, "submitted trial written with its 100 samples");
+	Check(LastLine(partialFilename).compare(0, 5, "0.49;") == 0, "interrupted trial written with the 50 samples of its chunk");
+	Check(!FileExists(interruptedJournal), "journal of the interrupted block deleted");
+	Check(FileExists(laterJournal), "journal of the later block created");
+
+	// Next start: the journal of the later block has no trial left, nothing is written again
+	DeleteFileA(submittedFilename.c_str());
+	{
+		TrialWriter writer;
+		int nbRecovered = writer.OpenJournal(TEST_DIRECTORY, TEST_DIRECTORY "block_19Oct2026_10-10-00.journal");
+		Check(nbRecovered == 0, "no trial recovered from an empty journal (" + std::to_string(nbRecovered) + ")");
+	}
+	Check(!FileExists(submittedFilename), "submitted trial not written twice");
+	Check(!FileExists(laterJournal), "empty journal of the later block deleted");
+
+	std::cout << ((nbFailedChecks == 0) ? "All checks passed" : std::to_string(nbFailedChecks) + " checks failed") << std::endl;
+	return (nbFailedChecks == 0) ? 0 : 1;
+}
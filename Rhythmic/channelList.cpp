@@ -0,0 +1,88 @@
+#include "channelList.h"
+
+ChannelList::ChannelList(Recorder *pRecorderOfTrial)
+{
+	pRecorder = pRecorderOfTrial;
+	rowDecimation = 1;
+	nbTicks = 0;
+	channels.reserve(RECORDER_MAX_CHANNELS);
+}
+
+ChannelList::~ChannelList()
+{
+}
+
+
+int ChannelList::Add(const std::string name, const std::string unit, const double *source, unsigned int decimation, int filter)
+{
+	if (pRecorder->AddChannel(name, unit) < 0)
+		return -1;
+	Channel channel;
+	channel.source = source;
+	channel.decimation = (decimation > 0) ? decimation : 1;
+	channel.filter = filter;
+	channel.sum = 0.;
+	channel.nbValues = 0;
+	channels.push_back(channel);
+	row[channels.size() - 1] = 0.;
+	SetDecimation(channels.size() - 1, channel.decimation); // update the decimation of the rows
+	return channels.size() - 1;
+}
+
+
+int ChannelList::SetDecimation(int channel, unsigned int decimation)
+{
+	if (channel < 0 || channel >= (int)channels.size() || decimation == 0)
+		return -1;
+	channels[channel].decimation = decimation;
+	rowDecimation = channels[0].decimation;
+	for (unsigned int c=1; c<channels.size(); c++)
+		if (channels[c].decimation < rowDecimation)
+			rowDecimation = channels[c].decimation;
+	return 0;
+}
+
+
+unsigned int ChannelList::GetNbChannels()
+{
+	return channels.size();
+}
+
+
+unsigned int ChannelList::GetRowDecimation()
+{
+	return rowDecimation;
+}
+
+
+void ChannelList::Reset()
+{
+	nbTicks = 0;
+	for (unsigned int c=0; c<channels.size(); c++)
+	{
+		channels[c].sum = 0.;
+		channels[c].nbValues = 0;
+	}
+}
+
+
+void ChannelList::Record()
+{
+	for (unsigned int c=0; c<channels.size(); c++)
+	{
+		Channel &channel = channels[c];
+		double value = *channel.source;
+		channel.sum += value;
+		channel.nbValues++;
+		// The first row has the current value of every channel, then each channel is updated at the end of each decimation window
+		if (nbTicks == 0 || channel.nbValues == channel.decimation)
+		{
+			row[c] = (channel.filter == CHANNEL_FILTER_MEAN && nbTicks > 0) ? channel.sum / channel.nbValues : value;
+			channel.sum = 0.;
+			channel.nbValues = 0;
+		}
+	}
+	if (nbTicks % rowDecimation == 0)
+		pRecorder->Append(row);
+	nbTicks++;
+}
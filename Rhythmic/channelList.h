@@ -0,0 +1,58 @@
+#ifndef CHANNELLIST_H_INCLUDED
+#define CHANNELLIST_H_INCLUDED
+
+/* List of the recorded channels: where each value is read, and at which rate it is recorded */
+/*
+	Each channel is declared once with the address of the value the control loop computes (a member of the display, or the measurements
+	stored in Haptic), so that recording a sample only copies values which are already computed at each tick (no accessor, no model computation).
+	Each channel has its own decimation factor: its value is only updated every decimation ticks, and is held in the rows in between.
+	The rows are recorded every GetRowDecimation() ticks (the smallest decimation of the channels): as the channels of the task are recorded
+	at each tick, the trial files keep one row per tick, and a decimated channel does not make the CSV, binary or MAT files smaller (only the
+	compressed format stores the held values almost for free, see columnCodec.h). Decimation lowers the rate of a channel, not the size of the data.
+	Before it is decimated, a channel can be averaged over the decimation window (continuous signals such as forces), or only sampled (states, time).
+	The mean is a boxcar filter: it smooths the signal but only attenuates the frequencies above half the decimated rate, it is not a full anti-aliasing filter.
+*/
+#include <string>
+#include <vector>
+#include <iostream>
+#include "recorder.h"
+
+#define CHANNEL_FILTER_NONE 0 // value at the tick of the update
+#define CHANNEL_FILTER_MEAN 1 // mean of the values since the previous update (boxcar, attenuates the aliasing of the decimation without removing it)
+
+class ChannelList
+{
+	public:
+		ChannelList(Recorder *pRecorderOfTrial);
+		~ChannelList();
+
+		// Declare a channel (also declared in the recorder). source must stay valid as long as the list is used. Return the index of the channel (-1 if the recorder is full)
+		int Add(const std::string name, const std::string unit, const double *source, unsigned int decimation = 1, int filter = CHANNEL_FILTER_NONE);
+		// Change the decimation factor of a channel (1: every tick). Return -1 if the channel does not exist or decimation is 0
+		int SetDecimation(int channel, unsigned int decimation);
+		unsigned int GetNbChannels();
+		unsigned int GetRowDecimation();
+
+		// Start of the recording: the first tick updates all the channels
+		void Reset();
+		// Read all the channels (once per tick) and append a row to the recorder when one is due
+		void Record();
+
+	private:
+		struct Channel
+		{
+			const double *source;
+			unsigned int decimation;
+			int filter;
+			double sum; // of the values since the previous update
+			unsigned int nbValues;
+		};
+
+		Recorder *pRecorder;
+		std::vector<Channel> channels;
+		double row[RECORDER_MAX_CHANNELS]; // last value of each channel
+		unsigned int rowDecimation;
+		unsigned int nbTicks; // since Reset
+};
+
+#endif // CHANNELLIST_H_INCLUDED
@@ -0,0 +1,96 @@
+#ifndef COLUMNCODEC_H_INCLUDED
+#define COLUMNCODEC_H_INCLUDED
+
+/* Lossless compression of the recorded channels (used by the compressed trial files, see trialFile.h) */
+/*
+	Successive samples of the recorded signals (time, pendulum angle, cart position...) are close to each other, so most of the bits of a sample can be
+	predicted from the previous samples. A column is compressed in blocks of COLUMN_CODEC_BLOCK_SIZE values, each block independently of the others:
+	- prediction: each value (as its 64 bits) is replaced by its difference with a prediction from the previous values of the block. Three predictors
+	  are tried and the one giving the smallest estimated size is kept for the block: XOR with the previous value, difference with the previous value,
+	  and difference with the linear extrapolation of the two previous values (good for the time). Differences are computed on the bits as integers
+	  (exactly reversible, unlike a difference of doubles) and zigzag encoded so that small negative differences have their high bytes at zero
+	- byte shuffle: the 8 bytes of the residuals are separated in 8 planes (byte 0 of all the residuals, then byte 1...). The high planes (sign, exponent,
+	  high bits of the mantissa) are then made of long runs of zeros
+	- entropy coding: each plane is coded with rANS (order 0, frequencies normalized to 1 << RANS_PROB_BITS and stored with the plane). A plane with a
+	  single byte value is stored as that byte, and a plane which would not be smaller is stored as it is
+
+	Stream of a column (little endian), one block after the other until the end of the data:
+		unsigned char predictor, unsigned int nbValues
+		8 x plane: unsigned char mode, then
+			COLUMN_CODEC_PLANE_CONSTANT: unsigned char value
+			COLUMN_CODEC_PLANE_RANS: unsigned short nbSymbols, nbSymbols x (unsigned char symbol, unsigned short frequency), unsigned int nbBytes, bytes
+			COLUMN_CODEC_PLANE_RAW: nbValues bytes
+
+	The decoder is streaming: it only keeps one block in memory and returns the values in as many calls as needed.
+*/
+#include <string.h>
+#include <string>
+#include <vector>
+
+#define COLUMN_CODEC_BLOCK_SIZE 4096 // values per block
+
+#define COLUMN_CODEC_XOR 0 // residual = value ^ previous
+#define COLUMN_CODEC_DELTA 1 // residual = value - previous
+#define COLUMN_CODEC_DELTA2 2 // residual = value - (2 * previous - before previous)
+#define COLUMN_CODEC_NB_PREDICTORS 3
+
+#define COLUMN_CODEC_PLANE_CONSTANT 0
+#define COLUMN_CODEC_PLANE_RANS 1
+#define COLUMN_CODEC_PLANE_RAW 2
+
+#define RANS_PROB_BITS 12 // the frequencies of the symbols of a plane sum to 1 << RANS_PROB_BITS
+#define RANS_LOWER_BOUND (1u << 23) // the state of the coder stays in [RANS_LOWER_BOUND, RANS_LOWER_BOUND << 8[
+
+class ColumnEncoder
+{
+	public:
+		ColumnEncoder();
+		~ColumnEncoder();
+
+		// Start a column: the compressed data will be appended to output (which must exist until End)
+		void Begin(std::string &output);
+		// Add values at the end of the column (in as many calls as needed)
+		void Append(const double *values, unsigned int nbValues);
+		// Compress the last block
+		void End();
+
+	private:
+		void EncodeBlock();
+		void EncodePlane(const unsigned char *symbols, unsigned int nbSymbols);
+
+		std::string *pOutput;
+		std::vector<unsigned __int64> block; // bits of the values of the current block
+		unsigned int nbValuesInBlock;
+		std::vector<unsigned __int64> residuals[COLUMN_CODEC_NB_PREDICTORS];
+		std::vector<unsigned char> plane;
+		std::vector<unsigned char> ransBuffer;
+		std::vector<double> countBits; // count * log2(count), to estimate the size of a plane
+};
+
+class ColumnDecoder
+{
+	public:
+		ColumnDecoder();
+		~ColumnDecoder();
+
+		// Start decoding the compressed column data (size bytes, which must stay available while decoding)
+		void Begin(const char *data, unsigned __int64 size);
+		// Copy the next values of the column (at most nbValues) in values. Return the number of values copied (0 at the end of the column),
+		// or -1 if the data are not valid
+		int Decode(double *values, unsigned int nbValues);
+
+	private:
+		bool DecodeBlock();
+		bool DecodePlane(unsigned int planeIndex, unsigned int nbSymbols);
+		bool Read(void *destination, unsigned __int64 nbBytes);
+
+		const unsigned char *data;
+		unsigned __int64 dataSize;
+		unsigned __int64 position;
+		std::vector<unsigned __int64> block; // residuals, then bits of the values of the current block
+		unsigned int nbValuesInBlock;
+		unsigned int nextValue; // first value of the block not returned yet
+		std::vector<unsigned char> lookup; // symbol of each slot of the rANS frequencies
+};
+
+#endif // COLUMNCODEC_H_INCLUDED
@@ -0,0 +1,66 @@
+#include "csvEmitter.h"
+
+CsvEmitter::CsvEmitter(int formatMode)
+{
+	mode = formatMode;
+}
+
+CsvEmitter::~CsvEmitter()
+{
+}
+
+
+void CsvEmitter::SetMode(int formatMode)
+{
+	mode = formatMode;
+}
+
+
+int CsvEmitter::GetMode()
+{
+	return mode;
+}
+
+
+int CsvEmitter::WriteSamples(std::ostream &file, const double * const *channels, unsigned int nbChannels, unsigned int nbSamples)
+{
+	if (nbChannels == 0)
+		return 0;
+	unsigned int lineLength = nbChannels * (CSV_EMITTER_MAX_VALUE_LENGTH + 1);
+	if (buffer.size() < CSV_EMITTER_BUFFER_SIZE || buffer.size() < lineLength)
+		buffer.resize((lineLength > CSV_EMITTER_BUFFER_SIZE) ? lineLength : CSV_EMITTER_BUFFER_SIZE);
+	char *start = &buffer[0];
+	char *end = start + buffer.size();
+	char *position = start;
+
+	for (unsigned int i=0; i<nbSamples; i++)
+	{
+		// Not enough room for a full line: write what is in the buffer
+		if ((unsigned int)(end - position) < lineLength)
+		{
+			file.write(start, position - start);
+			position = start;
+		}
+		position = WriteValue(position, channels[0][i]);
+		for (unsigned int c=1; c<nbChannels; c++)
+		{
+			*position++ = ';';
+			position = WriteValue(position, channels[c][i]);
+		}
+		*position++ = '\n'; // in text mode, the stream writes the end of line of the system (as with operator<<)
+	}
+	file.write(start, position - start);
+
+	if (file.fail())
+		return -1;
+	return 0;
+}
+
+
+char* CsvEmitter::WriteValue(char *position, double value)
+{
+	// std::chars_format::general with a precision is the format of printf("%.6g"), used by operator<< by default
+	if (mode == CSV_EMITTER_SHORTEST)
+		return std::to_chars(position, position + CSV_EMITTER_MAX_VALUE_LENGTH, value).ptr;
+	return std::to_chars(position, position + CSV_EMITTER_MAX_VALUE_LENGTH, value, std::chars_format::general, 6).ptr;
+}
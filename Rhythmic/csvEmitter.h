@@ -0,0 +1,40 @@
+#ifndef CSVEMITTER_H_INCLUDED
+#define CSVEMITTER_H_INCLUDED
+
+/* Formatting of the samples of the CSV data files */
+/*
+	The values are formatted with std::to_chars (no locale, no stream state) into a large buffer which is reused for all the files,
+	and the buffer is written to the file in big blocks instead of one value at a time.
+	Two modes are available:
+	- strict: 6 significant digits, exactly the text written by operator<< on a stream with the default settings (the CSV files written before, and by ConvertTrialFile)
+	- shortest: the shortest text which reads back to exactly the same double (the recorded values are not rounded, but the files are larger)
+*/
+#include <string>
+#include <vector>
+#include <iostream>
+#include <charconv>
+
+#define CSV_EMITTER_STRICT 0
+#define CSV_EMITTER_SHORTEST 1
+#define CSV_EMITTER_BUFFER_SIZE 65536 // (bytes) the buffer is written when it is almost full
+#define CSV_EMITTER_MAX_VALUE_LENGTH 32 // longest text of one value (the shortest round trip of a double takes up to 24 characters)
+
+class CsvEmitter
+{
+	public:
+		CsvEmitter(int formatMode = CSV_EMITTER_STRICT);
+		~CsvEmitter();
+
+		void SetMode(int formatMode); // CSV_EMITTER_STRICT or CSV_EMITTER_SHORTEST
+		int GetMode();
+		// Write one line per sample, the values of the channels separated by ';'. Return -1 if the writing failed
+		int WriteSamples(std::ostream &file, const double * const *channels, unsigned int nbChannels, unsigned int nbSamples);
+
+	private:
+		char* WriteValue(char *position, double value);
+
+		int mode;
+		std::vector<char> buffer;
+};
+
+#endif // CSVEMITTER_H_INCLUDED
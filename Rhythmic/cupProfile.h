@@ -0,0 +1,64 @@
+#ifndef CUPPROFILE_H_INCLUDED
+#define CUPPROFILE_H_INCLUDED
+
+/* Shape of a convex, symmetric cup (bowl) which is not necessarily a circular arc */
+/*
+	The half profile (right side of the cup) is given by knots (x_i, z_i) of a cubic spline z = f(x), with x_0 = 0 at the bottom of the cup.
+	The spline has a zero slope at the bottom (symmetric cup) and a parabolic run-out at the edge. It must be strictly convex (f'' > 0).
+
+	The ball position is parametrized by the slope angle phi of the cup at the ball position (phi = atan(f'(x))), which is monotonic for a convex cup.
+	For a circular cup of radius l, phi is exactly the pendulum angle theta. With the radius of curvature rho(phi) = ds/dphi (s: arc length), the
+	equation of motion of the ball sliding without friction in the cup becomes (see model.h):
+		rho ddphi = - ddx cos(phi) - g sin(phi) - b / (m * rho0 * rho0) * rho * dphi - drho/dphi * dphi^2
+	which is the pendulum equation for rho = l (rho0 is the radius of curvature at the bottom of the cup).
+
+	Everything which depends on the shape (position in the cup frame, arc length, radius of curvature and its derivative) is precomputed once
+	in a lookup table regularly sampled in phi, so that the evaluation in the control loop is one table read and a linear interpolation.
+*/
+#include <vector>
+#include <iostream>
+#include "math.h"
+
+#define CUP_PROFILE_TABLE_SIZE 1024
+
+class CupProfile
+{
+	public:
+		CupProfile();
+		~CupProfile();
+
+		// Build the spline from the knots (x0, z0, x1, z1, ...) and precompute the lookup table. Return -1 if the profile is not valid
+		int Build(const std::vector<double> &knots);
+
+		// All the lookups are valid for negative angles too (the cup is symmetric). Angles beyond the edge are clamped to the edge
+		void GetBallPosition(double angle, double &horizontal, double &vertical); // (m) in the cup frame (origin at the bottom of the cup, vertical is up)
+		void GetRadiusOfCurvature(double angle, double &radius, double &radiusDerivative); // (m) and (m/rad)
+		double GetArcLength(double angle); // (m) from the bottom of the cup (signed)
+		double GetEdgeAngle(); // (rad) slope angle of the cup at its edge (half of the equivalent arcCup)
+		double GetBottomRadius(); // (m) radius of curvature at the bottom of the cup
+		int GetNbKnots();
+
+	private:
+		// Evaluate the spline and its first two derivatives
+		void EvaluateSpline(double x, double &z, double &dz, double &ddz);
+
+		// Spline knots and second derivatives
+		std::vector<double> knotX;
+		std::vector<double> knotZ;
+		std::vector<double> knotSecondDerivative;
+
+		// Lookup table regularly sampled in angle between 0 and edgeAngle (one entry holds everything needed for one angle so that a lookup stays in the same cache lines)
+		struct TableEntry
+		{
+			double horizontal;
+			double vertical;
+			double arcLength;
+			double radius;
+			double radiusDerivative;
+		};
+		std::vector<TableEntry> table;
+		double edgeAngle;
+		double angleStep;
+};
+
+#endif // CUPPROFILE_H_INCLUDED
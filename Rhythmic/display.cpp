@@ -1,8 +1,10 @@
 #include "display.h"
-#include "Mmsystem.h" // required for PlaySound and must be placed here and not in header file (don't know why but otherwise compilation errors)
 
 extern Display* pDisplay; // no other choice due to GLUT functions
 
+// Names of the status (see display.h), in the timing file of the block
+static const char *statusNames[NB_STATUS] = {"INITIALIZING", "GOTONEXT", "WAITFORSTART", "STARTMOTION", "INITIATEMOTION", "INMOTION", "TERMINATEMOTION", "ENDOFTRIAL", "END"};
+
 Display::Display(int mainLoopPeriod, int mainLoopTimerID, std::string nameOfBlock, int nbTrialsInBlock, double durationOfOneTrial, double goalFrequencyOfOscillations, double floorHeight, double startToTargetDistance, double arcCup, double lengthPendulum, double massPendulum, double dampingPendulum, double pendulumInitAngle, double pendulumInitVelocity, double inertiaOfHM, double accuracyFactorAmplitude, double accelerationAmplification, bool isSelfPaced, bool ballCanEscape, bool autoStart, double scalingFactorVisual, double cupAddScalingFactorVisual, bool projector, bool sound, bool isSpeedHint, int pX, int pY, int pZ)
 {
 	posX = pX;
@@ -11,6 +13,11 @@ Display::Display(int mainLoopPeriod, int mainLoopTimerID, std::string nameOfBloc
 
 	loopPeriod = mainLoopPeriod; // (ms)
 	loopTimerID = mainLoopTimerID;
+	measurementDelay = 0.;
+	smallAngleThreshold = 0.;
+	outputFormat = TRIAL_FILE_CSV;
+	recordingChunkDuration = 0.;
+	recordingChunkNbSamples = 0;
 	
 	QueryPerformanceFrequency((LARGE_INTEGER*)&timerFrequency); // initialization of time counter
 
@@ -18,6 +25,52 @@ Display::Display(int mainLoopPeriod, int mainLoopTimerID, std::string nameOfBloc
 	gravity  = 9.81; 
 	pModel = new Model(massPendulum, lengthPendulum, dampingPendulum, pendulumInitAngle, pendulumInitVelocity, gravity); // timeStep is in sec 
 	pHaptic = new Haptic(inertiaOfHM, floorHeight, pX, pY, pZ);
+	
+	// Escape risk table (optional, the task runs normally without it)
+	viabilityTableFile = "viability.bin";
+	pViability = new ViabilityTable();
+	if (pViability->Load(viabilityTableFile) != 0)
+	{
+		delete pViability;
+		pViability = NULL;
+	}
+	maxCartAcceleration = 0.; // unknown until SetMaxCartAcceleration is called: the table is then rejected by Initialize
+	pCupProfile = NULL; // circular cup unless SetCupProfile is called
+
+	pRecorder = new Recorder();
+	pChannels = new ChannelList(pRecorder);
+	pTrialWriter = new TrialWriter();
+	pLoopScheduler = new LoopScheduler();
+	pLoopTiming = new LoopTiming(statusNames, NB_STATUS);
+	pSnapshots = new SnapshotBuffer<DisplaySnapshot>();
+	isVerticalSyncEnabled = false;
+	isRedisplayScheduled = false;
+	isExitRequested = false;
+	isDataFilePending = false;
+	nbDelayedDataFiles = 0;
+	displayPredictionHorizon = 0.;
+	displayLatency = 0.;
+	refreshPeriod = DISPLAY_FALLBACK_PERIOD / 1000.;
+	lastSwapTime = 0.;
+	pFrameCapture = NULL; // no capture unless SetFrameCapture is called
+	pScope = NULL; // no scope unless SetScopeWindow is called
+	mainWindow = 0;
+	scopeWindow = 0;
+	nbFramesSinceScope = 0;
+	captureTrialNb = -1;
+	captureFrameNb = 0;
+	for (int i=0; i<3; i++)
+		measuredCupAcceleration[i] = 0.;
+	realTimePriority = REAL_TIME_OFF;
+	realTimeCpu = -1;
+	auxiliaryChannelDecimation = 0;
+	tickTime = 0.;
+	tickStatus = 0.;
+	tickPendulumAngle = 0.;
+	tickPendulumAngularVelocity = 0.;
+	tickPendulumAngularAcceleration = 0.;
+	tickBallForce = 0.;
+	isTickBallForceComputed = false;
 
 	// options 
 	blockName = nameOfBlock;	
@@ -42,9 +95,23 @@ Display::Display(int mainLoopPeriod, int mainLoopTimerID, std::string nameOfBloc
 	durationWaitForStart = 2.;
 	durationEndOfTrial = 2.;
 	durationDamping = 0.5;
+	maxRecordingDuration = durationOneTrial + durationEndOfTrial + 5.; // the recording starts at the go signal, the margin covers the time the user takes to start moving
 	
 	// movement related parameters
 	axisOfMotion = posY;
+
+	// Recorded data (one sample per tick). Though the HM can move in 3D, the cart model has only a 1D motion. Only this direction is recorded by default so that the file is not too big (see SetAuxiliaryChannels)
+	pChannels->Add("Time", "(s)", &tickTime);
+	pChannels->Add("Pendulum_Angle", "(rad)", &tickPendulumAngle);
+	pChannels->Add("Pendulum_AngularVel", "(rad/s)", &tickPendulumAngularVelocity);
+	pChannels->Add("Pendulum_AngularAcc", "(rad/s/s)", &tickPendulumAngularAcceleration);
+	pChannels->Add("Cart_Pos_X", "(m)", &pHaptic->GetCurrentPosition()[axisOfMotion]);
+	pChannels->Add("Cart_Vel_X", "(m/s)", &pHaptic->GetCurrentVelocity()[axisOfMotion]);
+	pChannels->Add("Cart_Acc_X", "(m/s/s)", &pHaptic->GetCurrentAcceleration()[axisOfMotion]); // since the data to record are read after the ball force on the cup is applied, the acceleration here already contains the acceleration amplification gain (however the velocity does not include the gain)
+	pChannels->Add("Ball_Force", "(N)", &tickBallForce); // this is not similar to what we get with the force in HapticMaster (force along Y is zero since no haptic objects, except constant force but is not included apparently)
+	pChannels->Add("User_Force_X", "(N)", &pHaptic->GetCurrentForce()[0]); // force measured with the HM (force sensor)
+	pChannels->Add("User_Force_Y", "(N)", &pHaptic->GetCurrentForce()[1]);
+	pChannels->Add("User_Force_Z", "(N)", &pHaptic->GetCurrentForce()[2]);
 	targetPosition[posX] = 0;
 	startPosition[posX] = 0;
 	targetPosition[posY] = 0;
@@ -59,6 +126,8 @@ Display::Display(int mainLoopPeriod, int mainLoopTimerID, std::string nameOfBloc
 		escapePosition[i] = 0.;
 		escapeVelocity[i] = 0.;
 	}
+	escapeRisk = 0.;
+	viabilityLossTime = -1.;
 	
 	// physical model parameter (all model parameters must be stored to write in output file)
 	accelerationAmplificationFactor = accelerationAmplification;
@@ -69,26 +138,31 @@ Display::Display(int mainLoopPeriod, int mainLoopTimerID, std::string nameOfBloc
 	pendulumLength = lengthPendulum;
 	pendulumInitialAngle = pendulumInitAngle;
 	pendulumInitialVelocity = pendulumInitVelocity;
-	
-	cupWidth = 2 * pendulumLength * sin(0.5 * arcCup);
-	cupHeight = pendulumLength * (1 - cos(0.5 * arcCup));
 	amplitudeFactorAccuracy = accuracyFactorAmplitude;
-	targetWidth = max(amplitudeFactorAccuracy, 1.1) * cupWidth; // target must be larger that cup so that cup can fits entirely into target box (this is how motion is target is considered to be reached)
 
 	// tolerance parameters (used to bring HM back to init pos) and parameters to compute average frequency for feedback to user during trial
 	distanceTolerance = 0.01; 
 	velocityTolerance = 0.005; // also used when autoStart is off to detect beginning of motion
 	frequencyTolerance = 0.1; // percentage of the goal frequency
 	nbCyclesForAverageFrequency = 2;
+	firstCycleDuration = 0;
+	nbStoredCycleDurations = 0;
 	motionDirection = 1;
 	averageUserFrequency = 0.;
 	timeStartCycle = 0.;
+	nbScheduledBeats = 0;
+	nbReadOnsets = 0;
+	// All the bips of a trial (one every half period), so that nothing is allocated during the motion
+	beatTimes.reserve((size_t)(2. * durationOneTrial / goalOscillationPeriod) + 2);
+	beatOnsets.reserve(beatTimes.capacity());
 	
 	// sounds for auditory cues
 	playSound = sound;
-	failureSound = "Sounds\\failure.wav";
-	bipSound = "Sounds\\bip.wav";
-	endSound  = "Sounds\\neutral.wav";
+	pAudio = new AudioEngine();
+	audioSink = AUDIO_SINK_DEVICE;
+	failureCue = pAudio->LoadCue("failure", "Sounds\\failure.wav");
+	bipCue = pAudio->LoadCue("bip", "Sounds\\bip.wav");
+	endCue = pAudio->LoadCue("end", "Sounds\\neutral.wav");
 
 	/* Graphic parameters */			
 	// window size and projection parameters
@@ -132,23 +206,14 @@ Display::Display(int mainLoopPeriod, int mainLoopTimerID, std::string nameOfBloc
 	upY = 0.0;
 	upZ = 1.0;
 	
-	// Update target width and height for visual block 
-	targetWidth *= cupAdditionalVisualScalingFactor;
-	cupHeight *= cupAdditionalVisualScalingFactor;
-
-	ballRadius = 0.1 * cupWidth * cupAdditionalVisualScalingFactor; // size of ball does not have any impact on the mechanical model. Defined as a percentage of the horizontal width of the cup
 	ballNbSlices = 20;
+	sceneList = 0; // display lists built in Initialize, once the OpenGL context exists
+	cupList = 0;
+	ballList = 0;
 	blockLineWidth = 4.0;
 
-	// Create an array of points which - once joined - form the arc for the cup (centered on (0,0), real position adapted after according to the position of the HM end-effector)
-	// The cup is defined by both the pendulum length (curvature of the cup) and the portion of the total circle which is kept to represent the cup (defined by an angle)
-	cupShapePoints.clear();
-	int nbPoints = 100;	
-	for (int i=0; i<nbPoints+1; i++)
-	{
-		double angle = ((i *1.0) / nbPoints * arcCup - arcCup / 2.);
-		cupShapePoints.push_back(std::pair<double,double>(cupAdditionalVisualScalingFactor * (pendulumLength + ballRadius) * sin(angle), cupAdditionalVisualScalingFactor * (pendulumLength + ballRadius) * (1 - cos(angle)) - ballRadius));
-	}
+	// Size of the cup, target and ball, and shape of the cup
+	ComputeCupGeometry();
 	
 	// color parameters
 	floorColor[0] = 0.;
@@ -183,10 +248,32 @@ Display::Display(int mainLoopPeriod, int mainLoopTimerID, std::string nameOfBloc
 
 Display::~Display()
 {
+	if (pLoopScheduler != NULL)
+		delete pLoopScheduler; // no tick after this point
+	if (pLoopTiming != NULL)
+		delete pLoopTiming;
+	if (pSnapshots != NULL)
+		delete pSnapshots;
+	if (pFrameCapture != NULL)
+		delete pFrameCapture; // wait until all the frames are written
+	if (pScope != NULL)
+		delete pScope;
+	if (pAudio != NULL)
+		delete pAudio; // stop the audio thread
 	if (pModel != NULL)
 		delete pModel;
 	if (pHaptic != NULL)
 		delete pHaptic;
+	if (pViability != NULL)
+		delete pViability;
+	if (pCupProfile != NULL)
+		delete pCupProfile;
+	if (pTrialWriter != NULL)
+		delete pTrialWriter; // wait until all the data files are written
+	if (pChannels != NULL)
+		delete pChannels;
+	if (pRecorder != NULL)
+		delete pRecorder;
 }
 
 void Display::Timer(int iTimer)
@@ -199,17 +286,26 @@ void Display::Timer(int iTimer)
 	for (int i=0; i<3; i++)
 		pendulumForce[i] = 0;
 
+	std::lock_guard<std::mutex> lock(stateMutex); // Timer runs in the thread of the scheduler
+
 	if (pHaptic != NULL)
 	{
+		pLoopTiming->BeginTick(status);
+
 		// Get time
 		previousTime = currentTime;
 		QueryPerformanceCounter((LARGE_INTEGER *)&currentTimeStamp);
 		currentTime = (1. * currentTimeStamp) / timerFrequency;
-		timeStep = currentTime - previousTime; // need to be computed because the theoretical simestep given as parameter in the glutTimerFunc is not well respected
+		timeStep = currentTime - previousTime; // measured: the ticks are at fixed deadlines (see loopScheduler.h), but a late tick is not compensated in its timeStep
+		isTickBallForceComputed = false;
 		
 		// Get The Current EndEffector Position/Velocity/Acceleration from THe HapticMASTER
 		// (force if needed but be careful, with the old software these are the virtual forces, not the forces actually applied by the user)
+		pLoopTiming->BeginPhase();
 		pHaptic->UpdateForcePositionVelocityAcceleration();
+		pLoopTiming->EndPhase(LOOP_PHASE_DEVICE_READ);
+		for (int i=0; i<3; i++)
+			measuredCupAcceleration[i] = pHaptic->GetCurrentAcceleration()[i];
 
 		switch (status)
 		{
@@ -244,7 +340,10 @@ void Display::Timer(int iTimer)
 					motionDirection = 1;
 					averageUserFrequency = 0.;
 					timeStartCycle = 0.;
-					storageCycleDuration.clear(); 
+					firstCycleDuration = 0;
+					nbStoredCycleDurations = 0;
+					escapeRisk = 0.;
+					viabilityLossTime = -1.;
 					pModel->InitializeState(pendulumInitialAngle, pendulumInitialVelocity); // the start state is the same for all trials in block
 					pHaptic->UpdateStartPositionSpring(startPosition);
 					pHaptic->EnableRestrict1DMotion();
@@ -266,7 +365,7 @@ void Display::Timer(int iTimer)
 			pHaptic->EnableBallForce();
 			// Play a sound saying you can start 
 			if(playSound)
-				PlaySoundA(bipSound, NULL, SND_ASYNC);
+				pAudio->Play(bipCue);
 
 			// Start recording (as soon as you are allowed to move, even if you are not really starting, so that you don't miss the very beginning of the motion)
 			startTime = currentTime; 	
@@ -278,20 +377,38 @@ void Display::Timer(int iTimer)
 			if (autoStartMode || pHaptic->GetCurrentVelocity()[axisOfMotion] >= velocityTolerance) // starts automatically or the time is triggered only when the user actually moves the HM 
 			{
 				userStartTime = currentTime;
-				startWaitTime = currentTime; // used later to compute when bip sound should be played
+				// The bips of the metronome are counted from here
+				nbScheduledBeats = 0;
+				beatTimes.clear();
+				beatOnsets.clear();
+				nbReadOnsets = pAudio->GetNbOnsets();
 				status = INMOTION;				
 			}
 			break;
 			
 		case INMOTION:
+			pLoopTiming->BeginPhase();
 			cupPosition = pHaptic->GetCurrentPosition();
 			cupVelocity = pHaptic->GetCurrentVelocity();	
 			cupAcceleration = pHaptic->GetCurrentAcceleration();
 			cupAcceleration[axisOfMotion] *= accelerationAmplificationFactor; // if motion is not along Y only, modify that to scale all the components needed
-			pModel->UpdatePendulumState(cupAcceleration[axisOfMotion], timeStep);
+			pModel->UpdatePendulumState(cupAcceleration[axisOfMotion], timeStep, (measurementDelay < 0.) ? pHaptic->GetMeasurementRoundTripTime() : measurementDelay); // the acceleration is one round trip old when it is received
 			
+			// Early failure detection: look up whether the ball can still be kept in the cup (no simulation needed, the table is precomputed)
+			if (pViability != NULL)
+			{
+				escapeRisk = pViability->GetEscapeRisk(pModel->GetPendulumAngle(), pModel->GetPendulumAngularVelocity());
+				if (escapeRisk > 0. && viabilityLossTime < 0.)
+					viabilityLossTime = currentTime - userStartTime;
+			}
+
 			pendulumForce[axisOfMotion] = pModel->ComputePendulumForceOnCart(cupAcceleration[axisOfMotion]);// Inertial force which tends to put the cart in motion (opposite of resistive force of the cup wall)
+			tickBallForce = pendulumForce[axisOfMotion]; // recorded as computed (the force may be limited in place)
+			isTickBallForceComputed = true;
+			pLoopTiming->EndPhase(LOOP_PHASE_MODEL);
+			pLoopTiming->BeginPhase();
 			pHaptic->UpdateBallForce(pendulumForce);
+			pLoopTiming->EndPhase(LOOP_PHASE_FORCE_WRITE);
 			
 			// Check if ball escape
 			if (canBallEscape && abs(pModel->GetPendulumAngle()) > arcOfCup/ 2.)
@@ -301,16 +418,18 @@ void Display::Timer(int iTimer)
 				double angle = pModel->GetPendulumAngle();
 				double angularVelocity = pModel->GetPendulumAngularVelocity();
 
+				double ballHorizontal, ballVertical;
+				pModel->GetBallPositionInCupFrame(ballHorizontal, ballVertical);
 				escapePosition[posX] = cupPosition[posX]; // 2D model
-				escapePosition[posY] = cupPosition[posY] + cupAdditionalVisualScalingFactor * pendulumLength * sin(angle);
-				escapePosition[posZ] = cupPosition[posZ] + cupAdditionalVisualScalingFactor * pendulumLength * (1 - cos(angle)); 
+				escapePosition[posY] = cupPosition[posY] + cupAdditionalVisualScalingFactor * ballHorizontal;
+				escapePosition[posZ] = cupPosition[posZ] + cupAdditionalVisualScalingFactor * ballVertical; 
 					
 				escapeVelocity[posX] = cupVelocity[posX]; // TODO should the velocity also be scaled ??
 				escapeVelocity[posX] = cupVelocity[posX] + cupAdditionalVisualScalingFactor * pendulumLength * cos(angle) * angularVelocity;
 				escapeVelocity[posX] = cupVelocity[posX] + cupAdditionalVisualScalingFactor * pendulumLength * sin(angle) * angularVelocity;
 				
 				if (playSound)
-					PlaySoundA(failureSound, NULL, SND_ASYNC);
+					pAudio->Play(failureCue);
 				status = TERMINATEMOTION;
 				break;
 			}
@@ -324,31 +443,36 @@ void Display::Timer(int iTimer)
 					if (timeStartCycle != 0.) // first time crossing, no cycle terminated
 					{
 						double averageCycleTime = 0.;
-						storageCycleDuration.push_back(currentTime - timeStartCycle);						
-						for (unsigned int i=0; i< storageCycleDuration.size(); i++)
-							averageCycleTime += storageCycleDuration[i];
-						averageUserFrequency = 1. / (averageCycleTime / storageCycleDuration.size());
+						storageCycleDuration[(firstCycleDuration + nbStoredCycleDurations) % MAX_CYCLES_FOR_AVERAGE_FREQUENCY] = currentTime - timeStartCycle;
+						nbStoredCycleDurations++;
+						for (unsigned int i=0; i< nbStoredCycleDurations; i++)
+							averageCycleTime += storageCycleDuration[(firstCycleDuration + i) % MAX_CYCLES_FOR_AVERAGE_FREQUENCY];
+						averageUserFrequency = 1. / (averageCycleTime / nbStoredCycleDurations);
 					
-						if (storageCycleDuration.size() > nbCyclesForAverageFrequency)
-							storageCycleDuration.pop_front(); // remove oldest element	
+						if (nbStoredCycleDurations > nbCyclesForAverageFrequency || nbStoredCycleDurations == MAX_CYCLES_FOR_AVERAGE_FREQUENCY)
+						{
+							// remove oldest element
+							firstCycleDuration = (firstCycleDuration + 1) % MAX_CYCLES_FOR_AVERAGE_FREQUENCY;
+							nbStoredCycleDurations--;
+						}
 					}
 					timeStartCycle = currentTime;
 				}
 				motionDirection *= -1;
 			}
 			
-			// if metronome paced, check whether a metronome bip should be played (each time direction must change so half-period)
-			if (!selfPaced && currentTime - startWaitTime >= goalOscillationPeriod / 2.)	
+			// if metronome paced, a bip is played each time direction must change (half-period), scheduled ahead on the clock of the audio device
+			if (!selfPaced)
 			{
-				PlaySoundA(bipSound, NULL, SND_ASYNC);
-				startWaitTime = currentTime;
+				ScheduleMetronome();
+				ReadMetronomeOnsets();
 			}
 			
 			// Check whether duration of trial is reached
 			if (currentTime - userStartTime >= durationOneTrial)
 			{
 				if (playSound)
-					PlaySoundA(endSound, NULL, SND_ASYNC);
+					pAudio->Play(endCue);
 				status = TERMINATEMOTION;
 			}
 			// Check whether end of trial is close and damping should be activated to make the stop smooth
@@ -370,6 +494,13 @@ void Display::Timer(int iTimer)
 				isEndMotionDamped = false;
 			}
 
+			// The bips scheduled after the end of the motion are not played, those already played are written with the data
+			if (!selfPaced)
+			{
+				pAudio->CancelScheduled();
+				ReadMetronomeOnsets();
+			}
+
 			// Stop recording data and write the recorded data in a file
 			StopRecording();			
 			WriteDataInFile();
@@ -379,54 +510,212 @@ void Display::Timer(int iTimer)
 			break;
 
 		case ENDOFTRIAL:
-			if (currentTime - startWaitTime >= durationEndOfTrial)
+			if (isDataFilePending)
+				SubmitDataFile();
+			CheckDataFiles();
+			if (currentTime - startWaitTime >= durationEndOfTrial && !isDataFilePending)
 			{
 				trialNb++;
 				status = GOTONEXT;
 			}
 			break;
 
-		case END: // Exit
-			pHaptic->Terminate();
-			exit(0);
+		case END: // Exit, from the GLUT thread (see ExitProgram): the ticks must be stopped and the other threads joined first
+			isExitRequested = true;
 			break;
 		}
 
 		// Record current data if recording is active
 		if (isRecording)
+		{
+			pLoopTiming->BeginPhase();
 			RecordMotionData();
+			pLoopTiming->EndPhase(LOOP_PHASE_RECORDING);
+		}
+
+		PublishSnapshot();
+		if (pScope != NULL)
+			PushScopeSample(timeStep);
+		pLoopTiming->EndTick();
 	}
-	
-	// Set The Timer For This Function Again
-	// 1st param = callback time in msec, 2nd param = function to call at callback, 3rd param : timer ID (can have several differemt timers)
-	// Note: GLUT attempts to deliver the timer callback as soon as possible after the expiration of the callback's time interval (time is not exactly guaranteed)
-	// Callback function cannot be a method (must be either static method or regular function), because the callback function can take only one parameter (here loopTimerID),		// whereas a method also has "this" as a parameter
-	glutTimerFunc(loopPeriod, InternalTimer, loopTimerID);
 }
 
 
 void Display::InternalTimer(int iTimer)
 {
+	// Called by the scheduler at each deadline (same signature as a glutTimerFunc callback)
 	// Method being static, it cannot use attributes of the class, so a global variable is needed here
 	if (pDisplay != NULL)
 		pDisplay->Timer(iTimer);
 }
 
 
+void Display::PublishSnapshot()
+{
+	DisplaySnapshot snapshot;
+	double *cup = pHaptic->GetCurrentPosition();
+	double *cupVelocity = pHaptic->GetCurrentVelocity();
+
+	snapshot.time = currentTime;
+	snapshot.status = status;
+	snapshot.trialNb = trialNb;
+	snapshot.escapeRisk = escapeRisk;
+	snapshot.ballEscape = ballEscape;
+	snapshot.averageUserFrequency = averageUserFrequency;
+	for (int i=0; i<3; i++)
+	{
+		snapshot.cupPosition[i] = cup[i];
+		snapshot.cupVelocity[i] = cupVelocity[i];
+		snapshot.cupAcceleration[i] = measuredCupAcceleration[i];
+		snapshot.ballVelocity[i] = cupVelocity[i];
+		snapshot.ballAcceleration[i] = measuredCupAcceleration[i];
+	}
+	snapshot.pendulumAngle = pModel->GetPendulumAngle();
+	snapshot.pendulumAngularVelocity = pModel->GetPendulumAngularVelocity();
+	snapshot.pendulumAngularAcceleration = pModel->GetPendulumAngularAcceleration();
+
+	// Ball in the lab frame
+	if (!ballEscape) // ball in cup
+	{
+		double ballHorizontal, ballVertical;
+		pModel->GetBallPositionInCupFrame(ballHorizontal, ballVertical); // on the circle of radius pendulumLength, or on the cup profile
+		snapshot.ballPosition[posX] = cup[posX]; // 2D model
+		snapshot.ballPosition[posY] = cup[posY] + cupAdditionalVisualScalingFactor * ballHorizontal;
+		snapshot.ballPosition[posZ] = cup[posZ] + cupAdditionalVisualScalingFactor * ballVertical;
+	}
+	else // flying ball motion
+	{
+		snapshot.ballPosition[posX] = escapePosition[posX] + escapeVelocity[posX] * (currentTime - escapeTime);
+		snapshot.ballPosition[posY] = escapePosition[posY] + escapeVelocity[posY] * (currentTime - escapeTime);
+		snapshot.ballPosition[posZ] = escapePosition[posZ] + escapeVelocity[posZ] * (currentTime - escapeTime) - gravity / 2. * pow(currentTime - escapeTime, 2);
+		for (int i=0; i<3; i++)
+		{
+			snapshot.ballVelocity[i] = escapeVelocity[i];
+			snapshot.ballAcceleration[i] = 0.;
+		}
+		snapshot.ballVelocity[posZ] -= gravity * (currentTime - escapeTime);
+		snapshot.ballAcceleration[posZ] = -gravity;
+	}
+
+	pSnapshots->Publish(snapshot);
+}
+
+
+bool Display::GetDisplayFrame(double frameStartTime, DisplaySnapshot &frame)
+{
+	DisplaySnapshot previous;
+	if (!pSnapshots->Read(previous, frame))
+		return false;
+
+	// Predicted time at which the frame is seen: end of its swap, then half a refresh period for the scan-out to reach the middle of the screen
+	if (displayPredictionHorizon > 0.)
+	{
+		double photonTime = frameStartTime + displayLatency + 0.5 * refreshPeriod;
+		PredictDisplayFrame(min(max(photonTime - frame.time, 0.), displayPredictionHorizon), frame);
+		return true;
+	}
+
+	// No interpolation across a change of state (the ball is put back in the cup, it escapes...)
+	if (previous.status != frame.status || previous.trialNb != frame.trialNb || previous.ballEscape != frame.ballEscape || frame.time <= previous.time)
+		return true;
+
+	// The frame shows the state one loop period ago, which is between the last two ticks: the motion is smooth whatever the time of the frame relative to the ticks
+	double frameTime = frameStartTime - loopPeriod / 1000.;
+	double ratio = min(max((frameTime - previous.time) / (frame.time - previous.time), 0.), 1.);
+	frame.escapeRisk = previous.escapeRisk + ratio * (frame.escapeRisk - previous.escapeRisk);
+	for (int i=0; i<3; i++)
+	{
+		frame.cupPosition[i] = previous.cupPosition[i] + ratio * (frame.cupPosition[i] - previous.cupPosition[i]);
+		frame.ballPosition[i] = previous.ballPosition[i] + ratio * (frame.ballPosition[i] - previous.ballPosition[i]);
+	}
+	return true;
+}
+
+
+void Display::PredictDisplayFrame(double horizon, DisplaySnapshot &frame)
+{
+	// Cup: measured velocity and acceleration
+	for (int i=0; i<3; i++)
+		frame.cupPosition[i] += frame.cupVelocity[i] * horizon + 0.5 * frame.cupAcceleration[i] * horizon * horizon;
+
+	if (!frame.ballEscape)
+	{
+		// Ball: state of the model, so that it stays on the cup (up to the edge)
+		double angle = frame.pendulumAngle + frame.pendulumAngularVelocity * horizon + 0.5 * frame.pendulumAngularAcceleration * horizon * horizon;
+		angle = min(max(angle, -arcOfCup / 2.), arcOfCup / 2.);
+		double ballHorizontal, ballVertical;
+		pModel->GetBallPositionInCupFrame(angle, ballHorizontal, ballVertical);
+		frame.ballPosition[posX] = frame.cupPosition[posX]; // 2D model
+		frame.ballPosition[posY] = frame.cupPosition[posY] + cupAdditionalVisualScalingFactor * ballHorizontal;
+		frame.ballPosition[posZ] = frame.cupPosition[posZ] + cupAdditionalVisualScalingFactor * ballVertical;
+	}
+	else
+	{
+		for (int i=0; i<3; i++)
+			frame.ballPosition[i] += frame.ballVelocity[i] * horizon + 0.5 * frame.ballAcceleration[i] * horizon * horizon;
+	}
+}
+
+
+void Display::UpdateDisplayLatency(double frameStartTime)
+{
+	unsigned __int64 currentTimeStamp;
+	QueryPerformanceCounter((LARGE_INTEGER *)&currentTimeStamp);
+	double swapTime = (1. * currentTimeStamp) / timerFrequency;
+
+	displayLatency += DISPLAY_LATENCY_SMOOTHING * (swapTime - frameStartTime - displayLatency);
+	if (lastSwapTime > 0. && swapTime - lastSwapTime < 0.1) // not after a pause of the display (window moved...)
+		refreshPeriod += DISPLAY_LATENCY_SMOOTHING * (swapTime - lastSwapTime - refreshPeriod);
+	lastSwapTime = swapTime;
+}
+
+
 void Display::Keyboard(unsigned char ucKey, int iX, int iY)
 {
 	switch (ucKey)
 	{		
-		// Exit
+		// Exit (without stateMutex: the current tick may be waiting for it, and the ticks are stopped first)
 	case 27:
-		if (pHaptic != NULL)
-			pHaptic->Terminate();
-		exit(0);
+		ExitProgram();
 		break;
 	}
 }
 
 
+void Display::CloseBlock()
+{
+	pLoopScheduler->Stop(); // wait for the current tick, no tick after this point
+	if (isDataFilePending) // the queue of the writer was full at the end of the last trial
+	{
+		pTrialWriter->Flush();
+		SubmitDataFile();
+	}
+	pTrialWriter->Flush(); // do not lose the trials already done
+	if (nbDelayedDataFiles > 0)
+		std::cout << "Data files: the queue of the writer was full at the end of " << nbDelayedDataFiles << " trials (disk slower than the trials)" << std::endl;
+	CheckDataFiles();
+	pLoopTiming->WriteFile("Output/" + blockName + "_timing.csv");
+	FlushFrameCapture();
+	CloseAudio();
+	std::cout << "Control loop: " << pLoopScheduler->GetNbTicks() << " ticks, " << pLoopScheduler->GetNbOverruns() << " overruns, " << pLoopScheduler->GetNbSkippedTicks() << " skipped ticks" << std::endl;
+	pHaptic->Terminate();
+}
+
+
+void Display::ExitProgram()
+{
+	// GLUT thread: exit is not called while the scheduler, writer and audio threads are running (glutMainLoop never returns, so the destructor is called here)
+	Display *pEndedDisplay = pDisplay;
+	if (pEndedDisplay != NULL)
+	{
+		pEndedDisplay->CloseBlock();
+		pDisplay = NULL; // the callbacks do nothing from now on
+		delete pEndedDisplay; // join the writer, frame capture and audio threads
+	}
+	exit(0);
+}
+
+
 void Display::InternalKeyboard(unsigned char ucKey, int iX, int iY)
 {
 	if (pDisplay != NULL)
@@ -445,46 +734,24 @@ void Display::DrawFloor()
 	glEnd();
 }
 
-void Display::DrawBall(GLfloat color[3])
+void Display::DrawBall(const DisplaySnapshot &frame, GLfloat color[3])
 {
-	double *cup = pHaptic->GetCurrentPosition();
-	double angle  = pModel->GetPendulumAngle(); 	
-	double ballPosition[3];
 	glPushMatrix();	// push and pop matrix are needed here because you do a translation of the frame (whereas you don't do any modification when drawing blocks etc...)
 	glColor3f(color[0], color[1], color[2]); 
-	// Compute ball position
-	if (!ballEscape) // ball in cup
-	{		
-		ballPosition[posX] = cup[posX]; // 2D model
-		ballPosition[posY] = cup[posY] + cupAdditionalVisualScalingFactor * pendulumLength * sin(angle);
-		ballPosition[posZ] = cup[posZ] + cupAdditionalVisualScalingFactor * pendulumLength * (1 - cos(angle));
-	}
-	else // flying ball motion
-	{
-		unsigned __int64 currentTimeStamp;
-		QueryPerformanceCounter((LARGE_INTEGER *)&currentTimeStamp);
-		double currentTime = (1. * currentTimeStamp) / timerFrequency; 
-		ballPosition[posX] = escapePosition[posX] + escapeVelocity[posX] * (currentTime - escapeTime);
-		ballPosition[posY] = escapePosition[posY] + escapeVelocity[posY] * (currentTime - escapeTime);
-		ballPosition[posZ] = escapePosition[posZ] + escapeVelocity[posZ] * (currentTime - escapeTime) - gravity / 2. * pow(currentTime - escapeTime, 2);		
-	}
-	glTranslatef(0., ballPosition[posY], ballPosition[posZ]); // The X (depth position) is set to 0 (should be cup[posX]+ball[posX] to be more general) otherwise ball disappears is the EE of the HM is not exactly on 0 on the X axis (i.e. if you push on the HM) (despite the spring to constrain the motion on the Y axis you can slighlty move in the other directions)
-	glutSolidSphere(ballRadius, ballNbSlices, ballNbSlices);
+	glTranslatef(0., frame.ballPosition[posY], frame.ballPosition[posZ]); // The X (depth position) is set to 0 (should be cup[posX]+ball[posX] to be more general) otherwise ball disappears is the EE of the HM is not exactly on 0 on the X axis (i.e. if you push on the HM) (despite the spring to constrain the motion on the Y axis you can slighlty move in the other directions)
+	glCallList(ballList);
 	glPopMatrix();
 }
 
-void Display::DrawCup(GLfloat color[3])
+void Display::DrawCup(const DisplaySnapshot &frame, GLfloat color[3])
 {
-	double *cup = pHaptic->GetCurrentPosition();
+	const double *cup = frame.cupPosition;
 
-	glLineWidth(2*blockLineWidth);
+	glPushMatrix(); // the shape of the cup is in the frame of the cup (see BuildDisplayLists)
 	glColor3f(color[0], color[1], color[2]);
-	glBegin(GL_LINE_STRIP);
-	for (unsigned int i=0; i<cupShapePoints.size(); i++)
-	{
-		glVertex3f(0., cupShapePoints[i].first + cup[posY], cupShapePoints[i].second + cup[posZ]);  // The X (depth position) is set to 0 (should be cup[posX] to be more general) otherwise cup disappears is the EE of the HM is not exactly on 0 on the X axis (i.e. if you push on the HM) (despite the spring to constrain the motion on the Y axis you can slighlty move in the other directions)
-	}
-	glEnd();
+	glTranslatef(0., cup[posY], cup[posZ]);  // The X (depth position) is set to 0 (should be cup[posX] to be more general) otherwise cup disappears is the EE of the HM is not exactly on 0 on the X axis (i.e. if you push on the HM) (despite the spring to constrain the motion on the Y axis you can slighlty move in the other directions)
+	glCallList(cupList);
+	glPopMatrix();
 }
 
 void Display::DrawTargetBlock()
@@ -531,15 +798,49 @@ void Display::DrawStatus(std::string text_str, GLfloat color[3], double position
 }
 
 
-void Display::DrawWindow(GLfloat currentStateColor[3])
+void Display::DrawWindow(const DisplaySnapshot &frame, GLfloat currentStateColor[3])
 {
 	// Object last drawn is on the upper layer
+	glCallList(sceneList); // floor, start and target blocks
+	DrawBall(frame, currentStateColor);
+	DrawCup(frame, cupColor);
+
+}
+
+
+int Display::BuildDisplayLists()
+{
+	// The floor, the blocks and the shapes of the cup and of the ball do not change during the block: they are sent once to the graphic card,
+	// then each frame only moves the cup and the ball (display lists of OpenGL 1.1, the vertex buffers need an extension loader with GLUT)
+	sceneList = glGenLists(3);
+	if (sceneList == 0)
+	{
+		std::cout << "Error: the display lists cannot be created" << std::endl;
+		return -1;
+	}
+	cupList = sceneList + 1;
+	ballList = sceneList + 2;
+
+	glNewList(sceneList, GL_COMPILE);
 	DrawFloor();
 	DrawStartBlock();
 	DrawTargetBlock();
-	DrawBall(currentStateColor);
-	DrawCup(cupColor);
+	glEndList();
 
+	// Cup in its own frame (the color is set by the caller)
+	glNewList(cupList, GL_COMPILE);
+	glLineWidth(2*blockLineWidth);
+	glBegin(GL_LINE_STRIP);
+	for (unsigned int i=0; i<cupShapePoints.size(); i++)
+		glVertex3f(0., cupShapePoints[i].first, cupShapePoints[i].second);
+	glEnd();
+	glEndList();
+
+	// Ball centered on 0 (the color is set by the caller)
+	glNewList(ballList, GL_COMPILE);
+	glutSolidSphere(ballRadius, ballNbSlices, ballNbSlices);
+	glEndList();
+	return 0;
 }
 
 void Display::Reshape(int iWidth, int iHeight)
@@ -564,6 +865,18 @@ void Display::InternalReshape(int iWidth, int iHeight)
 void Display::UpdateDisplay(void)
 {
 	char msg[1024]; 
+	GLfloat riskColor[3];
+	unsigned __int64 currentTimeStamp;
+	QueryPerformanceCounter((LARGE_INTEGER *)&currentTimeStamp);
+	double frameStartTime = (1. * currentTimeStamp) / timerFrequency;
+	if (isExitRequested) // END reached by the control loop
+	{
+		ExitProgram();
+		return;
+	}
+	DisplaySnapshot frame; // the state of the task itself is not read: a tick never waits for a frame
+	if (!GetDisplayFrame(frameStartTime, frame))
+		frame.status = INITIALIZING; // no tick yet
 
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
@@ -577,7 +890,7 @@ void Display::UpdateDisplay(void)
 	gluLookAt(eyeX, eyeY, eyeZ, centerX, centerY, centerZ, upX, upY, upZ);	
 
 	// Draw what need be depending on the status
-	switch (status)
+	switch (frame.status)
 	{
 	case INITIALIZING:
 		DrawStatus("Initializing", textColor, 0.75);
@@ -588,30 +901,33 @@ void Display::UpdateDisplay(void)
 		break;
 
 	case WAITFORSTART:
-		sprintf_s(msg, "Trial Nb:  %i ", trialNb);
+		sprintf_s(msg, "Trial Nb:  %i ", frame.trialNb);
 		DrawStatus(msg, textColor, 0.75);
-		DrawWindow(waitingColor);
+		DrawWindow(frame, waitingColor);
 		break;
 
 	case STARTMOTION:
 		sprintf_s(msg, "Go");
 		DrawStatus(msg, textColor, 0.75);
-		DrawWindow(activeColor);
+		DrawWindow(frame, activeColor);
 		break;
 
 	case INITIATEMOTION:
 		sprintf_s(msg, "Go");
 		DrawStatus(msg, textColor, 0.75);
-		DrawWindow(activeColor);
+		DrawWindow(frame, activeColor);
 		break;
 
 	case INMOTION:		
-		DrawWindow(activeColor);
-		if(!selfPaced && speedHint && averageUserFrequency!=0)
+		// The ball turns progressively to the failure color when the escape risk increases
+		for (int i=0; i<3; i++)
+			riskColor[i] = (GLfloat)((1. - frame.escapeRisk) * activeColor[i] + frame.escapeRisk * waitingColor[i]);
+		DrawWindow(frame, riskColor);
+		if(!selfPaced && speedHint && frame.averageUserFrequency!=0)
 		{
-			if (averageUserFrequency * goalOscillationPeriod > (1. + frequencyTolerance))
+			if (frame.averageUserFrequency * goalOscillationPeriod > (1. + frequencyTolerance))
 				sprintf_s(msg, "Slow down");
-			else if (averageUserFrequency * goalOscillationPeriod < (1. - frequencyTolerance))
+			else if (frame.averageUserFrequency * goalOscillationPeriod < (1. - frequencyTolerance))
 				sprintf_s(msg, "Go faster");
 			else
 				sprintf_s(msg, "Good job");
@@ -620,24 +936,122 @@ void Display::UpdateDisplay(void)
 		break;
 
 	case TERMINATEMOTION:
-		if (ballEscape)
-			DrawWindow(waitingColor);
+		if (frame.ballEscape)
+			DrawWindow(frame, waitingColor);
 		else
-			DrawWindow(successColor);
+			DrawWindow(frame, successColor);
 		break;
 
 	case ENDOFTRIAL:
-		if (ballEscape)
-			DrawWindow(waitingColor);
+		if (frame.ballEscape)
+			DrawWindow(frame, waitingColor);
 		else
-			DrawWindow(successColor);
+			DrawWindow(frame, successColor);
 		break;
 
 	case END:
 		break;
 	}
+	if (pFrameCapture != NULL)
+		CaptureFrame(frame); // back buffer, before the swap
 	glutSwapBuffers();
-	glutPostRedisplay();
+	glFinish(); // wait for the end of the swap (the driver does not queue frames ahead), its time gives the latency of the display
+	UpdateDisplayLatency(frameStartTime);
+	if (isVerticalSyncEnabled)
+		glutPostRedisplay(); // the swap waits for the vertical retrace: one frame per refresh of the screen
+	else if (!isRedisplayScheduled)
+	{
+		glutTimerFunc(DISPLAY_FALLBACK_PERIOD, InternalRedisplay, 0); // not as fast as possible
+		isRedisplayScheduled = true;
+	}
+	if (pScope != NULL && ++nbFramesSinceScope >= SCOPE_REFRESH_DIVIDER)
+	{
+		glutPostWindowRedisplay(scopeWindow);
+		nbFramesSinceScope = 0;
+	}
+}
+
+
+void Display::CaptureFrame(const DisplaySnapshot &frame)
+{
+	if (frame.status < WAITFORSTART || frame.status > ENDOFTRIAL)
+	{
+		pFrameCapture->ReadPendingFrames(); // last frames of the trial
+		return;
+	}
+	if (frame.trialNb != captureTrialNb)
+	{
+		captureTrialNb = frame.trialNb;
+		captureFrameNb = 0;
+	}
+	// The frames are numbered without gap (the dropped frames are only counted), so that the sequence can be read by video tools
+	if (pFrameCapture->Capture(frame.trialNb, captureFrameNb, glutGet(GLUT_WINDOW_WIDTH), glutGet(GLUT_WINDOW_HEIGHT)))
+		captureFrameNb++;
+}
+
+
+void Display::FlushFrameCapture()
+{
+	if (pFrameCapture == NULL)
+		return;
+	pFrameCapture->Flush();
+	std::cout << "Frame capture: " << pFrameCapture->GetNbWrittenFrames() << " frames written, " << pFrameCapture->GetNbDroppedFrames() << " dropped (disk too slow), " << pFrameCapture->GetNbFailedFrames() << " could not be written" << std::endl;
+}
+
+
+void Display::PushScopeSample(double timeStep)
+{
+	double values[SCOPE_NB_CHANNELS];
+	values[0] = pModel->GetPendulumAngle() * 180. / M_PI;
+	values[1] = pHaptic->GetCurrentVelocity()[axisOfMotion];
+	values[2] = isTickBallForceComputed ? tickBallForce : 0.; // no force is sent to the HM in the other states
+	values[3] = 1000. * timeStep;
+	pScope->Push(currentTime, values);
+}
+
+
+void Display::CreateScopeWindow()
+{
+	// Fixed ranges (extended by the scope if the values go beyond), the edges of the cup and the nominal period are drawn as references
+	double edge = arcOfCup / 2. * 180. / M_PI;
+	pScope->SetChannel(0, "Pendulum angle (deg)", -edge, edge);
+	pScope->AddReference(0, edge);
+	pScope->AddReference(0, -edge);
+	pScope->SetChannel(1, "Cup velocity (m/s)", -1., 1.);
+	pScope->SetChannel(2, "Ball force (N)", -pendulumMass * gravity, pendulumMass * gravity);
+	pScope->AddReference(2, 0.);
+	pScope->SetChannel(3, "Loop period (ms)", 0., 2. * loopPeriod);
+	pScope->AddReference(3, loopPeriod);
+
+	// Without vertical synchronization: the swap of the scope must not wait for a retrace and delay the next frame of the subject
+	glutInitWindowSize(SCOPE_WINDOW_WIDTH, SCOPE_WINDOW_HEIGHT);
+	glutInitWindowPosition(windowPosX + windowSizeX, windowPosY);
+	scopeWindow = glutCreateWindow("Scope");
+	glClearColor(0.f, 0.f, 0.f, 1.f);
+	typedef BOOL (WINAPI *SwapIntervalFunction)(int interval);
+	SwapIntervalFunction wglSwapIntervalEXT = (SwapIntervalFunction)wglGetProcAddress("wglSwapIntervalEXT");
+	if (wglSwapIntervalEXT != NULL)
+		wglSwapIntervalEXT(0);
+	glutDisplayFunc(InternalUpdateScope);
+	glutKeyboardFunc(InternalKeyboard);
+	glutSetWindow(mainWindow);
+}
+
+
+void Display::UpdateScope()
+{
+	pScope->Draw();
+	glutSwapBuffers();
+}
+
+
+void Display::CloseAudio()
+{
+	if (pAudio == NULL)
+		return;
+	pAudio->Stop();
+	pAudio->WriteOnsets("Output/" + blockName + "_cues.csv");
+	std::cout << "Audio: " << pAudio->GetNbOnsets() << " cues played, " << pAudio->GetNbUnderruns() << " underruns" << std::endl;
 }
 
 
@@ -648,8 +1062,34 @@ void Display::InternalUpdateDisplay(void)
 }
 
 
+void Display::InternalRedisplay(int value)
+{
+	if (pDisplay != NULL)
+		pDisplay->isRedisplayScheduled = false;
+	glutPostRedisplay();
+}
+
+
+void Display::InternalUpdateScope(void)
+{
+	if (pDisplay != NULL && pDisplay->pScope != NULL)
+		pDisplay->UpdateScope();
+}
+
+
 int Display::Initialize(int argc, char** argv)
 {
+	// The escape-risk table must have been computed for this block (checked once all the parameters are set)
+	if (pViability != NULL && !pViability->IsCompatible(pendulumMass, pendulumLength, pendulumDamping, arcOfCup, gravity, accelerationAmplificationFactor * maxCartAcceleration, loopPeriod / 1000.))
+	{
+		std::cout << "Viability table was computed for other cart-pendulum parameters, generate it again to get the escape risk" << std::endl;
+		delete pViability;
+		pViability = NULL;
+	}
+
+	// Trials of the previous runs which were interrupted before their data files were written (crash, power loss), then journal the next ones
+	pTrialWriter->OpenJournal("Output/", "Output/" + blockName + ".journal");
+
 	// Starts with HM initialization
 	if(pHaptic->InitHapticMaster() != 0) // HM initialization failed
 		return -1;
@@ -659,16 +1099,48 @@ int Display::Initialize(int argc, char** argv)
 	glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH);
 	glutInitWindowSize(windowSizeX, windowSizeY);
 	glutInitWindowPosition(windowPosX, windowPosY);
-	glutCreateWindow(windowName);
+	mainWindow = glutCreateWindow(windowName);
 
 	// Set background color
 	glClearColor(backgroundColor[0], backgroundColor[1], backgroundColor[2], backgroundColor[3]);
 
+	// One frame per refresh of the screen: the swap of the buffers waits for the vertical retrace (WGL_EXT_swap_control, the function is given by the driver)
+	typedef BOOL (WINAPI *SwapIntervalFunction)(int interval);
+	SwapIntervalFunction wglSwapIntervalEXT = (SwapIntervalFunction)wglGetProcAddress("wglSwapIntervalEXT");
+	isVerticalSyncEnabled = (wglSwapIntervalEXT != NULL && wglSwapIntervalEXT(1));
+	if (!isVerticalSyncEnabled)
+		std::cout << "Vertical synchronization not available, the display is redrawn every " << DISPLAY_FALLBACK_PERIOD << " ms" << std::endl;
+
 	// OpenGL Initialization Calls
 	glutReshapeFunc(InternalReshape);
 	glutDisplayFunc(InternalUpdateDisplay);
 	glutKeyboardFunc(InternalKeyboard);
-	glutTimerFunc(loopPeriod, InternalTimer, loopTimerID);
+
+	// The size of the cup is set before Initialize
+	if (BuildDisplayLists() != 0)
+		return -1;
+
+	// The scope has its own window and OpenGL context (the display lists above are not shared with it)
+	if (pScope != NULL)
+		CreateScopeWindow();
+
+	// The cues are decoded, the audio thread mixes them from now on (a sink which cannot be opened is reported, the task goes on without sound)
+	pAudio->Start(audioSink, "Output/" + blockName + "_audio.wav");
+
+	// Recording in chunks: the slots of the writer are prepared once for the whole block, the control loop never waits for the writer
+	if (recordingChunkDuration > 0.)
+	{
+		recordingChunkNbSamples = (unsigned int)(recordingChunkDuration * 1000. / loopPeriod) + 1;
+		pRecorder->Reserve(recordingChunkNbSamples);
+		pTrialWriter->PrepareChunks(*pRecorder, recordingChunkNbSamples);
+	}
+
+	if (realTimePriority != REAL_TIME_OFF)
+		PrepareRealTime();
+
+	// Control loop at a fixed rate, independent of the GLUT event loop
+	if (pLoopScheduler->Start(loopPeriod, InternalTimer, loopTimerID) != 0)
+		return -1;
 
 	return 0;
 }
@@ -680,90 +1152,344 @@ void Display::LaunchLoop()
 }
 
 
-// Data are recorded as a .csv file, but can be converted into a .mat file using the csv2mat.m script provided
-void Display::WriteDataInFile()
+void Display::SetLatencyCompensation(double delay)
 {
-	char nbTrialChar[4]; // should be enough, less that 1000 trials + end character
-	_itoa_s(trialNb, nbTrialChar, 10);
-	std::string filename = "Output/" + blockName + "_trial_" + (std::string)nbTrialChar + ".csv";	
-	const char * filenameChar = filename.c_str();
-	double nb_lines_header = 21; // Does not include names and units of variables
-	std::ofstream data_file(filenameChar);
-	if (data_file)
-	{
-		// First write parameters used for the trial
-		data_file << "RythmicTask"  << ";" << nb_lines_header << std::endl;
-		data_file << "TrialNumber" << ";" << trialNb  << ";" << "N/A" << std::endl;
-		data_file << "Success" << ";" << !ballEscape  << ";" << "(bool)" << std::endl;
-		data_file << "TrialDuration" << ";" << durationOneTrial  << ";" << "(s)" << std::endl; // can be shorter than the actual recorded data in cas autoStart is off and user does not start motion exactly at the starting cue
-		data_file << "IsSelfPaced" << ";" << selfPaced  << ";" << "(bool" << std::endl;
-		data_file << "IsSpeedHint" << ";" << speedHint << ";" << "(bool)" << std::endl;
-		if (selfPaced)
-			data_file << "GoalOscillationFrequency" << ";" << "N/A"  << ";" << "(Hz)" << std::endl; 
+	measurementDelay = delay;
+}
+
+
+void Display::SetSmallAngleApproximation(double angleThreshold)
+{
+	smallAngleThreshold = angleThreshold;
+	pModel->SetSmallAngleApproximation(angleThreshold);
+}
+
+
+int Display::SetOutputFormat(int format)
+{
+	if (format != TRIAL_FILE_CSV && format != TRIAL_FILE_CSV_EXACT && format != TRIAL_FILE_BINARY && format != TRIAL_FILE_COMPRESSED && format != TRIAL_FILE_MAT && format != TRIAL_FILE_BLOCK)
+	{
+		std::cout << "Unknown output format " << format << ", the data files are written in CSV" << std::endl;
+		outputFormat = TRIAL_FILE_CSV;
+		return -1;
+	}
+	outputFormat = format;
+	return 0;
+}
+
+
+int Display::SetRecordingChunkDuration(double duration)
+{
+	if (duration < 0.)
+	{
+		std::cout << "The recording chunk duration must be positive (0: no chunks), the whole trials are kept in memory" << std::endl;
+		recordingChunkDuration = 0.;
+		return -1;
+	}
+	recordingChunkDuration = duration;
+	return 0;
+}
+
+
+int Display::SetAuxiliaryChannels(int decimation)
+{
+	if (decimation < 0)
+	{
+		std::cout << "Decimation of the auxiliary channels must be positive, they are not recorded" << std::endl;
+		return -1;
+	}
+	if (decimation == 0 || auxiliaryChannelDecimation != 0)
+		return 0;
+	auxiliaryChannelDecimation = decimation;
+
+	// Full 3D motion of the HM and force sent to the HM (in the axes of the HM), averaged over the decimation window (the measured force is already recorded at each tick)
+	const char *axes[3] = {"X", "Y", "Z"};
+	int axis[3] = {posX, posY, posZ};
+	for (int i=0; i<3; i++)
+		pChannels->Add(std::string("HM_Pos_") + axes[i], "(m)", &pHaptic->GetCurrentPosition()[axis[i]], decimation, CHANNEL_FILTER_MEAN);
+	for (int i=0; i<3; i++)
+		pChannels->Add(std::string("HM_Vel_") + axes[i], "(m/s)", &pHaptic->GetCurrentVelocity()[axis[i]], decimation, CHANNEL_FILTER_MEAN);
+	for (int i=0; i<3; i++)
+		pChannels->Add(std::string("HM_Acc_") + axes[i], "(m/s/s)", &pHaptic->GetCurrentAcceleration()[axis[i]], decimation, CHANNEL_FILTER_MEAN);
+	for (int i=0; i<3; i++)
+		pChannels->Add(std::string("Commanded_Ball_Force_") + axes[i], "(N)", &pHaptic->GetCommandedBallForce()[axis[i]], decimation, CHANNEL_FILTER_MEAN);
+	// Springs and task: distance to the springs and states, which are sampled (a mean of states has no meaning)
+	for (int i=0; i<3; i++)
+		pChannels->Add(std::string("Spring_Drift_") + axes[i], "(m)", &pHaptic->GetSpringDrift()[axis[i]], decimation, CHANNEL_FILTER_MEAN);
+	pChannels->Add("Start_Spring_Enabled", "(bool)", &pHaptic->GetSpringStates()[SPRING_STATE_START_ENABLED], decimation);
+	pChannels->Add("Start_Spring_Pos", "(m)", &pHaptic->GetSpringStates()[SPRING_STATE_START_POSITION], decimation);
+	pChannels->Add("Constraint_Springs", "(0: smooth, 1: 1D motion)", &pHaptic->GetSpringStates()[SPRING_STATE_CONSTRAINT], decimation);
+	pChannels->Add("Damper_Enabled", "(bool)", &pHaptic->GetSpringStates()[SPRING_STATE_DAMPER_ENABLED], decimation);
+	pChannels->Add("Status", "(see display.h)", &tickStatus, decimation);
+	return 0;
+}
+
+
+int Display::SetLoopOverrunPolicy(int policy)
+{
+	if (pLoopScheduler->SetOverrunPolicy(policy) != 0)
+	{
+		std::cout << "Unknown overrun policy of the control loop: " << policy << ", the late ticks are skipped" << std::endl;
+		return -1;
+	}
+	return 0;
+}
+
+
+void Display::SetLoopTimeBudget(double budget)
+{
+	pLoopTiming->SetBudget(budget);
+}
+
+
+int Display::SetRealTimeMode(int priority, int cpu)
+{
+	if (priority != REAL_TIME_OFF && priority != REAL_TIME_HIGH && priority != REAL_TIME_REALTIME)
+	{
+		std::cout << "Unknown real-time priority: " << priority << ", the real-time mode is not used" << std::endl;
+		return -1;
+	}
+	realTimePriority = priority;
+	realTimeCpu = cpu;
+	pLoopScheduler->SetRealTime(priority, cpu);
+	return 0;
+}
+
+
+void Display::SetDisplayPrediction(double horizon)
+{
+	displayPredictionHorizon = max(horizon, 0.);
+}
+
+
+void Display::SetFrameCapture(bool capture)
+{
+	if (capture && pFrameCapture == NULL)
+		pFrameCapture = new FrameCapture("Output/" + blockName, windowSizeX, windowSizeY);
+}
+
+
+void Display::SetScopeWindow(bool scope)
+{
+	if (scope && pScope == NULL)
+		pScope = new Scope();
+}
+
+
+void Display::SetMaxCartAcceleration(double maxAcceleration)
+{
+	maxCartAcceleration = maxAcceleration;
+}
+
+
+int Display::SetAudioSink(int sink)
+{
+	if (sink != AUDIO_SINK_DEVICE && sink != AUDIO_SINK_NULL && sink != AUDIO_SINK_FILE)
+	{
+		std::cout << "Unknown audio sink " << sink << ", the cues are played on the audio device" << std::endl;
+		audioSink = AUDIO_SINK_DEVICE;
+		return -1;
+	}
+	audioSink = sink;
+	return 0;
+}
+
+
+int Display::SetCupProfile(const std::vector<double> &knots)
+{
+	if (knots.empty()) // circular cup
+		return 0;
+	CupProfile *profile = new CupProfile();
+	if (profile->Build(knots) != 0)
+	{
+		std::cout << "Cup profile is not valid, the circular cup is used" << std::endl;
+		delete profile;
+		return -1;
+	}
+	if (pCupProfile != NULL)
+		delete pCupProfile;
+	pCupProfile = profile;
+	cupProfileKnots = knots;
+	pModel->SetCupProfile(pCupProfile);
+
+	// The equivalent pendulum is the osculating circle at the bottom of the cup, and the ball escapes when its slope angle is beyond the edge
+	pendulumLength = pCupProfile->GetBottomRadius();
+	arcOfCup = 2. * pCupProfile->GetEdgeAngle();
+	ComputeCupGeometry();
+
+	// The viability table is computed for a circular cup only
+	if (pViability != NULL)
+	{
+		std::cout << "Viability table is not valid for a non-circular cup, escape risk is not computed" << std::endl;
+		delete pViability;
+		pViability = NULL;
+	}
+	return 0;
+}
+
+
+void Display::ComputeCupGeometry()
+{
+	if (pCupProfile == NULL)
+	{
+		cupWidth = 2 * pendulumLength * sin(0.5 * arcOfCup);
+		cupHeight = pendulumLength * (1 - cos(0.5 * arcOfCup));
+	}
+	else
+	{
+		double edgeHorizontal, edgeVertical;
+		pCupProfile->GetBallPosition(pCupProfile->GetEdgeAngle(), edgeHorizontal, edgeVertical);
+		cupWidth = 2 * edgeHorizontal;
+		cupHeight = edgeVertical;
+	}
+	targetWidth = max(amplitudeFactorAccuracy, 1.1) * cupWidth; // target must be larger that cup so that cup can fits entirely into target box (this is how motion is target is considered to be reached)
+
+	// Update target width and height for visual block 
+	targetWidth *= cupAdditionalVisualScalingFactor;
+	cupHeight *= cupAdditionalVisualScalingFactor;
+	ballRadius = 0.1 * cupWidth * cupAdditionalVisualScalingFactor; // size of ball does not have any impact on the mechanical model. Defined as a percentage of the horizontal width of the cup
+
+	// Create an array of points which - once joined - form the arc for the cup (centered on (0,0), real position adapted after according to the position of the HM end-effector)
+	// The cup is defined by both the pendulum length (curvature of the cup) and the portion of the total circle which is kept to represent the cup (defined by an angle)
+	// For a non-circular cup, the points are read in the profile table and offset by the ball radius along the normal to the cup, like for the circular cup
+	cupShapePoints.clear();
+	int nbPoints = 100;	
+	for (int i=0; i<nbPoints+1; i++)
+	{
+		double angle = ((i *1.0) / nbPoints * arcOfCup - arcOfCup / 2.);
+		if (pCupProfile == NULL)
+			cupShapePoints.push_back(std::pair<double,double>(cupAdditionalVisualScalingFactor * (pendulumLength + ballRadius) * sin(angle), cupAdditionalVisualScalingFactor * (pendulumLength + ballRadius) * (1 - cos(angle)) - ballRadius));
 		else
-			data_file << "GoalOscillationFrequency" << ";" << 1. / goalOscillationPeriod  << ";" << "(Hz)" << std::endl; 
-		data_file << "StartToTargetDistance" << ";" << targetPosition[axisOfMotion] - startPosition[axisOfMotion]  << ";" << "(m)" << std::endl;
-		data_file << "HMInertia" << ";" << inertiaHM  << ";" << "(kg)" << std::endl;
-		data_file << "PendulumMass" << ";" << pendulumMass  << ";" << "(kg)" << std::endl;
-		data_file << "PendulumDamping" << ";" << pendulumDamping  << ";" << "(N.m.s)" << std::endl;
-		data_file << "PendulumLength" << ";" << pendulumLength  << ";" << "(m)" << std::endl;
-		data_file << "ArcOfCup" << ";" << arcOfCup  << ";" << "(rad)" << std::endl;
-		data_file << "PendulumInitialAngle" << ";" << pendulumInitialAngle  << ";" << "(rad)" << std::endl;
-		data_file << "PendulumInitialVelocity" << ";" << pendulumInitialVelocity  << ";" << "(rad/s)" << std::endl;
-		data_file << "AmplitudeAccuracyFactor" << ";" << amplitudeFactorAccuracy  << ";" << "(block width=factor*cup width)" << std::endl;
-		data_file << "CartAccelerationAmplificationFactor" << ";" << accelerationAmplificationFactor  << ";" << "N/A" << std::endl;
-		data_file << "VisualScalingFactor" << ";" << visualScalingFactor  << ";" << "(visual=factor*real)" << std::endl;
-		data_file << "CupAdditionalVisualScalingFactor" << ";" << cupAdditionalVisualScalingFactor << ";" << "(visual_cup=additionalFactor*visualFactor*real)" << std::endl; // also affect the tolerance to reach the target
-		data_file << "AutoStartMode" << ";" << autoStartMode  << ";" << "(bool)" << std::endl;
-		data_file << "CanBallEscape" << ";" << canBallEscape  << ";" << "(bool)" << std::endl;
-
-		// Then write the actual data (we only care about the Y motion of teh cart)
-		data_file <<	"Time" << ";" << "Pendulum_Angle"  << ";" << "Pendulum_AngularVel"  << ";" << "Pendulum_AngularAcc"  << ";" << 
-						"Cart_Pos_X"  << ";" << "Cart_Vel_X"  << ";" << "Cart_Acc_X"  << ";" << 
-						"Ball_Force"  << ";" << "User_Force_X" << ";" << "User_Force_Y" << ";" << "User_Force_Z" << std::endl;
-		data_file <<	"(s)" << ";" << "(rad)"  << ";" << "(rad/s)"  << ";" << "(rad/s/s)"  << ";" << 
-						"(m)"  << ";" << "(m/s)"  << ";" << "(m/s/s)"  << ";" << 
-						"(N)"  << ";" << "(N)" << ";" << "(N)" << ";" << "(N)" << std::endl;
-
-		// Evene if all vectorsa are supposed to be the same length, still check and take the minimum length, just in case
-		unsigned int nbLinesPosP = pendulumAngleData.size();
-		unsigned int nbLinesVelP = pendulumAngularVelocityData.size();
-		unsigned int nbLinesAccP = pendulumAngularAccelerationData.size();
-		unsigned int nbLinesPosC = cartPositionData.size();
-		unsigned int nbLinesVelC = cartVelocityData.size();
-		unsigned int nbLinesAccC = cartAccelerationData.size();
-		unsigned int nbLinesForce = pendulumForceData.size(); 
-		unsigned int nbLinesUserForce = min(userForce[posX].size(), min(userForce[posY].size(), userForce[posZ].size()));
-		unsigned int nbLines = min(timeData.size(), min(nbLinesPosP, min(nbLinesVelP, min(nbLinesAccP, min(nbLinesPosC, min(nbLinesVelC, min(nbLinesAccC, min(nbLinesForce, nbLinesUserForce))))))));
-		while (nbLines > 0)
 		{
-			// Drop data in file
-			data_file << timeData.front() << ";" << 
-				pendulumAngleData.front() << ";" << pendulumAngularVelocityData.front() << ";" << pendulumAngularAccelerationData.front() << ";" <<
-				cartPositionData.front() << ";" << cartVelocityData.front() << ";" << cartAccelerationData.front() << ";" <<
-				pendulumForceData.front() << ";" <<
-				userForce[posX].front() << ";" << userForce[posY].front() << ";" << userForce[posZ].front() << std::endl; 
-			// Remove first element (oldest) in queues
-			timeData.pop();
-			pendulumAngleData.pop();
-			pendulumAngularVelocityData.pop();
-			pendulumAngularAccelerationData.pop();
-			cartPositionData.pop();
-			cartVelocityData.pop();
-			cartAccelerationData.pop();
-			pendulumForceData.pop();
-			for(int i=0; i<3; i++)
-				userForce[i].pop();
-			nbLines--;
+			double horizontal, vertical;
+			pCupProfile->GetBallPosition(angle, horizontal, vertical);
+			cupShapePoints.push_back(std::pair<double,double>(cupAdditionalVisualScalingFactor * (horizontal + ballRadius * sin(angle)), cupAdditionalVisualScalingFactor * (vertical + ballRadius * (1 - cos(angle))) - ballRadius));
 		}
 	}
+}
+
+
+// Data are recorded as a .csv file (converted into a .mat file using the csv2mat.m script provided), or directly in a .mat file (see SetOutputFormat)
+void Display::WriteDataInFile()
+{
+	double nb_lines_header = 34; // Does not include names and units of variables
+	// Only the parameters are gathered here, the file is opened and the samples are written by the writer thread so that the control loop is not stopped
+	// First the parameters used for the trial
+	trialHeader.Clear("RythmicTask", nb_lines_header);
+	trialHeader.AddInt("TrialNumber", trialNb, "N/A");
+	trialHeader.AddBool("Success", !ballEscape, "(bool)");
+	trialHeader.AddDouble("TrialDuration", durationOneTrial, "(s)"); // can be shorter than the actual recorded data in cas autoStart is off and user does not start motion exactly at the starting cue
+	trialHeader.AddBool("IsSelfPaced", selfPaced, "(bool");
+	trialHeader.AddBool("IsSpeedHint", speedHint, "(bool)");
+	if (selfPaced)
+		trialHeader.AddNotAvailable("GoalOscillationFrequency", "(Hz)");
+	else
+		trialHeader.AddDouble("GoalOscillationFrequency", 1. / goalOscillationPeriod, "(Hz)");
+	trialHeader.AddDouble("StartToTargetDistance", targetPosition[axisOfMotion] - startPosition[axisOfMotion], "(m)");
+	trialHeader.AddDouble("HMInertia", inertiaHM, "(kg)");
+	trialHeader.AddDouble("PendulumMass", pendulumMass, "(kg)");
+	trialHeader.AddDouble("PendulumDamping", pendulumDamping, "(N.m.s)");
+	trialHeader.AddDouble("PendulumLength", pendulumLength, "(m)");
+	trialHeader.AddDouble("ArcOfCup", arcOfCup, "(rad)");
+	trialHeader.AddDouble("PendulumInitialAngle", pendulumInitialAngle, "(rad)");
+	trialHeader.AddDouble("PendulumInitialVelocity", pendulumInitialVelocity, "(rad/s)");
+	trialHeader.AddDouble("AmplitudeAccuracyFactor", amplitudeFactorAccuracy, "(block width=factor*cup width)");
+	trialHeader.AddDouble("CartAccelerationAmplificationFactor", accelerationAmplificationFactor, "N/A");
+	trialHeader.AddDouble("VisualScalingFactor", visualScalingFactor, "(visual=factor*real)");
+	trialHeader.AddDouble("CupAdditionalVisualScalingFactor", cupAdditionalVisualScalingFactor, "(visual_cup=additionalFactor*visualFactor*real)"); // also affect the tolerance to reach the target
+	trialHeader.AddBool("AutoStartMode", autoStartMode, "(bool)");
+	trialHeader.AddBool("CanBallEscape", canBallEscape, "(bool)");
+	trialHeader.AddDouble("LatencyCompensation", measurementDelay, "(s, 0: none, -1: estimated round trip)");
+	trialHeader.AddVector("CupProfileKnots", cupProfileKnots, "(m, x0,z0,x1,z1,... N/A: circular cup)");
+	trialHeader.AddDouble("SmallAngleThreshold", smallAngleThreshold, "(rad, 0: RK4 only)");
+	trialHeader.AddInt("SmallAngleModelSteps", pModel->GetNbAnalyticSteps(), "N/A");
+	trialHeader.AddInt("RK4ModelSteps", pModel->GetNbNumericSteps(), "N/A");
+	if (pViability != NULL)
+		trialHeader.AddDouble("ViabilityLossTime", viabilityLossTime, "(s, -1: ball could always be saved)");
 	else
-		std::cout << "Error on file opening" << std::endl;
+		trialHeader.AddNotAvailable("ViabilityLossTime", "(s, -1: ball could always be saved)");
+	trialHeader.AddInt("AuxiliaryChannelDecimation", auxiliaryChannelDecimation, "(ticks, 0: not recorded)");
+	// Metronome: scheduled and played bips, on the time of the recorded samples (N/A: self-paced)
+	trialHeader.AddVector("MetronomeBeatTimes", beatTimes, "(s)");
+	trialHeader.AddVector("MetronomeOnsets", beatOnsets, "(s, first sample played, estimated from the clock of the audio device)");
+	// Timing of the control loop since the end of the previous trial (see loopTiming.h)
+	trialHeader.AddDouble("LoopTimeBudget", pLoopTiming->GetBudget(), "(s)");
+	trialHeader.AddInt("TicksOverBudget", pLoopTiming->GetTrialNbOverBudget(), "N/A");
+	trialHeader.AddDouble("MaxTickDuration", pLoopTiming->GetTrialMax(LOOP_PHASE_TICK), "(s)");
+	trialHeader.AddDouble("LoopPeriodJitter", pLoopTiming->GetTrialStd(LOOP_PHASE_PERIOD), "(s, standard deviation of the period)");
+
+	// Then the actual data (we only care about the Y motion of teh cart): names and units of the recorded channels, and samples
+	SubmitDataFile();
+	pLoopTiming->EndTrial(trialNb);
+}
+
+
+bool Display::SubmitDataFile()
+{
+	// The writer never waits: if its queue is full (the disk is much slower than the trials), the samples stay in the recorder and the trial stays
+	// in ENDOFTRIAL until they are queued, at a next tick
+	bool wasDataFilePending = isDataFilePending;
+	isDataFilePending = !pTrialWriter->Submit(trialNb, dataFilename, outputFormat, trialHeader, *pRecorder);
+	if (isDataFilePending && !wasDataFilePending)
+		nbDelayedDataFiles++;
+	return !isDataFilePending;
+}
+
+
+void Display::UpdateDataFilename()
+{
+	char nbTrialChar[4]; // should be enough, less that 1000 trials + end character
+	_itoa_s(trialNb, nbTrialChar, 10);
+	dataFilename = "Output/" + blockName + "_trial_" + (std::string)nbTrialChar + ((outputFormat == TRIAL_FILE_BINARY) ? ".bin" : ((outputFormat == TRIAL_FILE_COMPRESSED) ? ".cbin" : ((outputFormat == TRIAL_FILE_MAT) ? ".mat" : ".csv")));
+	if (outputFormat == TRIAL_FILE_BLOCK)
+		dataFilename = "Output/" + blockName + ".blk"; // one file for all the trials of the block
+}
+
+
+void Display::ScheduleMetronome()
+{
+	// Each bip is scheduled from userStartTime: the audio thread keeps their intervals exact, the ticks of the loop only need to come before them
+	while (userStartTime + (nbScheduledBeats + 1) * goalOscillationPeriod / 2. < currentTime + METRONOME_SCHEDULE_AHEAD)
+	{
+		double delay = (nbScheduledBeats + 1) * goalOscillationPeriod / 2.;
+		if (delay > durationOneTrial)
+			break;
+		if (!pAudio->PlayAt(bipCue, userStartTime, delay)) // no audio, or the queue is full (tried again at the next tick)
+			break;
+		if (beatTimes.size() < beatTimes.capacity())
+			beatTimes.push_back(userStartTime + delay - startTime);
+		nbScheduledBeats++;
+	}
+}
+
+
+void Display::ReadMetronomeOnsets()
+{
+	unsigned int nbOnsets = pAudio->GetNbOnsets();
+	for (; nbReadOnsets<nbOnsets; nbReadOnsets++)
+	{
+		AudioOnset onset = pAudio->GetOnset(nbReadOnsets);
+		if (onset.cue == bipCue && onset.scheduledTime > 0. && beatOnsets.size() < beatOnsets.capacity()) // not the bip of the start
+			beatOnsets.push_back(onset.onsetTime - startTime);
+	}
+}
+
+
+void Display::CheckDataFiles()
+{
+	// The data files are written in the background, report the ones which could not be written
+	int failedTrial = pTrialWriter->GetFailedTrial();
+	while (failedTrial >= 0)
+	{
+		std::cout << "Error on file opening (trial " << failedTrial << ")" << std::endl;
+		failedTrial = pTrialWriter->GetFailedTrial();
+	}
 }
 
 
 void Display::StartRecording()
 {
+	pChannels->Reset();
 	isRecording = true;
 }
 
@@ -774,58 +1500,54 @@ void Display::StopRecording()
 }
 
 
-void Display::RecordMotionData() // most functions called here are already called in Timer, so it is not very efficient in term of computation time. If computation time is an issue, modify here to prevent calling the same function twice in one controller loop
+void Display::RecordMotionData()
 {
 	if (pHaptic != NULL)
 	{
-		// Get time
-		unsigned __int64 currentTimeStamp;
-		QueryPerformanceCounter((LARGE_INTEGER *)&currentTimeStamp);
-		double currentTime = (1. * currentTimeStamp) / timerFrequency; 	
-		double pendulumAngle = pModel->GetPendulumAngle();
-		double pendulumAngularVelocity = pModel->GetPendulumAngularVelocity();
-		double pendulumAngularAcceleration = pModel->GetPendulumAngularAcceleration();
-		double cartPosition = pHaptic->GetCurrentPosition()[axisOfMotion];
-		double cartVelocity = pHaptic->GetCurrentVelocity()[axisOfMotion];
-		double cartAcceleration = pHaptic->GetCurrentAcceleration()[axisOfMotion]; // since the data to record are read after the ball force on the cup is applied, the acceleration here already contains the acceleration amplification gain (however the velocity does not include the gain)
-		double pendulumForce = pModel->ComputePendulumForceOnCart(cartAcceleration);
-		double *userExtForce = pHaptic->GetCurrentForce();
-
-		timeData.push(currentTime - startTime);
-		pendulumAngleData.push(pendulumAngle);
-		pendulumAngularVelocityData.push(pendulumAngularVelocity);
-		pendulumAngularAccelerationData.push(pendulumAngularAcceleration);
-		cartPositionData.push(cartPosition);
-		cartVelocityData.push(cartVelocity);
-		cartAccelerationData.push(cartAcceleration);  
-		pendulumForceData.push(pendulumForce);
-		for(int i=0; i<3; i++)
-			userForce[i].push(userExtForce[i]);
+		// Most of the recorded values were computed by the control during this tick, the channels read them where they are (see the constructor)
+		// The model state is read here because the model is not updated in all the states of the task
+		tickTime = currentTime - startTime;
+		tickStatus = status;
+		tickPendulumAngle = pModel->GetPendulumAngle();
+		tickPendulumAngularVelocity = pModel->GetPendulumAngularVelocity();
+		tickPendulumAngularAcceleration = pModel->GetPendulumAngularAcceleration();
+		if (!isTickBallForceComputed)
+			tickBallForce = pModel->ComputePendulumForceOnCart(pHaptic->GetCurrentAcceleration()[axisOfMotion]);
+		pChannels->Record();
+
+		// Full chunk: written during the trial (if the writer is late, the chunk keeps growing until the next sample)
+		if (recordingChunkNbSamples > 0 && pRecorder->GetNbSamples() >= recordingChunkNbSamples)
+			pTrialWriter->SubmitChunk(trialNb, dataFilename, *pRecorder);
 	}
 
 }
 
 void Display::ClearDataBuffer()
 {
-	// Clear queues 
-	while (!timeData.empty())
-		timeData.pop();
-	while (!pendulumAngleData.empty())
-		pendulumAngleData.pop();
-	while (!pendulumAngularVelocityData.empty())
-		pendulumAngularVelocityData.pop();
-	while (!pendulumAngularAccelerationData.empty())
-		pendulumAngularAccelerationData.pop();
-	while (!cartPositionData.empty())
-		cartPositionData.pop();
-	while (!cartVelocityData.empty())
-		cartVelocityData.pop();
-	while (!cartAccelerationData.empty())
-		cartAccelerationData.pop();
-	while (!pendulumForceData.empty())
-		pendulumForceData.pop();
-	for(int i=0; i<3; i++)
-		while(!userForce[i].empty())
-			userForce[i].pop();
+	// Forget the previous trial and make sure the longest expected trial (or one chunk) can be recorded without allocating memory in the control loop
+	UpdateDataFilename();
+	pRecorder->Clear();
+	if (recordingChunkNbSamples > 0)
+		pRecorder->Reserve(recordingChunkNbSamples); // the slots of the writer were prepared in Initialize
+	else
+		pRecorder->Reserve((unsigned int)(maxRecordingDuration * 1000. / loopPeriod) + 1);
+}
 
+
+void Display::PrepareRealTime()
+{
+	// Buffers of all the trials of the block allocated now (the memory is written, so that its pages are present), for the recorder and for each slot of the writer
+	unsigned int nbSamples = (unsigned int)(maxRecordingDuration * 1000. / loopPeriod) + 1;
+	if (recordingChunkNbSamples > 0)
+		nbSamples = recordingChunkNbSamples; // as in ClearDataBuffer
+	pRecorder->Reserve(nbSamples);
+	pTrialWriter->Reserve(*pRecorder, nbSamples);
+
+	// Then Windows does not take the pages of the program out of the RAM
+	LockWorkingSet();
+	LockMemory(pModel, sizeof(Model), "model");
+
+	// The display (this thread) and the writer do not compete with the control loop for its CPU
+	if (realTimeCpu >= 0 && KeepThreadOffCpu(GetCurrentThread(), realTimeCpu) == 0 && KeepThreadOffCpu(pTrialWriter->GetThreadHandle(), realTimeCpu) == 0)
+		std::cout << "Real-time mode: other threads off CPU " << realTimeCpu << " OK" << std::endl;
 }
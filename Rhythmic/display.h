@@ -5,8 +5,6 @@
 #include "stdlib.h" // needed otherwise conflict with glut
 #include <GL/glut.h>
 #include <string>
-#include <queue>
-#include <deque>
 #include <vector>
 #include <iostream>
 #include <fstream>
@@ -14,6 +12,18 @@
 #include "math.h"
 #include "model.h"
 #include "haptic.h"
+#include "viability.h"
+#include "recorder.h"
+#include "channelList.h"
+#include "trialWriter.h"
+#include "loopScheduler.h"
+#include "loopTiming.h"
+#include "snapshotBuffer.h"
+#include "frameCapture.h"
+#include "scope.h"
+#include "audioEngine.h"
+#include <mutex>
+#include <atomic>
 
 // Define status
 #define INITIALIZING 0
@@ -25,9 +35,36 @@
 #define TERMINATEMOTION 6
 #define ENDOFTRIAL 7
 #define END 8
+#define NB_STATUS 9
 
 #define M_PI 3.1415926
 
+#define MAX_CYCLES_FOR_AVERAGE_FREQUENCY 16 // size of the buffer used to compute the average frequency of the user
+#define METRONOME_SCHEDULE_AHEAD 0.1 // (s) the bips are given to the audio thread this long before they are played (more than its latency plus one tick)
+
+#define DISPLAY_FALLBACK_PERIOD 16 // (ms) period of the frames when the swap of the buffers is not synchronized with the screen
+#define DISPLAY_LATENCY_SMOOTHING 0.05 // weight of the last frame in the estimates of the display latency and of the refresh period
+#define SCOPE_WINDOW_WIDTH 800
+#define SCOPE_WINDOW_HEIGHT 600
+#define SCOPE_REFRESH_DIVIDER 2 // the scope is redrawn every 2 frames of the display
+
+// What the display needs from a tick of the control loop (see snapshotBuffer.h). The positions are in the lab frame, scaled like the cup is drawn
+struct DisplaySnapshot
+{
+	double time; // (s) of the tick
+	int status;
+	int trialNb;
+	double escapeRisk;
+	bool ballEscape;
+	double averageUserFrequency; // (Hz) for the speed hint
+	double cupPosition[3];
+	double cupVelocity[3]; // measured
+	double cupAcceleration[3]; // measured (not amplified)
+	double ballPosition[3];
+	double ballVelocity[3], ballAcceleration[3]; // flying ball
+	double pendulumAngle, pendulumAngularVelocity, pendulumAngularAcceleration; // ball in the cup
+};
+
 class Display
 {
 	// Methods
@@ -55,6 +92,59 @@ public:
 	// Start OpenGL main loop
 	void LaunchLoop();
 
+	// Set the latency compensation of the model: the cart acceleration read from the HM is considered as measurementDelay seconds old, and the model rewinds and re-simulates accordingly
+	// 0 (default) means no compensation, a negative value means the delay is estimated at each tick from the measured round trip time with the HM
+	void SetLatencyCompensation(double delay);
+
+	// Set the angle (rad) below which the model uses the closed-form small-angle solution instead of RK4 (0 means always RK4)
+	void SetSmallAngleApproximation(double angleThreshold);
+
+	// Format of the data files: TRIAL_FILE_CSV (default), TRIAL_FILE_CSV_EXACT (all the digits, see csvEmitter.h), TRIAL_FILE_BINARY (see trialFile.h), TRIAL_FILE_COMPRESSED (compressed binary, see columnCodec.h), TRIAL_FILE_MAT (MATLAB, see matFile.h) or TRIAL_FILE_BLOCK (one file per block, see blockFile.h)
+	// ConvertTrialFile converts the binary and block files into the CSV files. Return -1 if the format is unknown
+	int SetOutputFormat(int format);
+
+	// Record the trials in chunks of duration seconds, written to disk during the trial (see TrialWriter::SubmitChunk), so that the memory used does not depend on durationOfOneTrial
+	// 0 (default) keeps the whole trial in memory until it is written. The data files are the same in both cases. Return -1 if duration is negative
+	int SetRecordingChunkDuration(double duration);
+
+	// Also record the 3D position, velocity and acceleration of the HM, the commanded ball force, the states of the springs and the status of the task
+	// These channels are updated every decimation ticks (averaged over the ticks in between, the states are only sampled) and keep their value in between
+	// (the rows are still recorded at each tick, the data files are not smaller).
+	// 0 (default) means they are not recorded. Return -1 if decimation is negative
+	int SetAuxiliaryChannels(int decimation);
+
+	// What the control loop does when a tick ends after the deadline of the next one: LOOP_OVERRUN_SKIP (default) or LOOP_OVERRUN_CATCH_UP (see loopScheduler.h)
+	// Must be called before Initialize. Return -1 if the policy is unknown
+	int SetLoopOverrunPolicy(int policy);
+
+	// (s) ticks of the control loop longer than this budget are counted, for each trial and in the timing file of the block (see loopTiming.h)
+	void SetLoopTimeBudget(double budget);
+
+	// Real-time mode (see realTime.h): priority REAL_TIME_OFF (default), REAL_TIME_HIGH or REAL_TIME_REALTIME, and CPU the control loop is pinned to (-1: any)
+	// Applied by Initialize, which reports each step. Return -1 if the priority is unknown
+	int SetRealTimeMode(int priority, int cpu);
+
+	// Use a convex cup given by the knots (x0, z0, x1, z1, ...) of its half profile (see cupProfile.h) instead of the circular arc defined by pendulumLength and arcCup
+	// An empty list keeps the circular cup. Return -1 (and keep the circular cup) if the profile is not valid
+	int SetCupProfile(const std::vector<double> &knots);
+
+	// (s) the cup and the ball are drawn where they are expected to be when the frame is seen, at most horizon after the last tick (the latency of the display
+	// is estimated from the time the swaps of the buffers end). 0: no prediction, the frame is interpolated one loop period late
+	void SetDisplayPrediction(double horizon);
+
+	// Capture every frame of the trials (from the wait for the start to the end of the trial) in Output/blockName_trial_N_frame_M.tga (see frameCapture.h)
+	void SetFrameCapture(bool capture);
+
+	// Second window for the experimenter, next to the window of the subject, with the plots of the pendulum angle, the velocity of the cup, the ball force
+	// sent to the HM and the period of the control loop over the last seconds (see scope.h)
+	void SetScopeWindow(bool scope);
+
+	// Output of the cue sounds (see audioEngine.h): AUDIO_SINK_DEVICE (default), AUDIO_SINK_NULL (nothing played, e.g. without sound card)
+	// or AUDIO_SINK_FILE (written in Output/blockName_audio.wav). Return -1 if the sink is unknown (the device is used)
+	int SetAudioSink(int sink);
+	// (m/s/s) maximal acceleration the subject can give to the HM, before amplification (only used to check that the escape-risk table matches the block)
+	void SetMaxCartAcceleration(double maxAcceleration);
+
 	// Attributes
 private:
 
@@ -63,10 +153,37 @@ private:
 	static void InternalReshape(int iWidth, int iHeight);
 	static void InternalKeyboard(unsigned char ucKey, int iX, int iY);
 	static void InternalUpdateDisplay(void);
+	static void InternalRedisplay(int value);
+	static void InternalUpdateScope(void);
+	// GLUT thread: close the block and exit (Escape, or END reached by the control loop)
+	static void ExitProgram();
+
+	// Control loop: copy of the state of the task for the display, at the end of each tick
+	void PublishSnapshot();
+	// Display: state of the task for a frame started at frameStartTime (s), interpolated between the last two snapshots or predicted from the last one. Return false before the first ticks
+	bool GetDisplayFrame(double frameStartTime, DisplaySnapshot &frame);
+	// Display: extrapolate the last snapshot by horizon (s)
+	void PredictDisplayFrame(double horizon, DisplaySnapshot &frame);
+	// Display: update the estimates of the latency and the refresh period once the swap of the buffers has ended
+	void UpdateDisplayLatency(double frameStartTime);
+	// Display: capture the frame which has just been drawn, if it is part of a trial
+	void CaptureFrame(const DisplaySnapshot &frame);
+	// Display thread: wait until the captured frames are read back and written, and print the counts
+	void FlushFrameCapture();
+	// Control loop: sample of the plotted signals, at the end of each tick
+	void PushScopeSample(double timeStep);
+	// Create the window of the scope, after the main window
+	void CreateScopeWindow();
+	// Display: draw the scope, in its window
+	void UpdateScope();
+	// GLUT thread: stop the ticks, wait for the data files and the captured frames, write the timing file, stop the audio and the HapticMaster
+	void CloseBlock();
+	// Stop the audio, write the onsets of the cues in Output/blockName_cues.csv and print the counts
+	void CloseAudio();
 
 	void DrawFloor();
-	void DrawBall(GLfloat color[3]);
-	void DrawCup(GLfloat color[3]);
+	void DrawBall(const DisplaySnapshot &frame, GLfloat color[3]);
+	void DrawCup(const DisplaySnapshot &frame, GLfloat color[3]);
 	// Draw a square representing the target to reach (updated at each new trial)
 	void DrawTargetBlock();
 	// Draw a square representing the start position 
@@ -74,22 +191,60 @@ private:
 	// Display a text on the screen
 	void DrawStatus(std::string text, GLfloat color[3], double position);
 	// Display the cup and ball
-	void DrawWindow(GLfloat currentStateColor[3]);
+	void DrawWindow(const DisplaySnapshot &frame, GLfloat currentStateColor[3]);
+	// Compile the static scene and the shapes of the cup and ball in display lists (after the window is created). Return -1 if they cannot be created
+	int BuildDisplayLists();
 	// Write motion data in a file
 	void WriteDataInFile();
+	// Queue the data file of the trial for the writer. Return false if its queue is full (isDataFilePending, the trial is submitted again at the next ticks)
+	bool SubmitDataFile();
+	void CheckDataFiles(); // print the trials whose data file could not be written
+	void UpdateDataFilename(); // name of the data file of the current trial
+	// Metronome: schedule the bips of the next METRONOME_SCHEDULE_AHEAD seconds, at exact multiples of the half period from the start of the motion
+	void ScheduleMetronome();
+	// Read the onsets of the bips played since the last call (from the audio thread)
+	void ReadMetronomeOnsets();
 	void StartRecording();
 	void StopRecording();
 	void RecordMotionData();
 	void ClearDataBuffer();
+	void PrepareRealTime(); // buffers allocated and memory locked before the block, other threads off the CPU of the control loop
+	// Compute the size of the cup, target and ball and the points used to draw the cup (depend on the cup shape)
+	void ComputeCupGeometry();
 
 	// Task parameter
 	Haptic *pHaptic; // interaction with the HapticMaster
 	Model *pModel; // mathematical model of the cup-task (cart-pendulum)	
+	ViabilityTable *pViability; // precomputed escape risk of the cart-pendulum (NULL if no table matching the block parameters was found)
+	CupProfile *pCupProfile; // shape of a non-circular cup (NULL for a circular cup)
+	std::vector<double> cupProfileKnots;
 	
 	int posX, posY, posZ; // define axes orientation
 	
 	int loopPeriod;  // Timing parameter for the control loop
-	int loopTimerID;	
+	double measurementDelay; // (s) latency compensation in the model (0: none, <0: estimated from the round trip time with the HM)
+	double smallAngleThreshold; // (rad) below this angle, the model uses its closed-form small-angle solution (0: never)
+	int loopTimerID;
+	LoopScheduler *pLoopScheduler; // runs Timer every loopPeriod, in its own thread
+	int realTimePriority; // REAL_TIME_OFF: normal priority, no memory locked
+	int realTimeCpu; // -1: the control loop can run on any CPU
+	LoopTiming *pLoopTiming; // durations of the ticks and of their phases, by status
+	std::mutex stateMutex; // state of the task shared by Timer and the keyboard callback (Escape stops the ticks instead, see ExitProgram)
+	SnapshotBuffer<DisplaySnapshot> *pSnapshots; // state of the task seen by the display (the drawing does not lock stateMutex)
+	bool isVerticalSyncEnabled; // one frame per refresh of the screen, otherwise one every DISPLAY_FALLBACK_PERIOD
+	bool isRedisplayScheduled; // a frame is already scheduled by glutTimerFunc (no vertical synchronization)
+	std::atomic<bool> isExitRequested; // set by the tick in END, the GLUT thread exits at its next frame
+	double displayPredictionHorizon; // (s) 0: no prediction
+	double displayLatency; // (s) from the start of a frame to the end of its swap (smoothed)
+	double refreshPeriod; // (s) between the ends of two swaps (smoothed)
+	double lastSwapTime; // (s) end of the last swap (0: no frame yet)
+	double measuredCupAcceleration[3]; // acceleration of the current tick before the amplification of the model (for the display)
+	FrameCapture *pFrameCapture; // NULL: the frames are not captured
+	int captureTrialNb; // trial of the last captured frame
+	unsigned int captureFrameNb; // next frame of this trial
+	Scope *pScope; // NULL: no scope window
+	int mainWindow, scopeWindow; // GLUT identifiers of the windows
+	int nbFramesSinceScope; // frames of the display since the scope was redrawn
 	
 	int status;		
 	bool selfPaced; // whether a metronome bip indicates a target frequency or whether you can choose the frequency you want
@@ -103,15 +258,16 @@ private:
 	
 	double amplitudeFactorAccuracy; // ratio between the start/target width and the cup width
 	double accelerationAmplificationFactor;
+	double maxCartAcceleration; // (m/s/s) bound assumed by the escape-risk table, before amplification (0: unknown)
 	
 	double gravity;
-	double arcOfCup; // (rad) angle of the whole circle which is kept for the cup
+	double arcOfCup; // (rad) angle of the whole circle which is kept for the cup (for a non-circular cup, twice the slope angle at the edge)
 	double cupWidth; // (m) Horizontal width of the cup (used to scale ball and target width)
 	double cupHeight; // (m) Vertical height of the cup (used to choose vertical target block size)
 	double inertiaHM; // Include cup and ball?
 	double pendulumMass; // (kg)
 	double pendulumDamping; // (N.m.s)
-	double pendulumLength; // (m)
+	double pendulumLength; // (m) (for a non-circular cup, radius of curvature at the bottom of the cup)
 	double pendulumInitialAngle; // (rad)
 	double pendulumInitialVelocity; // (rad)
 	
@@ -133,26 +289,40 @@ private:
 	double targetPosition[3];		
 	double escapePosition[3]; // in case ball escape, 3D Cartesian position in the cup at time of escape (used to compute and show the motion of the free flying ball, just for visual effect)
 	double escapeVelocity[3]; // in case ball escape, 3D Cartesian velocity at time of escape (used to compute and show the motion of the free flying ball, just for visual effect)
+	double escapeRisk; // 0 while the ball can still be kept in the cup, up to 1 when the escape is imminent whatever the user does (looked up in the viability table at each tick)
+	double viabilityLossTime; // (s) time since the motion started when the ball could not be saved anymore (-1 if it never happened)
 
 	double distanceTolerance; // is HM back to initi position
 	double velocityTolerance; // is HM back to initi position + threshold motion detection for start of motion
 	double frequencyTolerance; // in percent of the goalFrequency
-	unsigned int nbCyclesForAverageFrequency; // must be > 1
+	unsigned int nbCyclesForAverageFrequency; // must be > 1 and < MAX_CYCLES_FOR_AVERAGE_FREQUENCY
 	int motionDirection;
 	double averageUserFrequency; // computed on the nbCyclesForAverageFrequency last cycles, and used when metronome paced to tell user if is going too fast/slow
 	double timeStartCycle; // used to store the time of the beginning of each cycle
-	std::deque<double> storageCycleDuration; // store the duration of the N previous cycles
+	double storageCycleDuration[MAX_CYCLES_FOR_AVERAGE_FREQUENCY]; // store the duration of the N previous cycles (circular buffer, so that nothing is allocated during the motion)
+	unsigned int firstCycleDuration; // index of the oldest stored duration
+	unsigned int nbStoredCycleDurations;
+	int nbScheduledBeats; // bips of the metronome given to the audio thread in this trial
+	std::vector<double> beatTimes; // (s) since the start of the recording, times at which the bips are scheduled
+	std::vector<double> beatOnsets; // (s) since the start of the recording, estimated times at which the bips are played
+	unsigned int nbReadOnsets; // onsets of the audio engine already read
 	
 	bool playSound;
-	const char* failureSound; // if ball escape
-	const char* bipSound;	  // metronome 
-	const char* endSound; 	  // indicate end of motion in case ball not lost	
+	AudioEngine *pAudio; // cue sounds decoded at startup, played by the audio thread
+	int audioSink;
+	int failureCue; // if ball escape (-1: the sound could not be read)
+	int bipCue; // metronome
+	int endCue; // indicate end of motion in case ball not lost
+	const char* viabilityTableFile; // generated offline by GenerateViabilityTable
 
 	// Visual parameters
 	double visualScalingFactor;
 	double cupAdditionalVisualScalingFactor;
 	double ballRadius;
 	int ballNbSlices; // glutSphere parameter
+	GLuint sceneList; // display list of the floor and the start and target blocks
+	GLuint cupList; // display list of the shape of the cup, in the frame of the cup
+	GLuint ballList; // display list of the ball, centered on 0
 	double blockLineWidth;
 	std::vector<std::pair<double, double>> cupShapePoints; // array of points which - once joined - form the arc for the cup	
 	
@@ -187,15 +357,24 @@ private:
 	// Recording parameters
 	std::string blockName; // Name you want for the output data file (a separate file is created for each trial in the block and the number of the trial is appended to the file name)
 	bool isRecording;
-	std::queue<double> timeData;
-	std::queue<double> pendulumAngleData;
-	std::queue<double> pendulumAngularVelocityData;
-	std::queue<double> pendulumAngularAccelerationData;
-	std::queue<double> cartPositionData; // though the HM can move in 3D, the cart model has only a 1D motion. Only this direction is recorded so that the file is not too big
-	std::queue<double> cartVelocityData;
-	std::queue<double> cartAccelerationData;
-	std::queue<double> pendulumForceData; // this is not similar to what we get with the force in HapticMaster (force along Y is zero since no haptic objects, except constant force but is not included apparently)
-	std::queue<double> userForce[3]; // force measured with the HM (force sensor)
+	Recorder *pRecorder; // all the recorded channels of the current trial (preallocated, see ClearDataBuffer)
+	ChannelList *pChannels; // where the value of each recorded channel is read at each tick (see RecordMotionData)
+	int auxiliaryChannelDecimation; // 0: no auxiliary channel (see SetAuxiliaryChannels)
+	// Values computed during the current tick and read by the recorded channels
+	double tickTime; // (s) since the start of the recording
+	double tickStatus;
+	double tickPendulumAngle, tickPendulumAngularVelocity, tickPendulumAngularAcceleration;
+	double tickBallForce; // (N) computed by the model (before the limitation of the force sent to the HM)
+	bool isTickBallForceComputed; // whether the ball force was computed by the control during the current tick
+	TrialWriter *pTrialWriter; // writes the data files in the background
+	TrialHeader trialHeader; // parameters of the current trial written in the data file (kept to reuse its memory)
+	bool isDataFilePending; // the data file of the trial is not queued yet (queue of the writer full)
+	unsigned int nbDelayedDataFiles; // trials whose data file could not be queued at the end of the motion
+	int outputFormat; // TRIAL_FILE_CSV, TRIAL_FILE_CSV_EXACT, TRIAL_FILE_BINARY, TRIAL_FILE_COMPRESSED, TRIAL_FILE_MAT or TRIAL_FILE_BLOCK
+	double maxRecordingDuration; // (s) longest expected recording, used to allocate the recording buffer before the trial starts
+	double recordingChunkDuration; // (s) 0: the whole trial is kept in memory
+	unsigned int recordingChunkNbSamples; // samples per chunk (0: no chunks)
+	std::string dataFilename; // data file of the current trial (updated before the trial starts, so that no string is built in the control loop)
 
 };
 
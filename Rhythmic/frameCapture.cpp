@@ -0,0 +1,258 @@
+#include "frameCapture.h"
+
+#define TGA_MAX_PACKET_LENGTH 128
+
+FrameCapture::FrameCapture(const std::string &filenamePrefix, int width, int height)
+{
+	this->filenamePrefix = filenamePrefix;
+	for (int i=0; i<FRAME_CAPTURE_QUEUE_SIZE; i++)
+		queue[i].pixels.resize(3 * width * height);
+	firstFrame = 0;
+	nbFrames = 0;
+	nbReadingFrames = 0;
+	arePixelBuffersCreated = false;
+	arePixelBuffersAvailable = false;
+	nbStartedReads = 0;
+	nbWrittenFrames = 0;
+	nbDroppedFrames = 0;
+	nbFailedFrames = 0;
+	isStopping = false;
+	writerThread = std::thread(&FrameCapture::Run, this);
+}
+
+FrameCapture::~FrameCapture()
+{
+	{
+		std::unique_lock<std::mutex> lock(queueMutex);
+		isStopping = true;
+	}
+	queueChanged.notify_all();
+	writerThread.join(); // the thread only stops when the queue is empty (the frames still being read back are lost, see Flush)
+	if (arePixelBuffersAvailable)
+		glDeleteBuffers(FRAME_CAPTURE_NB_PIXEL_BUFFERS, pixelBuffers);
+}
+
+
+void FrameCapture::CreatePixelBuffers()
+{
+	arePixelBuffersCreated = true;
+	const char *extensions = (const char *)glGetString(GL_EXTENSIONS);
+	if (extensions == NULL || strstr(extensions, "GL_ARB_pixel_buffer_object") == NULL)
+	{
+		std::cout << "Pixel buffer objects not available, the captured frames are read synchronously" << std::endl;
+		return;
+	}
+	glGenBuffers = (GenBuffersFunction)wglGetProcAddress("glGenBuffers");
+	glDeleteBuffers = (DeleteBuffersFunction)wglGetProcAddress("glDeleteBuffers");
+	glBindBuffer = (BindBufferFunction)wglGetProcAddress("glBindBuffer");
+	glBufferData = (BufferDataFunction)wglGetProcAddress("glBufferData");
+	glMapBuffer = (MapBufferFunction)wglGetProcAddress("glMapBuffer");
+	glUnmapBuffer = (UnmapBufferFunction)wglGetProcAddress("glUnmapBuffer");
+	if (glGenBuffers == NULL || glDeleteBuffers == NULL || glBindBuffer == NULL || glBufferData == NULL || glMapBuffer == NULL || glUnmapBuffer == NULL)
+	{
+		std::cout << "Pixel buffer objects not available, the captured frames are read synchronously" << std::endl;
+		return;
+	}
+	glGenBuffers(FRAME_CAPTURE_NB_PIXEL_BUFFERS, pixelBuffers);
+	for (int i=0; i<FRAME_CAPTURE_NB_PIXEL_BUFFERS; i++)
+		pixelBufferSizes[i] = 0;
+	arePixelBuffersAvailable = true;
+}
+
+
+bool FrameCapture::Capture(int trialNb, unsigned int frameNb, int width, int height)
+{
+	if (width <= 0 || height <= 0)
+		return false;
+	if (!arePixelBuffersCreated)
+		CreatePixelBuffers();
+	std::unique_lock<std::mutex> lock(queueMutex);
+	if (nbFrames + nbReadingFrames == FRAME_CAPTURE_QUEUE_SIZE)
+	{
+		nbDroppedFrames++;
+		return false;
+	}
+	// The slot is not in the queue yet: the writer does not use it while the pixels are read
+	Frame &frame = queue[(firstFrame + nbFrames + nbReadingFrames) % FRAME_CAPTURE_QUEUE_SIZE];
+	lock.unlock();
+	frame.trialNb = trialNb;
+	frame.frameNb = frameNb;
+	frame.width = width;
+	frame.height = height;
+	frame.isRead = true;
+	ptrdiff_t size = 3 * width * height;
+	if ((ptrdiff_t)frame.pixels.size() < size) // the window is larger than at the construction
+		frame.pixels.resize(size);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadBuffer(GL_BACK);
+
+	if (!arePixelBuffersAvailable)
+	{
+		glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, &frame.pixels[0]);
+		lock.lock();
+		nbFrames++;
+		lock.unlock();
+		queueChanged.notify_all();
+		return true;
+	}
+
+	// The copy into the pixel buffer is done by the GPU, glReadPixels returns at once
+	int buffer = nbStartedReads % FRAME_CAPTURE_NB_PIXEL_BUFFERS;
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, pixelBuffers[buffer]);
+	if (pixelBufferSizes[buffer] < size)
+	{
+		glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+		pixelBufferSizes[buffer] = size;
+	}
+	glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, 0);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	nbStartedReads++;
+	nbReadingFrames++;
+
+	// The frame read FRAME_CAPTURE_NB_PIXEL_BUFFERS - 1 captures ago is copied, and its pixel buffer is free for the next capture
+	if (nbReadingFrames == FRAME_CAPTURE_NB_PIXEL_BUFFERS)
+		ReadOldestFrame();
+	return true;
+}
+
+
+void FrameCapture::ReadOldestFrame()
+{
+	std::unique_lock<std::mutex> lock(queueMutex);
+	Frame &frame = queue[(firstFrame + nbFrames) % FRAME_CAPTURE_QUEUE_SIZE];
+	lock.unlock();
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, pixelBuffers[(nbStartedReads - nbReadingFrames) % FRAME_CAPTURE_NB_PIXEL_BUFFERS]);
+	const unsigned char *pixels = (const unsigned char *)glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+	frame.isRead = (pixels != NULL);
+	if (pixels != NULL)
+	{
+		memcpy(&frame.pixels[0], pixels, 3 * frame.width * frame.height);
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	lock.lock();
+	nbReadingFrames--;
+	nbFrames++;
+	lock.unlock();
+	queueChanged.notify_all();
+}
+
+
+void FrameCapture::ReadPendingFrames()
+{
+	while (nbReadingFrames > 0)
+		ReadOldestFrame();
+}
+
+
+void FrameCapture::Flush()
+{
+	ReadPendingFrames();
+	std::unique_lock<std::mutex> lock(queueMutex);
+	while (nbFrames > 0)
+		queueChanged.wait(lock);
+}
+
+
+unsigned int FrameCapture::GetNbWrittenFrames()
+{
+	return nbWrittenFrames;
+}
+
+
+unsigned int FrameCapture::GetNbDroppedFrames()
+{
+	return nbDroppedFrames;
+}
+
+
+unsigned int FrameCapture::GetNbFailedFrames()
+{
+	return nbFailedFrames;
+}
+
+
+void FrameCapture::Run()
+{
+	std::unique_lock<std::mutex> lock(queueMutex);
+	while (true)
+	{
+		while (nbFrames == 0 && !isStopping)
+			queueChanged.wait(lock);
+		if (nbFrames == 0) // stopping and nothing left to write
+			break;
+
+		// The slot stays in the queue while it is written, so that Capture does not reuse it
+		Frame &frame = queue[firstFrame];
+		lock.unlock();
+		if (frame.isRead && WriteFrame(frame) == 0)
+			nbWrittenFrames++;
+		else
+			nbFailedFrames++;
+		lock.lock();
+		firstFrame = (firstFrame + 1) % FRAME_CAPTURE_QUEUE_SIZE;
+		nbFrames--;
+		queueChanged.notify_all();
+	}
+}
+
+
+int FrameCapture::WriteFrame(Frame &frame)
+{
+	// Header: run-length encoded true-color image (type 10), 24 bits per pixel, first row at the bottom (as read by glReadPixels)
+	unsigned char header[18] = {0};
+	header[2] = 10;
+	header[12] = (unsigned char)(frame.width & 0xFF);
+	header[13] = (unsigned char)(frame.width >> 8);
+	header[14] = (unsigned char)(frame.height & 0xFF);
+	header[15] = (unsigned char)(frame.height >> 8);
+	header[16] = 24;
+
+	// Each row is encoded separately: runs of identical pixels, or raw packets of different pixels, of at most 128 pixels, in BGR order
+	encodedFrame.clear();
+	for (int row=0; row<frame.height; row++)
+	{
+		const unsigned char *pixels = &frame.pixels[3 * row * frame.width];
+		int x = 0;
+		while (x < frame.width)
+		{
+			int runLength = 1;
+			while (x + runLength < frame.width && runLength < TGA_MAX_PACKET_LENGTH && memcmp(pixels + 3 * (x + runLength), pixels + 3 * x, 3) == 0)
+				runLength++;
+			if (runLength > 1)
+			{
+				encodedFrame.push_back((unsigned char)(0x80 | (runLength - 1)));
+				encodedFrame.push_back(pixels[3 * x + 2]);
+				encodedFrame.push_back(pixels[3 * x + 1]);
+				encodedFrame.push_back(pixels[3 * x]);
+				x += runLength;
+			}
+			else
+			{
+				// Raw packet up to the next run of identical pixels
+				int rawLength = 1;
+				while (x + rawLength < frame.width && rawLength < TGA_MAX_PACKET_LENGTH && (x + rawLength + 1 >= frame.width || memcmp(pixels + 3 * (x + rawLength), pixels + 3 * (x + rawLength + 1), 3) != 0))
+					rawLength++;
+				encodedFrame.push_back((unsigned char)(rawLength - 1));
+				for (int i=x; i<x+rawLength; i++)
+				{
+					encodedFrame.push_back(pixels[3 * i + 2]);
+					encodedFrame.push_back(pixels[3 * i + 1]);
+					encodedFrame.push_back(pixels[3 * i]);
+				}
+				x += rawLength;
+			}
+		}
+	}
+
+	char filename[1024];
+	sprintf_s(filename, "%s_trial_%i_frame_%05u.tga", filenamePrefix.c_str(), frame.trialNb, frame.frameNb);
+	std::ofstream file(filename, std::ios::out | std::ios::binary);
+	if (!file.is_open())
+		return -1;
+	file.write((const char *)header, sizeof(header));
+	file.write((const char *)&encodedFrame[0], encodedFrame.size());
+	file.close();
+	return file.fail() ? -1 : 0;
+}
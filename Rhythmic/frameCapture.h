@@ -0,0 +1,116 @@
+#ifndef FRAMECAPTURE_H_INCLUDED
+#define FRAMECAPTURE_H_INCLUDED
+
+/* Capture of the frames of the display in image files, written by a background thread */
+/*
+	Each captured frame is read from the back buffer once it is drawn (before the swap), and a background thread compresses and writes it as a TGA image
+	(24 bits, run-length encoded: the scene is mostly uniform, so the files are small and the images can be read by most viewers and video tools,
+	e.g. ffmpeg -i name_frame_%05d.tga).
+	The read back is asynchronous when the driver has pixel buffer objects (GL_ARB_pixel_buffer_object, the functions are given by the driver as
+	wglSwapIntervalEXT): glReadPixels only starts the copy of the frame into one of the FRAME_CAPTURE_NB_PIXEL_BUFFERS buffers of a ring, and the frame read
+	FRAME_CAPTURE_NB_PIXEL_BUFFERS - 1 captures before, which the GPU has finished copying, is mapped and copied into its slot of the queue. The display thread
+	only does this copy and the hand-off to the writer: the slots are allocated at the size of the window beforehand, and the filenames are built by the writer.
+	Without pixel buffer objects, the frame is read synchronously into its slot.
+	The display never waits for the disk: if all the slots are waiting to be written, the frame is not captured and is counted as dropped.
+*/
+#include <windows.h>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cstdio>
+#include <cstddef>
+#include <fstream>
+#include <iostream>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include "stdlib.h" // needed otherwise conflict with glut
+#include <GL/glut.h>
+
+#define FRAME_CAPTURE_QUEUE_SIZE 8 // maximal number of frames waiting to be written
+#define FRAME_CAPTURE_NB_PIXEL_BUFFERS 3 // frames being read back by the GPU (a frame is mapped 2 captures after its read back starts)
+
+// OpenGL 1.1 headers of Windows
+#ifndef GL_PIXEL_PACK_BUFFER
+#define GL_PIXEL_PACK_BUFFER 0x88EB
+#endif
+#ifndef GL_STREAM_READ
+#define GL_STREAM_READ 0x88E1
+#endif
+#ifndef GL_READ_ONLY
+#define GL_READ_ONLY 0x88B8
+#endif
+
+class FrameCapture
+{
+	public:
+		// The files are filenamePrefix_trial_N_frame_M.tga, the slots are allocated for frames of width x height pixels
+		FrameCapture(const std::string &filenamePrefix, int width, int height);
+		~FrameCapture(); // wait until all the queued frames are written
+
+		// Display thread, once the frame is drawn and before the swap: read the back buffer of the window (width x height pixels) as frame frameNb of trial trialNb.
+		// Never waits: return false if the queue is full (the frame is dropped). The slot only grows if the window is larger than at the construction
+		bool Capture(int trialNb, unsigned int frameNb, int width, int height);
+		// Display thread: queue the frames whose read back has started (e.g. the last frames of a trial)
+		void ReadPendingFrames();
+		// Display thread: queue the frames whose read back has started and wait until all the frames are written
+		void Flush();
+
+		// Counters (can be read from any thread)
+		unsigned int GetNbWrittenFrames();
+		unsigned int GetNbDroppedFrames(); // queue full
+		unsigned int GetNbFailedFrames(); // file could not be written, or pixel buffer could not be read
+
+	private:
+		struct Frame
+		{
+			int trialNb;
+			unsigned int frameNb;
+			int width, height;
+			bool isRead; // false if the pixel buffer could not be mapped
+			std::vector<unsigned char> pixels; // RGB, from the bottom row
+		};
+
+		typedef void (APIENTRY *GenBuffersFunction)(GLsizei n, GLuint *buffers);
+		typedef void (APIENTRY *DeleteBuffersFunction)(GLsizei n, const GLuint *buffers);
+		typedef void (APIENTRY *BindBufferFunction)(GLenum target, GLuint buffer);
+		typedef void (APIENTRY *BufferDataFunction)(GLenum target, ptrdiff_t size, const GLvoid *data, GLenum usage);
+		typedef GLvoid* (APIENTRY *MapBufferFunction)(GLenum target, GLenum access);
+		typedef GLboolean (APIENTRY *UnmapBufferFunction)(GLenum target);
+
+		void CreatePixelBuffers(); // at the first capture, once the context of the window is current
+		void ReadOldestFrame(); // map the oldest pixel buffer being read into its slot, and queue it
+		void Run(); // writer thread
+		int WriteFrame(Frame &frame);
+
+		std::string filenamePrefix;
+		Frame queue[FRAME_CAPTURE_QUEUE_SIZE]; // circular buffer, a slot is released once its file is written
+		unsigned int firstFrame;
+		unsigned int nbFrames; // queued for the writer
+		unsigned int nbReadingFrames; // next slots, whose pixel buffer is being read by the GPU (only changed by the display thread)
+
+		// Pixel buffers (only used by the display thread)
+		bool arePixelBuffersCreated;
+		bool arePixelBuffersAvailable; // otherwise synchronous read back
+		GLuint pixelBuffers[FRAME_CAPTURE_NB_PIXEL_BUFFERS];
+		ptrdiff_t pixelBufferSizes[FRAME_CAPTURE_NB_PIXEL_BUFFERS];
+		unsigned int nbStartedReads; // read backs started, the pixel buffer of the next one is pixelBuffers[nbStartedReads % FRAME_CAPTURE_NB_PIXEL_BUFFERS]
+		GenBuffersFunction glGenBuffers;
+		DeleteBuffersFunction glDeleteBuffers;
+		BindBufferFunction glBindBuffer;
+		BufferDataFunction glBufferData;
+		MapBufferFunction glMapBuffer;
+		UnmapBufferFunction glUnmapBuffer;
+
+		std::vector<unsigned char> encodedFrame; // only used by the writer thread
+		std::atomic<unsigned int> nbWrittenFrames;
+		std::atomic<unsigned int> nbDroppedFrames;
+		std::atomic<unsigned int> nbFailedFrames;
+		bool isStopping;
+		std::mutex queueMutex;
+		std::condition_variable queueChanged;
+		std::thread writerThread;
+};
+
+#endif // FRAMECAPTURE_H_INCLUDED
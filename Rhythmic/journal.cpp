@@ -0,0 +1,285 @@
+#include "journal.h"
+
+// FNV-1a (32 bits), enough to detect a record which was not completely written
+static unsigned int ComputeChecksum(const char *data, unsigned __int64 size)
+{
+	unsigned int checksum = 2166136261u;
+	for (unsigned __int64 i=0; i<size; i++)
+	{
+		checksum ^= (unsigned char)data[i];
+		checksum *= 16777619u;
+	}
+	return checksum;
+}
+
+TrialJournal::TrialJournal()
+{
+	fileHandle = INVALID_HANDLE_VALUE;
+}
+
+TrialJournal::~TrialJournal()
+{
+	Close();
+}
+
+
+int TrialJournal::Open(const std::string &filename)
+{
+	Close();
+	fileHandle = CreateFileA(filename.c_str(), GENERIC_WRITE, FILE_SHARE_READ, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (fileHandle == INVALID_HANDLE_VALUE)
+		return -1;
+	LARGE_INTEGER start;
+	start.QuadPart = 0;
+	if (!SetFilePointerEx(fileHandle, start, NULL, FILE_BEGIN) || !SetEndOfFile(fileHandle) || !FlushFileBuffers(fileHandle))
+	{
+		Close();
+		return -1;
+	}
+	pendingTrials.clear();
+	return 0;
+}
+
+
+void TrialJournal::Close()
+{
+	if (fileHandle != INVALID_HANDLE_VALUE)
+		CloseHandle(fileHandle);
+	fileHandle = INVALID_HANDLE_VALUE;
+}
+
+
+bool TrialJournal::IsOpen()
+{
+	return fileHandle != INVALID_HANDLE_VALUE;
+}
+
+
+int TrialJournal::AppendChunk(int trialNb, const std::string &filename, Recorder &data)
+{
+	record.clear();
+	AppendBytes(record, &trialNb, sizeof(int));
+	AppendString(record, filename);
+	AppendSamples(data);
+	AddPendingTrial(trialNb, filename);
+	return WriteRecord(JOURNAL_RECORD_CHUNK);
+}
+
+
+int TrialJournal::AppendTrial(int trialNb, const std::string &filename, int format, const TrialHeader &header, Recorder &data)
+{
+	record.clear();
+	AppendBytes(record, &trialNb, sizeof(int));
+	AppendString(record, filename);
+	unsigned int fileFormat = format;
+	AppendBytes(record, &fileFormat, sizeof(unsigned int));
+	AppendBytes(record, &header.nbHeaderLines, sizeof(double));
+	AppendString(record, header.taskName);
+	AppendBytes(record, &header.nbParameters, sizeof(unsigned int));
+	for (unsigned int p=0; p<header.nbParameters; p++)
+		AppendParameter(record, header.parameters[p]);
+	AppendSamples(data);
+	AddPendingTrial(trialNb, filename);
+	return WriteRecord(JOURNAL_RECORD_TRIAL);
+}
+
+
+int TrialJournal::AppendWritten(int trialNb, const std::string &filename)
+{
+	for (unsigned int t=0; t<pendingTrials.size(); t++)
+		if (pendingTrials[t].first == trialNb && pendingTrials[t].second == filename)
+		{
+			pendingTrials.erase(pendingTrials.begin() + t);
+			break;
+		}
+
+	// Nothing left to recover: start again from an empty file (durable at once, so that the trials are not recovered twice)
+	if (pendingTrials.empty())
+	{
+		LARGE_INTEGER start;
+		start.QuadPart = 0;
+		if (!SetFilePointerEx(fileHandle, start, NULL, FILE_BEGIN) || !SetEndOfFile(fileHandle) || !FlushFileBuffers(fileHandle))
+			return -1;
+		return 0;
+	}
+	record.clear();
+	AppendBytes(record, &trialNb, sizeof(int));
+	AppendString(record, filename);
+	return WriteRecord(JOURNAL_RECORD_WRITTEN);
+}
+
+
+int TrialJournal::Commit()
+{
+	if (!FlushFileBuffers(fileHandle))
+		return -1;
+	return 0;
+}
+
+
+void TrialJournal::AppendSamples(Recorder &data)
+{
+	unsigned int nbChannels = data.GetNbChannels();
+	unsigned int nbSamples = data.GetNbSamples();
+	AppendBytes(record, &nbChannels, sizeof(unsigned int));
+	AppendBytes(record, &nbSamples, sizeof(unsigned int));
+	for (unsigned int c=0; c<nbChannels; c++)
+	{
+		AppendString(record, data.GetChannelName(c));
+		AppendString(record, data.GetChannelUnit(c));
+	}
+	if (nbSamples > 0)
+		for (unsigned int c=0; c<nbChannels; c++)
+			AppendBytes(record, data.GetChannel(c), nbSamples * sizeof(double));
+}
+
+
+int TrialJournal::WriteRecord(unsigned int type)
+{
+	unsigned int prefix[3] = {JOURNAL_RECORD_MAGIC, type, (unsigned int)record.size()};
+	unsigned int checksum = ComputeChecksum(record.data(), record.size());
+	DWORD nbWritten;
+	if (!WriteFile(fileHandle, prefix, sizeof(prefix), &nbWritten, NULL) || nbWritten != sizeof(prefix) ||
+		!WriteFile(fileHandle, record.data(), record.size(), &nbWritten, NULL) || nbWritten != record.size() ||
+		!WriteFile(fileHandle, &checksum, sizeof(unsigned int), &nbWritten, NULL) || nbWritten != sizeof(unsigned int))
+		return -1;
+	return 0;
+}
+
+
+void TrialJournal::AddPendingTrial(int trialNb, const std::string &filename)
+{
+	for (unsigned int t=0; t<pendingTrials.size(); t++)
+		if (pendingTrials[t].first == trialNb && pendingTrials[t].second == filename)
+			return;
+	pendingTrials.push_back(std::pair<int, std::string>(trialNb, filename));
+}
+
+
+static bool ReadSamples(const char *data, unsigned __int64 dataSize, unsigned __int64 &position, JournalTrial &trial)
+{
+	unsigned int nbChannels, nbSamples;
+	if (!ReadBytes(data, dataSize, position, &nbChannels, sizeof(unsigned int)) || !ReadBytes(data, dataSize, position, &nbSamples, sizeof(unsigned int)) || nbChannels > RECORDER_MAX_CHANNELS)
+		return false;
+	std::vector<std::string> names(nbChannels), units(nbChannels);
+	for (unsigned int c=0; c<nbChannels; c++)
+		if (!ReadString(data, dataSize, position, names[c]) || !ReadString(data, dataSize, position, units[c]))
+			return false;
+	if ((unsigned __int64)nbChannels * nbSamples * sizeof(double) != dataSize - position)
+		return false;
+	// The channels of all the records of a trial are the same (the first ones are kept if not)
+	if (trial.channels.empty())
+	{
+		trial.channelNames = names;
+		trial.channelUnits = units;
+		trial.channels.resize(nbChannels);
+	}
+	if (trial.channels.size() != nbChannels)
+		return true;
+	for (unsigned int c=0; c<nbChannels; c++)
+	{
+		std::vector<double> &channel = trial.channels[c];
+		channel.resize(channel.size() + nbSamples);
+		if (nbSamples > 0)
+			ReadBytes(data, dataSize, position, &channel[channel.size() - nbSamples], nbSamples * sizeof(double));
+	}
+	return true;
+}
+
+
+int TrialJournal::Read(const std::string &filename, std::vector<JournalTrial> &trials, unsigned __int64 &nbIgnoredBytes)
+{
+	trials.clear();
+	nbIgnoredBytes = 0;
+	std::ifstream existingFile(filename.c_str(), std::ios::binary | std::ios::ate);
+	if (!existingFile.is_open() || existingFile.tellg() <= 0)
+		return 0; // no journal, or nothing in it
+	existingFile.close();
+	MappedFile file;
+	if (file.Open(filename) != 0)
+		return -1;
+	const char *data = file.GetData();
+	unsigned __int64 dataSize = file.GetSize();
+
+	unsigned __int64 position = 0;
+	while (position < dataSize)
+	{
+		// Stop at the first record which is not complete or damaged
+		unsigned int prefix[3], checksum;
+		unsigned __int64 recordStart = position;
+		if (!ReadBytes(data, dataSize, position, prefix, sizeof(prefix)) || prefix[0] != JOURNAL_RECORD_MAGIC || prefix[2] > dataSize - position)
+			break;
+		const char *payload = data + position;
+		unsigned __int64 payloadSize = prefix[2];
+		position += payloadSize;
+		if (!ReadBytes(data, dataSize, position, &checksum, sizeof(unsigned int)) || checksum != ComputeChecksum(payload, payloadSize))
+		{
+			position = recordStart;
+			break;
+		}
+
+		int trialNb;
+		std::string trialFilename;
+		unsigned __int64 payloadPosition = 0;
+		if (!ReadBytes(payload, payloadSize, payloadPosition, &trialNb, sizeof(int)) || !ReadString(payload, payloadSize, payloadPosition, trialFilename))
+		{
+			position = recordStart;
+			break;
+		}
+		unsigned int t = 0;
+		while (t < trials.size() && (trials[t].trialNb != trialNb || trials[t].filename != trialFilename))
+			t++;
+		if (t == trials.size())
+		{
+			trials.push_back(JournalTrial());
+			trials[t].trialNb = trialNb;
+			trials[t].filename = trialFilename;
+			trials[t].isSubmitted = false;
+			trials[t].isWritten = false;
+			trials[t].format = TRIAL_FILE_CSV;
+		}
+		JournalTrial &trial = trials[t];
+
+		bool isValid = true;
+		if (prefix[1] == JOURNAL_RECORD_CHUNK)
+			isValid = ReadSamples(payload, payloadSize, payloadPosition, trial);
+		else if (prefix[1] == JOURNAL_RECORD_TRIAL)
+		{
+			unsigned int format, nbParameters;
+			isValid = ReadBytes(payload, payloadSize, payloadPosition, &format, sizeof(unsigned int)) && ReadBytes(payload, payloadSize, payloadPosition, &trial.header.nbHeaderLines, sizeof(double)) &&
+				ReadString(payload, payloadSize, payloadPosition, trial.header.taskName) && ReadBytes(payload, payloadSize, payloadPosition, &nbParameters, sizeof(unsigned int));
+			if (isValid)
+			{
+				trial.format = format;
+				trial.header.parameters.resize(nbParameters);
+				trial.header.nbParameters = nbParameters;
+				for (unsigned int p=0; p<nbParameters && isValid; p++)
+					isValid = ReadParameter(payload, payloadSize, payloadPosition, trial.header.parameters[p]);
+			}
+			isValid = isValid && ReadSamples(payload, payloadSize, payloadPosition, trial);
+			trial.isSubmitted = isValid;
+		}
+		else if (prefix[1] == JOURNAL_RECORD_WRITTEN)
+			trial.isWritten = true;
+		else
+			isValid = false;
+		if (!isValid)
+		{
+			position = recordStart;
+			break;
+		}
+	}
+	nbIgnoredBytes = dataSize - position;
+	return 0;
+}
+
+
+int SyncFile(const std::string &filename)
+{
+	HANDLE fileHandle = CreateFileA(filename.c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (fileHandle == INVALID_HANDLE_VALUE)
+		return -1;
+	BOOL isFlushed = FlushFileBuffers(fileHandle);
+	CloseHandle(fileHandle);
+	return isFlushed ? 0 : -1;
+}
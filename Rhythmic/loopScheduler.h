@@ -0,0 +1,75 @@
+#ifndef LOOPSCHEDULER_H_INCLUDED
+#define LOOPSCHEDULER_H_INCLUDED
+
+/* Fixed-rate scheduler of the control loop, in its own thread */
+/*
+	With glutTimerFunc, the next tick was armed at the end of each tick, so the real period was loopPeriod plus the duration of the tick plus the latency
+	of the GLUT event loop (drawing included), and the error accumulated. Here the ticks are run at absolute deadlines, start + k * period on the
+	QueryPerformanceCounter clock: each wait is computed from the deadline, not from the end of the previous tick, so the rate does not drift.
+	The thread sleeps on a waitable timer (high resolution when available, otherwise with timeBeginPeriod(1)) until shortly before the deadline,
+	and polls the counter for the rest (LOOP_SCHEDULER_SPIN_TIME).
+
+	A tick which ends after the deadline of the next one is an overrun. Then:
+	- LOOP_OVERRUN_SKIP: the missed deadlines are skipped, the next tick is at the next deadline of the grid (the period is kept)
+	- LOOP_OVERRUN_CATCH_UP: the missed ticks are run at once, one after the other (the number of ticks is kept), at most maxCatchUpTicks of them,
+	  the deadlines beyond are skipped
+
+	The ticks are run in the scheduler thread, not in the GLUT thread: the state they share with the drawing and keyboard callbacks must be protected by the caller.
+*/
+#include <windows.h>
+#include <iostream>
+#include <thread>
+#include <atomic>
+#include "realTime.h"
+
+#define LOOP_OVERRUN_SKIP 0
+#define LOOP_OVERRUN_CATCH_UP 1
+
+#define LOOP_SCHEDULER_SPIN_TIME 0.0005 // (s) end of the wait which is polled instead of slept (precision of the waitable timer)
+#define LOOP_SCHEDULER_MAX_CATCH_UP_TICKS 5 // default number of missed ticks run at once with LOOP_OVERRUN_CATCH_UP
+
+#define CONTROL_LOOP_PERIOD 10 // (ms) period of the control loop of the tasks (mainLoopPeriod), also the time step of the offline tools
+
+class LoopScheduler
+{
+	public:
+		LoopScheduler();
+		~LoopScheduler();
+
+		// Set before Start
+		int SetOverrunPolicy(int policy, unsigned int maxCatchUpTicks = LOOP_SCHEDULER_MAX_CATCH_UP_TICKS);
+		// Priority of the thread (REAL_TIME_OFF, REAL_TIME_HIGH or REAL_TIME_REALTIME) and CPU it is pinned to (-1: any), applied and checked by Start (see realTime.h)
+		void SetRealTime(int priority, int cpu);
+		// Call tickFunction(tickID) every period (ms), as glutTimerFunc would. Return -1 if the thread or the timer cannot be created
+		int Start(int period, void (*tickFunction)(int), int tickID);
+		// Wait for the current tick to end and stop the thread (not from a tick)
+		void Stop();
+
+		// Counters since Start (can be read from any thread)
+		unsigned int GetNbTicks();
+		unsigned int GetNbOverruns(); // ticks which ended after the next deadline
+		unsigned int GetNbSkippedTicks(); // deadlines without a tick
+
+	private:
+		void Run(); // scheduler thread
+		void WaitUntil(unsigned __int64 deadline);
+
+		int overrunPolicy;
+		unsigned int maxNbCatchUpTicks;
+		void (*pTickFunction)(int);
+		int tickFunctionID;
+		unsigned __int64 timerFrequency;
+		unsigned __int64 periodTicks; // period in counter ticks
+		HANDLE timerHandle;
+		bool isTimerPeriodSet; // timeBeginPeriod(1) called (no high resolution timer)
+		int realTimePriority;
+		int realTimeCpu;
+
+		std::atomic<bool> isRunning;
+		std::atomic<unsigned int> nbTicks;
+		std::atomic<unsigned int> nbOverruns;
+		std::atomic<unsigned int> nbSkippedTicks;
+		std::thread schedulerThread;
+};
+
+#endif // LOOPSCHEDULER_H_INCLUDED
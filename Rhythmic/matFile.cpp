@@ -0,0 +1,224 @@
+#include "matFile.h"
+
+// Types of the data elements and classes of the arrays (MAT-file format, version 5)
+#define MI_INT8 1
+#define MI_UINT8 2
+#define MI_UINT16 4
+#define MI_INT32 5
+#define MI_UINT32 6
+#define MI_DOUBLE 9
+#define MI_MATRIX 14
+#define MX_STRUCT_CLASS 2
+#define MX_CHAR_CLASS 4
+#define MX_DOUBLE_CLASS 6
+#define MX_UINT8_CLASS 9
+#define MX_LOGICAL_FLAG 0x0200
+
+static void AppendTag(std::string &buffer, unsigned int type, unsigned int nbBytes)
+{
+	AppendBytes(buffer, &type, sizeof(unsigned int));
+	AppendBytes(buffer, &nbBytes, sizeof(unsigned int));
+}
+
+
+static void AppendPadding(std::string &buffer)
+{
+	buffer.append((8 - buffer.size() % 8) % 8, '\0');
+}
+
+
+// Valid MATLAB name: a letter first, then letters, digits or '_'
+static std::string MatName(const std::string &name)
+{
+	std::string matName = name.substr(0, MAT_FILE_NAME_LENGTH);
+	for (unsigned int i=0; i<matName.size(); i++)
+		if (!isalnum((unsigned char)matName[i]) && matName[i] != '_')
+			matName[i] = '_';
+	if (matName.empty() || !isalpha((unsigned char)matName[0]))
+		matName = ("x" + matName).substr(0, MAT_FILE_NAME_LENGTH);
+	return matName;
+}
+
+
+// Array flags, dimensions and name of a matrix whose data (dataSize bytes, a multiple of 8) follow
+static void AppendMatrixHeader(std::string &buffer, unsigned int classFlags, unsigned int nbRows, unsigned int nbColumns, const std::string &name, unsigned int dataSize)
+{
+	unsigned int nameSize = (name.size() + 7) / 8 * 8;
+	AppendTag(buffer, MI_MATRIX, 16 + 16 + 8 + nameSize + dataSize);
+	AppendTag(buffer, MI_UINT32, 8);
+	unsigned int flags[2] = {classFlags, 0};
+	AppendBytes(buffer, flags, sizeof(flags));
+	AppendTag(buffer, MI_INT32, 8);
+	int dimensions[2] = {(int)nbRows, (int)nbColumns};
+	AppendBytes(buffer, dimensions, sizeof(dimensions));
+	AppendTag(buffer, MI_INT8, name.size());
+	buffer.append(name);
+	AppendPadding(buffer);
+}
+
+
+static void AppendDoubleMatrix(std::string &buffer, const std::string &name, const double *values, unsigned int nbRows, unsigned int nbColumns)
+{
+	unsigned int nbValues = nbRows * nbColumns;
+	AppendMatrixHeader(buffer, MX_DOUBLE_CLASS, nbRows, nbColumns, name, 8 + nbValues * sizeof(double));
+	AppendTag(buffer, MI_DOUBLE, nbValues * sizeof(double));
+	if (nbValues > 0)
+		AppendBytes(buffer, values, nbValues * sizeof(double));
+}
+
+
+static void AppendLogical(std::string &buffer, const std::string &name, bool value)
+{
+	AppendMatrixHeader(buffer, MX_UINT8_CLASS | MX_LOGICAL_FLAG, 1, 1, name, 16);
+	AppendTag(buffer, MI_UINT8, 1);
+	buffer.append(1, value ? '\1' : '\0');
+	AppendPadding(buffer);
+}
+
+
+static void AppendText(std::string &buffer, const std::string &name, const std::string &text)
+{
+	unsigned int textSize = text.size() * sizeof(unsigned short);
+	AppendMatrixHeader(buffer, MX_CHAR_CLASS, text.empty() ? 0 : 1, text.size(), name, 8 + (textSize + 7) / 8 * 8);
+	AppendTag(buffer, MI_UINT16, textSize);
+	for (unsigned int i=0; i<text.size(); i++)
+	{
+		unsigned short character = (unsigned char)text[i];
+		AppendBytes(buffer, &character, sizeof(unsigned short));
+	}
+	AppendPadding(buffer);
+}
+
+
+// 1x1 struct: fields are the matrices (with empty names) in fieldData, in the order of fieldNames
+static void AppendStruct(std::string &buffer, const std::string &name, const std::vector<std::string> &fieldNames, const std::string &fieldData)
+{
+	unsigned int fieldNameLength = 8;
+	for (unsigned int f=0; f<fieldNames.size(); f++)
+		while (fieldNames[f].size() + 1 > fieldNameLength)
+			fieldNameLength += 8;
+	unsigned int namesSize = (fieldNames.size() * fieldNameLength + 7) / 8 * 8;
+	AppendMatrixHeader(buffer, MX_STRUCT_CLASS, 1, 1, name, 16 + 8 + namesSize + fieldData.size());
+	AppendTag(buffer, MI_INT32, 4);
+	int length = fieldNameLength;
+	AppendBytes(buffer, &length, sizeof(int));
+	AppendPadding(buffer);
+	AppendTag(buffer, MI_INT8, fieldNames.size() * fieldNameLength);
+	for (unsigned int f=0; f<fieldNames.size(); f++)
+	{
+		buffer.append(fieldNames[f]);
+		buffer.append(fieldNameLength - fieldNames[f].size(), '\0');
+	}
+	AppendPadding(buffer);
+	buffer.append(fieldData);
+}
+
+
+// Field names of a struct (valid and distinct)
+static void AddFieldName(std::vector<std::string> &fieldNames, const std::string &name)
+{
+	std::string baseName = MatName(name);
+	std::string fieldName = baseName;
+	bool isUsed = true;
+	for (int k=1; isUsed; k++)
+	{
+		isUsed = false;
+		for (unsigned int f=0; f<fieldNames.size() && !isUsed; f++)
+			isUsed = (fieldNames[f] == fieldName);
+		if (isUsed)
+			fieldName = baseName.substr(0, MAT_FILE_NAME_LENGTH - 4) + "_" + std::to_string(k);
+	}
+	fieldNames.push_back(fieldName);
+}
+
+
+int WriteTrialMatHeader(std::ostream &file, const TrialHeader &header, const std::vector<std::string> &channelNames, const std::vector<std::string> &channelUnits)
+{
+	std::string buffer;
+
+	// Header of the file: text (116 bytes), subsystem data offset (unused), version and endian indicator
+	char description[117];
+	time_t now = time(NULL);
+	struct tm localTime;
+	char date[64];
+	localtime_s(&localTime, &now);
+	strftime(date, sizeof(date), "%a %b %d %H:%M:%S %Y", &localTime);
+	memset(description, ' ', sizeof(description));
+	sprintf_s(description, "MATLAB 5.0 MAT-file, Platform: PCWIN, Created on: %s", date);
+	description[strlen(description)] = ' '; // padded with spaces, not terminated
+	buffer.append(description, 116);
+	buffer.append(8, '\0');
+	unsigned short version = 0x0100;
+	AppendBytes(buffer, &version, sizeof(unsigned short));
+	buffer.append("IM");
+
+	AppendText(buffer, "taskName", header.taskName);
+
+	// Parameters and units
+	std::vector<std::string> fieldNames;
+	std::string values, units;
+	for (unsigned int p=0; p<header.nbParameters; p++)
+	{
+		const TrialParameter &parameter = header.parameters[p];
+		AddFieldName(fieldNames, parameter.name);
+		double value = parameter.value;
+		if (parameter.type == PARAMETER_INT)
+			value = (double)parameter.intValue;
+		if (parameter.type == PARAMETER_BOOL)
+			AppendLogical(values, "", parameter.intValue != 0);
+		else if (parameter.type == PARAMETER_VECTOR)
+			AppendDoubleMatrix(values, "", parameter.values.empty() ? NULL : &parameter.values[0], parameter.values.empty() ? 0 : 1, parameter.values.size());
+		else if (parameter.type == PARAMETER_NONE)
+			AppendDoubleMatrix(values, "", NULL, 0, 0); // []
+		else
+			AppendDoubleMatrix(values, "", &value, 1, 1);
+		AppendText(units, "", parameter.unit);
+	}
+	AppendStruct(buffer, "parameters", fieldNames, values);
+	AppendStruct(buffer, "parameterUnits", fieldNames, units);
+
+	fieldNames.clear();
+	units.clear();
+	for (unsigned int c=0; c<channelNames.size(); c++)
+	{
+		AddFieldName(fieldNames, channelNames[c]);
+		AppendText(units, "", channelUnits[c]);
+	}
+	AppendStruct(buffer, "channelUnits", fieldNames, units);
+
+	file.write(buffer.data(), buffer.size());
+	if (file.fail())
+		return -1;
+	return 0;
+}
+
+
+int WriteTrialMatChannelHeader(std::ostream &file, const std::string &channelName, unsigned int nbSamples)
+{
+	std::string buffer;
+	AppendMatrixHeader(buffer, MX_DOUBLE_CLASS, nbSamples, 1, MatName(channelName), 8 + nbSamples * sizeof(double));
+	AppendTag(buffer, MI_DOUBLE, nbSamples * sizeof(double));
+	file.write(buffer.data(), buffer.size());
+	if (file.fail())
+		return -1;
+	return 0;
+}
+
+
+int WriteTrialMat(std::ostream &file, const TrialHeader &header, const std::vector<std::string> &channelNames, const std::vector<std::string> &channelUnits, const double * const *channels, unsigned int nbSamples)
+{
+	if (WriteTrialMatHeader(file, header, channelNames, channelUnits) != 0)
+		return -1;
+
+	// Columns, directly from the recorded channels (a multiple of 8 bytes, no padding)
+	for (unsigned int c=0; c<channelNames.size(); c++)
+	{
+		if (WriteTrialMatChannelHeader(file, channelNames[c], nbSamples) != 0)
+			return -1;
+		if (nbSamples > 0)
+			file.write((const char*)channels[c], nbSamples * sizeof(double));
+	}
+	if (file.fail())
+		return -1;
+	return 0;
+}
@@ -0,0 +1,34 @@
+#ifndef MATFILE_H_INCLUDED
+#define MATFILE_H_INCLUDED
+
+/* Data file of one trial in the MATLAB format (MAT-file version 5), loaded directly with load in MATLAB (or scipy.io.loadmat) */
+/*
+	Variables of the file:
+	- taskName: text
+	- parameters: struct with one field per parameter of the trial (double, logical for the booleans, row vector for the vectors, [] when not available)
+	- parameterUnits, channelUnits: structs with the unit (text) of each parameter and of each channel
+	- one column vector of doubles per recorded channel, named as the channel (Time, Pendulum_Angle...)
+	The names which are not valid MATLAB names are modified (invalid characters replaced by '_', at most 63 characters).
+
+	Each element of the file is a tag (unsigned int type, unsigned int nbBytes) followed by its data padded to a multiple of 8 bytes. The size of each variable
+	is known before its data are written, so that the columns can be streamed from the recorded channels (or from the chunks of the trial, see TrialWriter).
+	The data are not compressed (miCOMPRESSED would need zlib).
+*/
+#include <time.h>
+#include <ctype.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <iostream>
+#include "trialFile.h"
+
+#define MAT_FILE_NAME_LENGTH 63 // longest name of a variable or field (namelengthmax of MATLAB)
+
+// Write a trial in a MAT-file (stream opened in binary mode). Return -1 if the writing failed
+int WriteTrialMat(std::ostream &file, const TrialHeader &header, const std::vector<std::string> &channelNames, const std::vector<std::string> &channelUnits, const double * const *channels, unsigned int nbSamples);
+// The same file written in parts, when the samples are not all in memory: the header of the file and the parameters, then for each channel in turn,
+// the header of its variable followed by its nbSamples samples (raw doubles, written by the caller in as many parts as needed)
+int WriteTrialMatHeader(std::ostream &file, const TrialHeader &header, const std::vector<std::string> &channelNames, const std::vector<std::string> &channelUnits);
+int WriteTrialMatChannelHeader(std::ostream &file, const std::string &channelName, unsigned int nbSamples);
+
+#endif // MATFILE_H_INCLUDED
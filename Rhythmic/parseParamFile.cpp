@@ -1,6 +1,12 @@
 #include "parseParamFile.h"
 
 int parseParamFile(const std::string filename_input, std::string &filename_output, std::vector<std::pair<std::string, std::string> > &param_name_type, std::map<std::string, int> &param_map_int, std::map<std::string, bool> &param_map_bool, std::map<std::string, double> &param_map_double)
+{
+	std::map<std::string, std::vector<double> > param_map_vector;
+	return parseParamFile(filename_input, filename_output, param_name_type, param_map_int, param_map_bool, param_map_double, param_map_vector);
+}
+
+int parseParamFile(const std::string filename_input, std::string &filename_output, std::vector<std::pair<std::string, std::string> > &param_name_type, std::map<std::string, int> &param_map_int, std::map<std::string, bool> &param_map_bool, std::map<std::string, double> &param_map_double, std::map<std::string, std::vector<double> > &param_map_vector)
 {
 
 	const char *delimiter_comment = "%";
@@ -42,6 +48,22 @@ int parseParamFile(const std::string filename_input, std::string &filename_outpu
 							param_map_bool.insert( std::pair<std::string, bool>(name, value=="1"));
 						else if (type == TYPE_DOUBLE)	
 							param_map_double.insert( std::pair<std::string, double>(name, std::atof(value.c_str())));
+						else if (type == TYPE_VECTOR)
+						{
+							std::vector<double> values;
+							std::replace(value.begin(), value.end(), ';', ',');
+							size_t start = 0;
+							while (start < value.size()) // an empty value gives an empty vector
+							{
+								size_t end = value.find(',', start);
+								if (end == std::string::npos)
+									end = value.size();
+								if (end > start)
+									values.push_back(std::atof(value.substr(start, end - start).c_str()));
+								start = end + 1;
+							}
+							param_map_vector.insert( std::pair<std::string, std::vector<double> >(name, values));
+						}
 						// remove the paramater from the vector of parameter that should be read in the file
 						param_name_type.erase(param_name_type.begin() + index);
 					}
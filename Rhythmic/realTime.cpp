@@ -0,0 +1,109 @@
+#include "realTime.h"
+
+int SetRealTimePriority(HANDLE thread, int priority)
+{
+	int result = 0;
+	DWORD priorityClass = (priority == REAL_TIME_REALTIME) ? REALTIME_PRIORITY_CLASS : HIGH_PRIORITY_CLASS;
+	const char *className = (priority == REAL_TIME_REALTIME) ? "REALTIME" : "HIGH";
+	if (!SetPriorityClass(GetCurrentProcess(), priorityClass))
+	{
+		std::cout << "Real-time mode: priority class " << className << " FAILED (error " << GetLastError() << ")" << std::endl;
+		result = -1;
+	}
+	else if (GetPriorityClass(GetCurrentProcess()) != priorityClass)
+	{
+		std::cout << "Real-time mode: priority class " << className << " FAILED (refused by Windows, the program must be run as administrator), HIGH is used" << std::endl;
+		result = -1;
+	}
+	else
+		std::cout << "Real-time mode: priority class " << className << " OK" << std::endl;
+
+	if (!SetThreadPriority(thread, THREAD_PRIORITY_TIME_CRITICAL) || GetThreadPriority(thread) != THREAD_PRIORITY_TIME_CRITICAL)
+	{
+		std::cout << "Real-time mode: time critical priority of the control loop FAILED (error " << GetLastError() << ")" << std::endl;
+		result = -1;
+	}
+	else
+		std::cout << "Real-time mode: time critical priority of the control loop OK" << std::endl;
+	return result;
+}
+
+
+int PinThreadToCpu(HANDLE thread, int cpu)
+{
+	DWORD_PTR processMask, systemMask;
+	if (!GetProcessAffinityMask(GetCurrentProcess(), &processMask, &systemMask))
+	{
+		std::cout << "Real-time mode: control loop on CPU " << cpu << " FAILED (error " << GetLastError() << ")" << std::endl;
+		return -1;
+	}
+	if (cpu < 0 || cpu >= (int)(8 * sizeof(DWORD_PTR)) || (processMask & ((DWORD_PTR)1 << cpu)) == 0)
+	{
+		std::cout << "Real-time mode: control loop on CPU " << cpu << " FAILED (no such CPU for this program, affinity mask 0x" << std::hex << processMask << std::dec << ")" << std::endl;
+		return -1;
+	}
+	// The previous mask is returned: setting the mask twice checks that the first call was applied
+	DWORD_PTR cpuMask = (DWORD_PTR)1 << cpu;
+	if (SetThreadAffinityMask(thread, cpuMask) == 0 || SetThreadAffinityMask(thread, cpuMask) != cpuMask)
+	{
+		std::cout << "Real-time mode: control loop on CPU " << cpu << " FAILED (error " << GetLastError() << ")" << std::endl;
+		return -1;
+	}
+	std::cout << "Real-time mode: control loop on CPU " << cpu << " OK" << std::endl;
+	return 0;
+}
+
+
+int KeepThreadOffCpu(HANDLE thread, int cpu)
+{
+	DWORD_PTR processMask, systemMask;
+	if (!GetProcessAffinityMask(GetCurrentProcess(), &processMask, &systemMask) || cpu < 0 || cpu >= (int)(8 * sizeof(DWORD_PTR)))
+		return -1; // already reported by PinThreadToCpu
+	DWORD_PTR otherMask = processMask & ~((DWORD_PTR)1 << cpu);
+	if (otherMask == 0)
+	{
+		std::cout << "Real-time mode: other threads off CPU " << cpu << " FAILED (no other CPU)" << std::endl;
+		return -1;
+	}
+	if (SetThreadAffinityMask(thread, otherMask) == 0 || SetThreadAffinityMask(thread, otherMask) != otherMask)
+	{
+		std::cout << "Real-time mode: other threads off CPU " << cpu << " FAILED (error " << GetLastError() << ")" << std::endl;
+		return -1;
+	}
+	return 0;
+}
+
+
+int LockMemory(const void *address, SIZE_T size, const char *name)
+{
+	if (!VirtualLock((LPVOID)address, size))
+	{
+		std::cout << "Real-time mode: " << name << " locked in memory FAILED (error " << GetLastError() << ")" << std::endl;
+		return -1;
+	}
+	std::cout << "Real-time mode: " << name << " locked in memory OK" << std::endl;
+	return 0;
+}
+
+
+int LockWorkingSet()
+{
+	PROCESS_MEMORY_COUNTERS counters;
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+	{
+		std::cout << "Real-time mode: memory kept in RAM FAILED (error " << GetLastError() << ")" << std::endl;
+		return -1;
+	}
+	SIZE_T minimum = counters.WorkingSetSize + REAL_TIME_WORKING_SET_MARGIN;
+	SIZE_T maximum = minimum + REAL_TIME_WORKING_SET_MARGIN;
+	SIZE_T currentMinimum, currentMaximum;
+	DWORD flags;
+	if (!SetProcessWorkingSetSizeEx(GetCurrentProcess(), minimum, maximum, QUOTA_LIMITS_HARDWS_MIN_ENABLE | QUOTA_LIMITS_HARDWS_MAX_DISABLE) ||
+		!GetProcessWorkingSetSizeEx(GetCurrentProcess(), &currentMinimum, &currentMaximum, &flags) || (flags & QUOTA_LIMITS_HARDWS_MIN_ENABLE) == 0 || currentMinimum < minimum)
+	{
+		std::cout << "Real-time mode: memory kept in RAM FAILED (error " << GetLastError() << ")" << std::endl;
+		return -1;
+	}
+	std::cout << "Real-time mode: memory kept in RAM OK (" << minimum / (1024 * 1024) << " MB)" << std::endl;
+	return 0;
+}
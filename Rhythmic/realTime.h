@@ -0,0 +1,33 @@
+#ifndef REALTIME_H_INCLUDED
+#define REALTIME_H_INCLUDED
+
+/* Real-time mode of the control loop */
+/*
+	On a shared PC, the other processes can delay a tick of the control loop by several milliseconds (scheduling, pages of the program written to
+	the disk and read back), which is felt as a glitch of the force of the ball. In real-time mode:
+	- the priority of the process is raised (REAL_TIME_HIGH: HIGH_PRIORITY_CLASS, REAL_TIME_REALTIME: REALTIME_PRIORITY_CLASS, which needs to run
+	  as administrator, otherwise Windows silently uses HIGH_PRIORITY_CLASS) and the loop thread is THREAD_PRIORITY_TIME_CRITICAL
+	- the loop thread can be pinned to one CPU, and the other threads of the program (display, writer) are kept off this CPU.
+	  Windows cannot keep the other processes off a CPU: the high priority is what makes them wait
+	- the recording buffers are allocated and touched at the start of the block (see TrialWriter::Reserve), the models are locked in memory, then
+	  all the pages of the program are kept in memory (hard minimum of the working set, the equivalent of mlockall)
+	Each step prints whether it succeeded, and the reason otherwise (the program continues without it).
+*/
+#include <windows.h>
+#include <psapi.h>
+#include <iostream>
+
+#define REAL_TIME_OFF 0
+#define REAL_TIME_HIGH 1
+#define REAL_TIME_REALTIME 2
+
+#define REAL_TIME_WORKING_SET_MARGIN (64 * 1024 * 1024) // (bytes) memory allocated after the lock which is also kept in memory
+
+// Each function prints the result. Return -1 if it failed
+int SetRealTimePriority(HANDLE thread, int priority); // priority of the process and of the (loop) thread
+int PinThreadToCpu(HANDLE thread, int cpu);
+int KeepThreadOffCpu(HANDLE thread, int cpu);
+int LockMemory(const void *address, SIZE_T size, const char *name); // page in and lock
+int LockWorkingSet(); // keep all the pages in memory
+
+#endif // REALTIME_H_INCLUDED
@@ -0,0 +1,58 @@
+#ifndef RECORDER_H_INCLUDED
+#define RECORDER_H_INCLUDED
+
+/* Storage of the data recorded during one trial */
+/*
+	All the channels (time, pendulum angle, cart position...) are stored in one contiguous buffer, channel after channel (structure of arrays):
+	the sample i of channel c is at index c * capacity + i. The buffer is allocated once, before the trial starts, for the longest expected trial,
+	so that appending a sample in the control loop only writes one value per channel (no allocation).
+	If a trial is longer than expected, the buffer grows (which allocates and copies, in the control loop) and a warning is printed when the data are written.
+*/
+#include <string>
+#include <vector>
+#include <iostream>
+
+#define RECORDER_MAX_CHANNELS 64 // maximal number of values in one sample
+
+class Recorder
+{
+	public:
+		Recorder();
+		~Recorder();
+
+		// Declare a channel (must be done before the first sample). Return the index of the channel
+		int AddChannel(const std::string name, const std::string unit);
+		// Make sure that nbSamples samples can be recorded without allocation (nothing is done if the buffer is already large enough)
+		void Reserve(unsigned int nbSamples);
+		// Forget the recorded samples (the buffer is kept for the next trial)
+		void Clear();
+		// Append one sample: values[c] is the value of channel c (in the order of declaration)
+		void Append(const double *values);
+		// Give the recorded samples to another recorder without copying them (the other recorder gets the same channels).
+		// In exchange, this recorder gets the buffer of the other one, which is reused for the next trial
+		void HandOver(Recorder &destination);
+		// Declare the same channels as source (nothing is done if they are already the same, otherwise the samples and the buffer are lost)
+		void CopyChannels(Recorder &source);
+
+		unsigned int GetNbSamples();
+		unsigned int GetNbChannels();
+		unsigned int GetCapacity();
+		unsigned int GetNbGrowths(); // number of times the buffer had to grow since the last Clear (should be 0)
+		const double* GetChannel(int channel); // contiguous samples of one channel
+		const std::string& GetChannelName(int channel);
+		const std::string& GetChannelUnit(int channel);
+		const std::vector<std::string>& GetChannelNames();
+		const std::vector<std::string>& GetChannelUnits();
+
+	private:
+		void Grow(unsigned int newCapacity);
+
+		std::vector<std::string> channelNames;
+		std::vector<std::string> channelUnits;
+		std::vector<double> samples;
+		unsigned int capacity; // number of samples per channel in the buffer
+		unsigned int nbSamples;
+		unsigned int nbGrowths;
+};
+
+#endif // RECORDER_H_INCLUDED
@@ -0,0 +1,224 @@
+#include "scope.h"
+
+#define SCOPE_TEXT_HEIGHT 14 // (pixels) GLUT_BITMAP_HELVETICA_12
+
+Scope::Scope()
+{
+	for (int channel=0; channel<SCOPE_NB_CHANNELS; channel++)
+	{
+		minimums[channel] = -1.;
+		maximums[channel] = 1.;
+		nbReferences[channel] = 0;
+	}
+	nbPushed = 0;
+	nbRead = 0;
+	nbLost = 0;
+	lastTime = 0.;
+	for (int i=0; i<SCOPE_NB_COLUMNS; i++)
+		columns[i].index = -1;
+}
+
+
+void Scope::SetChannel(int channel, const std::string &name, double minimum, double maximum)
+{
+	if (channel < 0 || channel >= SCOPE_NB_CHANNELS)
+		return;
+	names[channel] = name;
+	minimums[channel] = minimum;
+	maximums[channel] = maximum;
+}
+
+
+void Scope::AddReference(int channel, double value)
+{
+	if (channel < 0 || channel >= SCOPE_NB_CHANNELS || nbReferences[channel] == SCOPE_MAX_REFERENCES)
+		return;
+	references[channel][nbReferences[channel]] = value;
+	nbReferences[channel]++;
+}
+
+
+void Scope::Push(double time, const double values[SCOPE_NB_CHANNELS])
+{
+	unsigned int index = nbPushed.load(std::memory_order_relaxed);
+	Sample &sample = ring[index % SCOPE_RING_SIZE];
+	sample.time = time;
+	for (int channel=0; channel<SCOPE_NB_CHANNELS; channel++)
+		sample.values[channel] = (float)values[channel];
+	nbPushed.store(index + 1, std::memory_order_release);
+}
+
+
+void Scope::ReadSamples()
+{
+	const double columnDuration = SCOPE_DURATION / SCOPE_NB_COLUMNS;
+	unsigned int nbAvailable = nbPushed.load(std::memory_order_acquire);
+	if (nbAvailable - nbRead > SCOPE_RING_SIZE / 2) // the oldest ones may be overwritten while they are read
+	{
+		nbLost += nbAvailable - nbRead - SCOPE_RING_SIZE / 2;
+		nbRead = nbAvailable - SCOPE_RING_SIZE / 2;
+	}
+	while (nbRead != nbAvailable)
+	{
+		Sample sample = ring[nbRead % SCOPE_RING_SIZE];
+		// The slot is written again by the loop SCOPE_RING_SIZE samples later: the copy is valid if the loop has not reached it yet
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (nbPushed.load(std::memory_order_relaxed) - nbRead >= SCOPE_RING_SIZE)
+		{
+			nbLost++;
+			nbRead++;
+			continue;
+		}
+		nbRead++;
+
+		if (sample.time < lastTime - SCOPE_DURATION) // the clock was restarted
+			for (int i=0; i<SCOPE_NB_COLUMNS; i++)
+				columns[i].index = -1;
+		lastTime = sample.time;
+		long long index = (long long)floor(sample.time / columnDuration);
+		if (index < 0)
+			continue;
+		Column &column = columns[index % SCOPE_NB_COLUMNS];
+		if (column.index != index) // the column is reused for a new period of time
+		{
+			column.index = index;
+			for (int channel=0; channel<SCOPE_NB_CHANNELS; channel++)
+				column.minimum[channel] = column.maximum[channel] = sample.values[channel];
+		}
+		for (int channel=0; channel<SCOPE_NB_CHANNELS; channel++)
+		{
+			float value = sample.values[channel];
+			if (value < column.minimum[channel])
+				column.minimum[channel] = value;
+			if (value > column.maximum[channel])
+				column.maximum[channel] = value;
+			column.last[channel] = value;
+		}
+	}
+}
+
+
+void Scope::Draw()
+{
+	ReadSamples();
+
+	double width = glutGet(GLUT_WINDOW_WIDTH);
+	double height = glutGet(GLUT_WINDOW_HEIGHT);
+	glViewport(0, 0, (GLsizei)width, (GLsizei)height);
+	glMatrixMode(GL_PROJECTION);
+	glLoadIdentity();
+	gluOrtho2D(0., width, 0., height);
+	glMatrixMode(GL_MODELVIEW);
+	glLoadIdentity();
+	glClear(GL_COLOR_BUFFER_BIT);
+
+	long long lastColumnIndex = (long long)floor(lastTime / (SCOPE_DURATION / SCOPE_NB_COLUMNS));
+	double channelHeight = height / SCOPE_NB_CHANNELS;
+	for (int channel=0; channel<SCOPE_NB_CHANNELS; channel++)
+		DrawChannel(channel, height - (channel + 1) * channelHeight, channelHeight, lastColumnIndex);
+
+	if (nbLost > 0)
+	{
+		char text[64];
+		sprintf_s(text, "%u samples lost", nbLost);
+		glColor3f(1.f, 0.3f, 0.3f);
+		DrawText(width - 120., 4., text);
+	}
+}
+
+
+void Scope::DrawChannel(int channel, double bottom, double height, long long lastColumnIndex)
+{
+	double width = glutGet(GLUT_WINDOW_WIDTH);
+	double columnWidth = width / SCOPE_NB_COLUMNS;
+	long long firstColumnIndex = lastColumnIndex - SCOPE_NB_COLUMNS + 1;
+
+	// Range: the fixed one, extended to the values shown
+	double minimum = minimums[channel];
+	double maximum = maximums[channel];
+	bool hasValue = false;
+	float lastValue = 0.f;
+	for (long long index=firstColumnIndex; index<=lastColumnIndex; index++)
+	{
+		if (index < 0)
+			continue;
+		const Column &column = columns[index % SCOPE_NB_COLUMNS];
+		if (column.index != index)
+			continue;
+		if (column.minimum[channel] < minimum)
+			minimum = column.minimum[channel];
+		if (column.maximum[channel] > maximum)
+			maximum = column.maximum[channel];
+		hasValue = true;
+		lastValue = column.last[channel];
+	}
+	if (maximum <= minimum)
+		maximum = minimum + 1.;
+	// A margin so that the trace does not touch the next channel
+	double plotBottom = bottom + 0.05 * height;
+	double scale = 0.9 * height / (maximum - minimum);
+
+	// Frame and reference lines
+	glLineWidth(1.f);
+	glColor3f(0.3f, 0.3f, 0.3f);
+	glBegin(GL_LINE_LOOP);
+	glVertex2f(0.f, (GLfloat)bottom);
+	glVertex2f((GLfloat)width, (GLfloat)bottom);
+	glVertex2f((GLfloat)width, (GLfloat)(bottom + height));
+	glVertex2f(0.f, (GLfloat)(bottom + height));
+	glEnd();
+	glColor3f(0.8f, 0.6f, 0.f);
+	glBegin(GL_LINES);
+	for (int i=0; i<nbReferences[channel]; i++)
+	{
+		GLfloat y = (GLfloat)(plotBottom + (references[channel][i] - minimum) * scale);
+		glVertex2f(0.f, y);
+		glVertex2f((GLfloat)width, y);
+	}
+	glEnd();
+
+	// Trace: the extent of each column, and the last values of consecutive columns joined
+	glColor3f(0.2f, 1.f, 0.2f);
+	glBegin(GL_LINES);
+	bool isPreviousDrawn = false;
+	GLfloat previousX = 0.f, previousY = 0.f;
+	for (long long index=firstColumnIndex; index<=lastColumnIndex; index++)
+	{
+		const Column &column = columns[(index < 0 ? 0 : index) % SCOPE_NB_COLUMNS];
+		if (index < 0 || column.index != index)
+		{
+			isPreviousDrawn = false;
+			continue;
+		}
+		GLfloat x = (GLfloat)((index - firstColumnIndex + 0.5) * columnWidth);
+		GLfloat y = (GLfloat)(plotBottom + (column.last[channel] - minimum) * scale);
+		glVertex2f(x, (GLfloat)(plotBottom + (column.minimum[channel] - minimum) * scale));
+		glVertex2f(x, (GLfloat)(plotBottom + (column.maximum[channel] - minimum) * scale));
+		if (isPreviousDrawn)
+		{
+			glVertex2f(previousX, previousY);
+			glVertex2f(x, y);
+		}
+		isPreviousDrawn = true;
+		previousX = x;
+		previousY = y;
+	}
+	glEnd();
+
+	// Name, last value and range
+	char text[256];
+	if (hasValue)
+		sprintf_s(text, "%s: %.3f   [%.3f, %.3f]", names[channel].c_str(), lastValue, minimum, maximum);
+	else
+		sprintf_s(text, "%s", names[channel].c_str());
+	glColor3f(1.f, 1.f, 1.f);
+	DrawText(4., bottom + height - SCOPE_TEXT_HEIGHT, text);
+}
+
+
+void Scope::DrawText(double x, double y, const std::string &text)
+{
+	glRasterPos2i((int)x, (int)y);
+	for (unsigned int i=0; i<text.length(); i++)
+		glutBitmapCharacter(GLUT_BITMAP_HELVETICA_12, text[i]);
+}
@@ -0,0 +1,151 @@
+#ifndef TRIALFILE_H_INCLUDED
+#define TRIALFILE_H_INCLUDED
+
+/* Data file of one trial: parameters of the trial (header) and recorded channels */
+/*
+	Two formats are available:
+	- CSV (text, ';' separated): one line per parameter (name;value;unit), then the names and units of the channels, then one line per sample
+	- binary: same content, but typed and with the samples stored as contiguous columns of doubles, so that the file can be mapped in memory
+	  and the channels used directly, without parsing (see TrialFileReader). ConvertTrialFile converts a binary file into the CSV file which
+	  would have been written by the experiment program (both use WriteTrialCsv)
+	- compressed binary: the binary file with the magic "CUPTRIAC", and the columns compressed without loss (see columnCodec.h). TrialFileReader
+	  decompresses the columns when the file is opened
+
+	Binary file format (little endian, strings are stored as unsigned int length + characters without terminating zero):
+		char[8] magic ("CUPTRIAL"), unsigned int version, nbParameters, nbChannels, nbSamples, unsigned __int64 dataOffset
+		double nbHeaderLines, string taskName
+		nbParameters x (string name, string unit, unsigned char type, value) where value is a double (PARAMETER_DOUBLE), an __int64 (PARAMETER_INT),
+			an unsigned char (PARAMETER_BOOL), an unsigned int n + n doubles (PARAMETER_VECTOR) or nothing (PARAMETER_NONE, written N/A in the CSV file)
+		nbChannels x (string name, string unit)
+		zeros up to dataOffset (multiple of 8, so that the columns are aligned)
+		double samples[nbChannels * nbSamples] (sample i of channel c is at index c * nbSamples + i)
+		(compressed binary file: nbChannels x (unsigned __int64 nbBytes, compressed column) instead of the samples)
+*/
+#include <windows.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <fstream>
+#include "csvEmitter.h"
+#include "columnCodec.h"
+
+#define TRIAL_FILE_CSV 0
+#define TRIAL_FILE_BINARY 1
+#define TRIAL_FILE_BLOCK 2 // all the trials of the block in one file (see blockFile.h)
+#define TRIAL_FILE_CSV_EXACT 3 // CSV with the shortest text which reads back the exact recorded values, instead of 6 significant digits (see csvEmitter.h)
+#define TRIAL_FILE_COMPRESSED 4 // binary with the columns compressed without loss (see columnCodec.h)
+#define TRIAL_FILE_MAT 5 // MATLAB MAT-file (see matFile.h)
+#define TRIAL_FILE_VERSION 1
+
+#define PARAMETER_NONE 0 // value not available in this trial
+#define PARAMETER_DOUBLE 1
+#define PARAMETER_INT 2
+#define PARAMETER_BOOL 3
+#define PARAMETER_VECTOR 4
+
+struct TrialParameter
+{
+	std::string name;
+	std::string unit;
+	int type;
+	double value; // PARAMETER_DOUBLE
+	__int64 intValue; // PARAMETER_INT and PARAMETER_BOOL
+	std::vector<double> values; // PARAMETER_VECTOR
+};
+
+// Parameters of one trial, in the order of the file
+class TrialHeader
+{
+	public:
+		TrialHeader();
+		~TrialHeader();
+
+		// Start a new header (the memory of the previous parameters is reused). nbHeaderLines is the number of parameter lines announced in the CSV file
+		void Clear(const std::string &nameOfTask, double nbLines);
+		void AddDouble(const std::string &name, double value, const std::string &unit);
+		void AddInt(const std::string &name, __int64 value, const std::string &unit);
+		void AddBool(const std::string &name, bool value, const std::string &unit);
+		void AddVector(const std::string &name, const std::vector<double> &values, const std::string &unit); // an empty vector is written N/A
+		void AddNotAvailable(const std::string &name, const std::string &unit);
+		void Swap(TrialHeader &other); // exchange the parameters with other without copying them (the memory of both is kept for their next parameters)
+
+		std::string taskName;
+		double nbHeaderLines;
+		std::vector<TrialParameter> parameters; // only the nbParameters first ones are used
+		unsigned int nbParameters;
+
+	private:
+		TrialParameter& AddParameter(const std::string &name, int type, const std::string &unit);
+};
+
+// Write a trial file in the given stream (opened in text mode for CSV, in binary mode for the binary format). Return -1 if the writing failed
+// The samples of the CSV files are formatted by emitter (its buffer is reused from one file to the next)
+int WriteTrialCsv(std::ostream &file, const TrialHeader &header, const std::vector<std::string> &channelNames, const std::vector<std::string> &channelUnits, const double * const *channels, unsigned int nbSamples, CsvEmitter &emitter);
+int WriteTrialBinary(std::ostream &file, const TrialHeader &header, const std::vector<std::string> &channelNames, const std::vector<std::string> &channelUnits, const double * const *channels, unsigned int nbSamples);
+// Compressed binary file: the columns are compressed with encoder in column (buffer reused from one column to the next)
+int WriteTrialCompressed(std::ostream &file, const TrialHeader &header, const std::vector<std::string> &channelNames, const std::vector<std::string> &channelUnits, const double * const *channels, unsigned int nbSamples, ColumnEncoder &encoder, std::string &column);
+// The same files written in parts, when the samples are not all in memory (see TrialWriter::SubmitChunk): the header (with the names of the channels), then
+// the samples in as many calls as needed (CSV: consecutive samples of all the channels; binary: each column in turn, nbSamples is the total number of samples)
+int WriteTrialCsvHeader(std::ostream &file, const TrialHeader &header, const std::vector<std::string> &channelNames, const std::vector<std::string> &channelUnits);
+int WriteTrialCsvSamples(std::ostream &file, const double * const *channels, unsigned int nbChannels, unsigned int nbSamples, CsvEmitter &emitter);
+int WriteTrialBinaryHeader(std::ostream &file, const TrialHeader &header, const std::vector<std::string> &channelNames, const std::vector<std::string> &channelUnits, unsigned int nbSamples, bool isCompressed = false);
+int WriteTrialCompressedColumn(std::ostream &file, const std::string &column); // after WriteTrialBinaryHeader(..., true), each compressed column in turn
+
+// Serialization of the parameters and strings in the binary formats (also used by the block files, see blockFile.h)
+void AppendBytes(std::string &buffer, const void *source, size_t nbBytes);
+void AppendString(std::string &buffer, const std::string &text);
+void AppendParameter(std::string &buffer, const TrialParameter &parameter);
+bool IsSameParameter(const TrialParameter &parameter1, const TrialParameter &parameter2);
+// Read at position in data (of size dataSize) and move position after what was read. Return false if the data are too short or invalid
+bool ReadBytes(const char *data, unsigned __int64 dataSize, unsigned __int64 &position, void *destination, size_t nbBytes);
+bool ReadString(const char *data, unsigned __int64 dataSize, unsigned __int64 &position, std::string &text);
+bool ReadParameter(const char *data, unsigned __int64 dataSize, unsigned __int64 &position, TrialParameter &parameter);
+
+// Whole file mapped in memory (read only)
+class MappedFile
+{
+	public:
+		MappedFile();
+		~MappedFile();
+
+		int Open(const std::string filename); // return -1 if the file cannot be opened or mapped
+		void Close();
+		const char* GetData(); // the view starts on a page boundary
+		unsigned __int64 GetSize();
+
+	private:
+		HANDLE fileHandle;
+		HANDLE mappingHandle;
+		const char *fileView;
+		unsigned __int64 fileSize;
+};
+
+// Read-only access to a binary trial file mapped in memory: the channels point directly into the file (compressed file: into the decompressed columns)
+class TrialFileReader
+{
+	public:
+		TrialFileReader();
+		~TrialFileReader();
+
+		int Open(const std::string filename); // return -1 if the file cannot be mapped or is not a valid trial file
+		void Close();
+
+		const TrialHeader& GetHeader();
+		const std::vector<std::string>& GetChannelNames();
+		const std::vector<std::string>& GetChannelUnits();
+		unsigned int GetNbSamples();
+		const double* const* GetChannels(); // GetChannels()[c] is the first sample of channel c
+
+	private:
+		MappedFile file;
+		TrialHeader header;
+		std::vector<std::string> channelNames;
+		std::vector<std::string> channelUnits;
+		std::vector<const double*> channels;
+		unsigned int nbSamples;
+		std::vector<double> decompressedSamples; // compressed file only
+		ColumnDecoder decoder;
+};
+
+#endif // TRIALFILE_H_INCLUDED
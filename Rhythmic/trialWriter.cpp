@@ -0,0 +1,520 @@
+#include "trialWriter.h"
+
+TrialWriter::TrialWriter()
+{
+	firstTrialFile = 0;
+	nbTrialFiles = 0;
+	isStopping = false;
+	chunkTrialNb = 0;
+	isChunkFileValid = false;
+	chunkNbGrowths = 0;
+	nbJournaledTrialFiles = 0;
+	writerThread = std::thread(&TrialWriter::Run, this);
+}
+
+TrialWriter::~TrialWriter()
+{
+	{
+		std::unique_lock<std::mutex> lock(queueMutex);
+		isStopping = true;
+	}
+	queueChanged.notify_all();
+	writerThread.join(); // the thread only stops when the queue is empty
+}
+
+
+bool TrialWriter::Submit(int trialNb, const std::string &filename, int format, TrialHeader &header, Recorder &recorder)
+{
+	std::unique_lock<std::mutex> lock(queueMutex);
+	if (nbTrialFiles == TRIAL_WRITER_QUEUE_SIZE)
+		return false;
+	TrialFile &trialFile = queue[(firstTrialFile + nbTrialFiles) % TRIAL_WRITER_QUEUE_SIZE];
+	trialFile.isChunk = false;
+	trialFile.trialNb = trialNb;
+	trialFile.filename = filename;
+	trialFile.format = format;
+	trialFile.header.Swap(header);
+	recorder.HandOver(trialFile.data);
+	nbTrialFiles++;
+	lock.unlock();
+	queueChanged.notify_all();
+	return true;
+}
+
+
+void TrialWriter::PrepareChunks(Recorder &recorder, unsigned int chunkNbSamples)
+{
+	std::unique_lock<std::mutex> lock(queueMutex);
+	while (nbTrialFiles > 0)
+		queueChanged.wait(lock);
+	for (unsigned int i=0; i<TRIAL_WRITER_QUEUE_SIZE; i++)
+	{
+		queue[i].filename.reserve(MAX_PATH); // room for any file name, no allocation in SubmitChunk
+		queue[i].data.CopyChannels(recorder);
+		queue[i].data.Clear();
+		queue[i].data.Reserve(chunkNbSamples);
+	}
+}
+
+
+void TrialWriter::Reserve(Recorder &recorder, unsigned int nbSamples)
+{
+	std::unique_lock<std::mutex> lock(queueMutex);
+	while (nbTrialFiles > 0)
+		queueChanged.wait(lock);
+	for (unsigned int i=0; i<TRIAL_WRITER_QUEUE_SIZE; i++)
+	{
+		queue[i].data.CopyChannels(recorder);
+		queue[i].data.Clear();
+		queue[i].data.Reserve(nbSamples);
+	}
+}
+
+
+bool TrialWriter::SubmitChunk(int trialNb, const std::string &filename, Recorder &recorder)
+{
+	std::unique_lock<std::mutex> lock(queueMutex);
+	if (nbTrialFiles == TRIAL_WRITER_QUEUE_SIZE)
+		return false;
+	TrialFile &trialFile = queue[(firstTrialFile + nbTrialFiles) % TRIAL_WRITER_QUEUE_SIZE];
+	trialFile.isChunk = true;
+	trialFile.trialNb = trialNb;
+	trialFile.filename = filename;
+	recorder.HandOver(trialFile.data);
+	nbTrialFiles++;
+	lock.unlock();
+	queueChanged.notify_all();
+	return true;
+}
+
+
+int TrialWriter::GetFailedTrial()
+{
+	std::unique_lock<std::mutex> lock(queueMutex);
+	if (failedTrials.empty())
+		return -1;
+	int trialNb = failedTrials.front();
+	failedTrials.erase(failedTrials.begin());
+	return trialNb;
+}
+
+
+unsigned int TrialWriter::GetNbPendingTrials()
+{
+	std::unique_lock<std::mutex> lock(queueMutex);
+	return nbTrialFiles;
+}
+
+
+void TrialWriter::Flush()
+{
+	std::unique_lock<std::mutex> lock(queueMutex);
+	while (nbTrialFiles > 0)
+		queueChanged.wait(lock);
+}
+
+
+HANDLE TrialWriter::GetThreadHandle()
+{
+	return (HANDLE)writerThread.native_handle();
+}
+
+
+int TrialWriter::OpenJournal(const std::string &directory, const std::string &filename)
+{
+	// The thread is idle until the next trial: the trials of the previous runs can be written from here
+	Flush();
+
+	// The name of the journal changes from one run to the next (date of the block): all the journals of the directory are recovered
+	std::vector<std::string> previousJournals;
+	WIN32_FIND_DATAA findData;
+	HANDLE findHandle = FindFirstFileA((directory + "*.journal").c_str(), &findData);
+	if (findHandle != INVALID_HANDLE_VALUE)
+	{
+		do
+		{
+			if (!(findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+				previousJournals.push_back(directory + findData.cFileName);
+		} while (FindNextFileA(findHandle, &findData));
+		FindClose(findHandle);
+	}
+	int nbRecovered = 0;
+	for (unsigned int j=0; j<previousJournals.size(); j++)
+	{
+		int nbTrials = RecoverJournal(previousJournals[j]);
+		if (nbTrials < 0)
+			continue; // kept for the next start
+		nbRecovered += nbTrials;
+		if (previousJournals[j] != filename)
+			DeleteFileA(previousJournals[j].c_str()); // nothing left in it
+	}
+
+	if (journal.Open(filename) != 0)
+	{
+		std::cout << "Error: cannot open the journal " << filename << ", the trials are not journaled" << std::endl;
+		return -1;
+	}
+	return nbRecovered;
+}
+
+
+int TrialWriter::RecoverJournal(const std::string &filename)
+{
+	std::vector<JournalTrial> trials;
+	unsigned __int64 nbIgnoredBytes;
+	if (TrialJournal::Read(filename, trials, nbIgnoredBytes) != 0)
+	{
+		std::cout << "Error: the journal " << filename << " cannot be read, it is kept" << std::endl;
+		return -1;
+	}
+	if (nbIgnoredBytes > 0)
+		std::cout << "Journal " << filename << ": the last " << nbIgnoredBytes << " bytes were not completely written and are ignored" << std::endl;
+
+	int nbRecovered = 0;
+	for (unsigned int t=0; t<trials.size(); t++)
+	{
+		JournalTrial &trial = trials[t];
+		if (trial.isWritten)
+			continue;
+		TrialFile trialFile;
+		trialFile.isChunk = false;
+		trialFile.trialNb = trial.trialNb;
+		std::string extension = (trial.filename.find_last_of('.') != std::string::npos) ? trial.filename.substr(trial.filename.find_last_of('.')) : "";
+		std::string stem = trial.filename.substr(0, trial.filename.size() - extension.size());
+		if (trial.isSubmitted)
+		{
+			// The trial is written as it would have been (the block file of the interrupted run is not replaced, the trials are gathered in another block file)
+			trialFile.filename = (trial.format == TRIAL_FILE_BLOCK) ? stem + "_recovered" + extension : trial.filename;
+			trialFile.format = trial.format;
+			trialFile.header = trial.header;
+		}
+		else
+		{
+			// Interrupted during the motion: the samples of the durable chunks, without the parameters of the trial
+			char nbTrialChar[12];
+			_itoa_s(trial.trialNb, nbTrialChar, 10);
+			trialFile.filename = (extension == ".blk") ? stem + "_trial_" + nbTrialChar + "_partial.csv" : stem + "_partial.csv";
+			trialFile.format = TRIAL_FILE_CSV;
+			trialFile.header.Clear("InterruptedTrial", 1);
+			trialFile.header.AddInt("TrialNumber", trial.trialNb, "N/A");
+		}
+		unsigned int nbSamples = trial.channels.empty() ? 0 : trial.channels[0].size();
+		double sample[RECORDER_MAX_CHANNELS];
+		for (unsigned int c=0; c<trial.channels.size(); c++)
+			trialFile.data.AddChannel(trial.channelNames[c], trial.channelUnits[c]);
+		trialFile.data.Reserve(nbSamples);
+		for (unsigned int i=0; i<nbSamples; i++)
+		{
+			for (unsigned int c=0; c<trial.channels.size(); c++)
+				sample[c] = trial.channels[c][i];
+			trialFile.data.Append(sample);
+		}
+		if (WriteTrial(trialFile) != 0 || SyncFile(trialFile.filename) != 0)
+		{
+			std::cout << "Error: trial " << trial.trialNb << " of the journal " << filename << " could not be written in " << trialFile.filename << ", the journal is kept" << std::endl;
+			blockFile.Close();
+			return -1;
+		}
+		remove((trial.filename + ".part").c_str()); // temporary file of a trial recorded in chunks
+		std::cout << "Trial " << trial.trialNb << " recovered from the journal in " << trialFile.filename << ((trial.isSubmitted) ? "" : " (interrupted, " + std::to_string(nbSamples) + " samples)") << std::endl;
+		nbRecovered++;
+	}
+	blockFile.Close(); // the block file of the next trials is a new file
+	return nbRecovered;
+}
+
+
+void TrialWriter::JournalQueue(std::unique_lock<std::mutex> &lock)
+{
+	// Group commit: one flush to the disk for all the trial files received since the previous wake-up
+	if (nbJournaledTrialFiles == nbTrialFiles || !journal.IsOpen())
+		return;
+	bool isJournalValid = true;
+	while (nbJournaledTrialFiles < nbTrialFiles)
+	{
+		TrialFile &trialFile = queue[(firstTrialFile + nbJournaledTrialFiles) % TRIAL_WRITER_QUEUE_SIZE];
+		lock.unlock();
+		if (trialFile.isChunk)
+			isJournalValid = (journal.AppendChunk(trialFile.trialNb, trialFile.filename, trialFile.data) == 0) && isJournalValid;
+		else
+			isJournalValid = (journal.AppendTrial(trialFile.trialNb, trialFile.filename, trialFile.format, trialFile.header, trialFile.data) == 0) && isJournalValid;
+		lock.lock();
+		nbJournaledTrialFiles++;
+	}
+	lock.unlock();
+	isJournalValid = (journal.Commit() == 0) && isJournalValid;
+	if (!isJournalValid)
+	{
+		std::cout << "Error: the journal cannot be written, the next trials will not be recovered after a crash" << std::endl;
+		journal.Close();
+	}
+	lock.lock();
+}
+
+
+void TrialWriter::Run()
+{
+	std::unique_lock<std::mutex> lock(queueMutex);
+	while (true)
+	{
+		while (nbTrialFiles == 0 && !isStopping)
+			queueChanged.wait(lock);
+		if (nbTrialFiles == 0) // stopping and nothing left to write
+			break;
+
+		JournalQueue(lock);
+
+		// The slot stays in the queue while it is written, so that Submit does not reuse it
+		TrialFile &trialFile = queue[firstTrialFile];
+		lock.unlock();
+		int result = trialFile.isChunk ? WriteChunk(trialFile) : WriteTrial(trialFile);
+		// The trial can be forgotten once its file is on the disk (otherwise it is written again at the next start). A trial of a block file is on the disk
+		// with the index which follows it: the next trials are written after this index, which stays valid if the program stops while they are written
+		if (result == 0 && !trialFile.isChunk && journal.IsOpen() && SyncFile(trialFile.filename) == 0)
+			journal.AppendWritten(trialFile.trialNb, trialFile.filename);
+		lock.lock();
+		if (result != 0 && !trialFile.isChunk) // a chunk which could not be written makes the trial fail
+			failedTrials.push_back(trialFile.trialNb);
+		trialFile.data.Clear();
+		firstTrialFile = (firstTrialFile + 1) % TRIAL_WRITER_QUEUE_SIZE;
+		nbTrialFiles--;
+		if (nbJournaledTrialFiles > 0)
+			nbJournaledTrialFiles--;
+		queueChanged.notify_all();
+	}
+}
+
+
+int TrialWriter::WriteTrial(TrialFile &trialFile)
+{
+	// Trial recorded in chunks: the last samples are the last chunk
+	if (!chunkFilename.empty() && (chunkTrialNb != trialFile.trialNb || chunkFilename != trialFile.filename + ".part"))
+		CloseChunks(); // chunks of an interrupted trial
+	if (!chunkFilename.empty())
+	{
+		WriteChunk(trialFile);
+		if (chunkNbGrowths > 0)
+			std::cout << "Warning: the recording buffer was too small for trial " << trialFile.trialNb << ", it was reallocated during the motion" << std::endl;
+		int result = isChunkFileValid ? WriteTrialFromChunks(trialFile) : -1;
+		CloseChunks();
+		return result;
+	}
+
+	Recorder &data = trialFile.data;
+	std::vector<const double*> channels(data.GetNbChannels());
+	for (unsigned int c=0; c<channels.size(); c++)
+		channels[c] = data.GetChannel(c);
+	const double * const *channelsStart = channels.empty() ? NULL : &channels[0];
+	if (data.GetNbGrowths() > 0)
+		std::cout << "Warning: the recording buffer was too small for trial " << trialFile.trialNb << " (" << data.GetNbSamples() << " samples), it was reallocated during the motion" << std::endl;
+
+	// The block file stays open for the next trials
+	if (trialFile.format == TRIAL_FILE_BLOCK)
+	{
+		if (!blockFile.IsOpen(trialFile.filename) && blockFile.Open(trialFile.filename) != 0)
+			return -1;
+		return blockFile.AppendTrial(trialFile.trialNb, trialFile.header, data.GetChannelNames(), data.GetChannelUnits(), channelsStart, data.GetNbSamples());
+	}
+
+	std::ofstream data_file;
+	if (trialFile.format == TRIAL_FILE_BINARY || trialFile.format == TRIAL_FILE_COMPRESSED || trialFile.format == TRIAL_FILE_MAT)
+		data_file.open(trialFile.filename.c_str(), std::ios::binary);
+	else
+		data_file.open(trialFile.filename.c_str());
+	if (!data_file)
+		return -1;
+	int result;
+	if (trialFile.format == TRIAL_FILE_BINARY)
+		result = WriteTrialBinary(data_file, trialFile.header, data.GetChannelNames(), data.GetChannelUnits(), channelsStart, data.GetNbSamples());
+	else if (trialFile.format == TRIAL_FILE_MAT)
+		result = WriteTrialMat(data_file, trialFile.header, data.GetChannelNames(), data.GetChannelUnits(), channelsStart, data.GetNbSamples());
+	else if (trialFile.format == TRIAL_FILE_COMPRESSED)
+		result = WriteTrialCompressed(data_file, trialFile.header, data.GetChannelNames(), data.GetChannelUnits(), channelsStart, data.GetNbSamples(), columnEncoder, compressedColumn);
+	else
+	{
+		csvEmitter.SetMode((trialFile.format == TRIAL_FILE_CSV_EXACT) ? CSV_EMITTER_SHORTEST : CSV_EMITTER_STRICT);
+		result = WriteTrialCsv(data_file, trialFile.header, data.GetChannelNames(), data.GetChannelUnits(), channelsStart, data.GetNbSamples(), csvEmitter);
+	}
+	data_file.close();
+	if (result != 0 || data_file.fail())
+		return -1;
+	return 0;
+}
+
+
+int TrialWriter::WriteChunk(TrialFile &trialFile)
+{
+	Recorder &data = trialFile.data;
+	std::string filename = trialFile.filename + ".part";
+	if (chunkTrialNb != trialFile.trialNb || chunkFilename != filename)
+	{
+		CloseChunks();
+		chunkFile.open(filename.c_str(), std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+		chunkFilename = filename;
+		chunkTrialNb = trialFile.trialNb;
+		isChunkFileValid = chunkFile.is_open();
+		if (!chunkFile.is_open())
+			return -1;
+	}
+	chunkNbGrowths += data.GetNbGrowths();
+	if (data.GetNbSamples() == 0 || !isChunkFileValid)
+		return isChunkFileValid ? 0 : -1;
+
+	// Raw columns of the chunk at the end of the file
+	chunkFile.seekp(0, std::ios::end);
+	chunkOffsets.push_back(chunkFile.tellp());
+	chunkSizes.push_back(data.GetNbSamples());
+	for (unsigned int c=0; c<data.GetNbChannels(); c++)
+		chunkFile.write((const char*)data.GetChannel(c), data.GetNbSamples() * sizeof(double));
+	if (chunkFile.fail())
+	{
+		isChunkFileValid = false;
+		return -1;
+	}
+	return 0;
+}
+
+
+int TrialWriter::WriteTrialFromChunks(TrialFile &trialFile)
+{
+	Recorder &data = trialFile.data;
+	unsigned int nbChannels = data.GetNbChannels();
+	unsigned int nbSamples = 0;
+	for (unsigned int k=0; k<chunkSizes.size(); k++)
+		nbSamples += chunkSizes[k];
+	chunkFile.flush();
+
+	// CSV: the lines of the samples of each chunk in turn
+	if (trialFile.format == TRIAL_FILE_CSV || trialFile.format == TRIAL_FILE_CSV_EXACT)
+	{
+		csvEmitter.SetMode((trialFile.format == TRIAL_FILE_CSV_EXACT) ? CSV_EMITTER_SHORTEST : CSV_EMITTER_STRICT);
+		std::ofstream data_file(trialFile.filename.c_str());
+		if (!data_file || WriteTrialCsvHeader(data_file, trialFile.header, data.GetChannelNames(), data.GetChannelUnits()) != 0)
+			return -1;
+		std::vector<const double*> channels(nbChannels);
+		for (unsigned int k=0; k<chunkSizes.size() && nbChannels>0; k++)
+		{
+			if (!ReadChunk(k, 0, nbChannels))
+				return -1;
+			for (unsigned int c=0; c<nbChannels; c++)
+				channels[c] = &chunkBuffer[0] + c * chunkSizes[k];
+			if (WriteTrialCsvSamples(data_file, &channels[0], nbChannels, chunkSizes[k], csvEmitter) != 0)
+				return -1;
+		}
+		data_file.close();
+		if (data_file.fail())
+			return -1;
+		return 0;
+	}
+
+	// Compressed file: each column is compressed as the chunks are read
+	if (trialFile.format == TRIAL_FILE_COMPRESSED)
+	{
+		std::ofstream data_file(trialFile.filename.c_str(), std::ios::binary);
+		if (!data_file || WriteTrialBinaryHeader(data_file, trialFile.header, data.GetChannelNames(), data.GetChannelUnits(), nbSamples, true) != 0)
+			return -1;
+		for (unsigned int c=0; c<nbChannels; c++)
+		{
+			compressedColumn.clear();
+			columnEncoder.Begin(compressedColumn);
+			for (unsigned int k=0; k<chunkSizes.size(); k++)
+			{
+				if (!ReadChunk(k, c, 1))
+					return -1;
+				columnEncoder.Append(&chunkBuffer[0], chunkSizes[k]);
+			}
+			columnEncoder.End();
+			if (WriteTrialCompressedColumn(data_file, compressedColumn) != 0)
+				return -1;
+		}
+		data_file.close();
+		if (data_file.fail())
+			return -1;
+		return 0;
+	}
+
+	// MAT-file: each variable is the concatenation of the columns of the chunks
+	if (trialFile.format == TRIAL_FILE_MAT)
+	{
+		std::ofstream data_file(trialFile.filename.c_str(), std::ios::binary);
+		if (!data_file || WriteTrialMatHeader(data_file, trialFile.header, data.GetChannelNames(), data.GetChannelUnits()) != 0)
+			return -1;
+		for (unsigned int c=0; c<nbChannels; c++)
+		{
+			if (WriteTrialMatChannelHeader(data_file, data.GetChannelName(c), nbSamples) != 0)
+				return -1;
+			for (unsigned int k=0; k<chunkSizes.size(); k++)
+			{
+				if (!ReadChunk(k, c, 1))
+					return -1;
+				data_file.write((const char*)&chunkBuffer[0], chunkSizes[k] * sizeof(double));
+			}
+		}
+		data_file.close();
+		if (data_file.fail())
+			return -1;
+		return 0;
+	}
+
+	// Binary and block files: each column is the concatenation of the columns of the chunks
+	std::ofstream data_file;
+	if (trialFile.format == TRIAL_FILE_BLOCK)
+	{
+		if (!blockFile.IsOpen(trialFile.filename) && blockFile.Open(trialFile.filename) != 0)
+			return -1;
+		if (blockFile.BeginTrial(trialFile.trialNb, trialFile.header, data.GetChannelNames(), data.GetChannelUnits(), nbSamples) != 0)
+			return -1;
+	}
+	else
+	{
+		data_file.open(trialFile.filename.c_str(), std::ios::binary);
+		if (!data_file || WriteTrialBinaryHeader(data_file, trialFile.header, data.GetChannelNames(), data.GetChannelUnits(), nbSamples) != 0)
+			return -1;
+	}
+	for (unsigned int c=0; c<nbChannels; c++)
+		for (unsigned int k=0; k<chunkSizes.size(); k++)
+		{
+			if (!ReadChunk(k, c, 1))
+				return -1;
+			if (trialFile.format == TRIAL_FILE_BLOCK)
+			{
+				if (blockFile.WriteSamples(&chunkBuffer[0], chunkSizes[k]) != 0)
+					return -1;
+			}
+			else
+				data_file.write((const char*)&chunkBuffer[0], chunkSizes[k] * sizeof(double));
+		}
+	if (trialFile.format == TRIAL_FILE_BLOCK)
+		return blockFile.EndTrial();
+	data_file.close();
+	if (data_file.fail())
+		return -1;
+	return 0;
+}
+
+
+bool TrialWriter::ReadChunk(unsigned int chunk, unsigned int firstChannel, unsigned int nbChannels)
+{
+	unsigned int nbValues = nbChannels * chunkSizes[chunk];
+	if (chunkBuffer.size() < nbValues)
+		chunkBuffer.resize(nbValues);
+	chunkFile.seekg(chunkOffsets[chunk] + (unsigned __int64)firstChannel * chunkSizes[chunk] * sizeof(double));
+	chunkFile.read((char*)&chunkBuffer[0], nbValues * sizeof(double));
+	return !chunkFile.fail();
+}
+
+
+void TrialWriter::CloseChunks()
+{
+	if (chunkFile.is_open())
+	{
+		chunkFile.close();
+		remove(chunkFilename.c_str());
+	}
+	chunkFile.clear();
+	chunkFilename.clear();
+	isChunkFileValid = false;
+	chunkNbGrowths = 0;
+	chunkOffsets.clear();
+	chunkSizes.clear();
+}